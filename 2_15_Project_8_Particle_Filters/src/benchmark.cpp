@@ -0,0 +1,350 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include "particle_filter.h"
+#include "rng.h"
+
+using namespace std;
+
+// Headless, deterministic benchmark of the particle filter. Replays control, observation and ground truth
+// data through the filter with a fixed seed for every particle count and prints one line per count.
+//
+// usage: pf_benchmark [options]
+//   --data DIR          replay DIR/control_data.txt, DIR/gt_data.txt and DIR/observation/observations_NNNNNN.txt
+//   --synthetic STEPS   drive a circle through the map and generate the data instead (default, 2000 steps)
+//   --map FILE          map file, default ../data/map_data.txt
+//   --particles LIST    comma separated particle counts to sweep, default 100,1000,10000
+//   --threads LIST      comma separated worker thread counts to sweep for every particle count, default: all cores
+//   --seed S            seed of the filter and of the simulated sensor noise, default 1
+//   --global            start without the GPS pose, with a global localization on the first observations
+//   --field RES         score the observations with a likelihood field of RES m cells instead of associating them
+//   --json              print JSON lines instead of CSV
+
+// Parameters of the simulator, the same as in main.cpp
+static const double delta_t = 0.1;		// Time elapsed between measurements [sec]
+static const double sensor_range = 50;	// Sensor range [m]
+static double sigma_pos [3] = {0.3, 0.3, 0.01}; // GPS measurement uncertainty [x [m], y [m], theta [rad]]
+static double sigma_landmark [2] = {0.3, 0.3}; // Landmark measurement uncertainty [x [m], y [m]]
+
+struct Recording {
+  vector<control_s> controls;
+  vector<ground_truth> gt;
+  vector<vector<LandmarkObs> > observations;	// noiseless, in vehicle coordinates
+};
+
+struct RunResult {
+  int particles;
+  unsigned int threads;
+  size_t steps;
+  double prediction_s, update_s, resample_s, total_s;
+  double global_s;	// time of the global localization, if used
+  double mean_error[3], max_error[3];
+};
+
+void usage()
+{
+  cerr << "usage: pf_benchmark [--data DIR | --synthetic STEPS] [--map FILE] [--particles N,N,...]"
+       << " [--threads N,N,...] [--seed S] [--global] [--field RES] [--json]" << endl;
+}
+
+// Reads the recorded data set of the original project layout
+bool readRecording(const string &dir, Recording &recording)
+{
+  if (!read_control_data(dir + "/control_data.txt", recording.controls) ||
+      !read_gt_data(dir + "/gt_data.txt", recording.gt)) {
+    return false;
+  }
+
+  const size_t steps = min(recording.controls.size(), recording.gt.size());
+  recording.observations.resize(steps);
+  for (size_t i = 0; i < steps; ++i) {
+    ostringstream file;
+    file << dir << "/observation/observations_" << setfill('0') << setw(6) << i + 1 << ".txt";
+    if (!read_landmark_data(file.str(), recording.observations[i])) {
+      return false;
+    }
+  }
+  recording.controls.resize(steps);
+  recording.gt.resize(steps);
+  return steps > 0;
+}
+
+// Drives a circle around the middle of the map with a varying speed and records what the vehicle sees
+void synthesizeRecording(const Map &map, size_t steps, Recording &recording)
+{
+  double minX = 0, maxX = 0, minY = 0, maxY = 0;
+  for (size_t i = 0; i < map.landmark_list.size(); ++i) {
+    const MapLandmark &landmark = map.landmark_list[i];
+    if (i == 0 || landmark.x_f < minX) minX = landmark.x_f;
+    if (i == 0 || landmark.x_f > maxX) maxX = landmark.x_f;
+    if (i == 0 || landmark.y_f < minY) minY = landmark.y_f;
+    if (i == 0 || landmark.y_f > maxY) maxY = landmark.y_f;
+  }
+  const double centerX = 0.5 * (minX + maxX), centerY = 0.5 * (minY + maxY);
+
+  // take the circle around the map center which sees the most landmarks at its emptiest point
+  vector<int> inRange;
+  double radius = 10.0;
+  size_t bestCoverage = 0;
+  for (double fraction = 0.05; fraction <= 0.45; fraction += 0.05) {
+    const double candidate = max(10.0, fraction * min(maxX - minX, maxY - minY));
+    size_t coverage = map.landmark_list.size();
+    for (int k = 0; k < 100; ++k) {
+      map.grid.queryRange(centerX + candidate * cos(k * M_PI / 50), centerY + candidate * sin(k * M_PI / 50),
+                          sensor_range, inRange);
+      coverage = min(coverage, inRange.size());
+    }
+    if (coverage >= bestCoverage) {
+      bestCoverage = coverage;
+      radius = candidate;
+    }
+  }
+
+  ground_truth pose;
+  pose.x = centerX;
+  pose.y = centerY - radius;
+  pose.theta = 0.0;
+
+  for (size_t t = 0; t < steps; ++t) {
+    control_s control;
+    control.velocity = 5.0 + 3.0 * sin(t * 0.01);
+    control.yawrate = control.velocity / radius;
+
+    recording.gt.push_back(pose);
+    recording.controls.push_back(control);
+
+    vector<LandmarkObs> observations;
+    map.grid.queryRange(pose.x, pose.y, sensor_range, inRange);
+    const double c = cos(pose.theta), s = sin(pose.theta);
+    for (const int index : inRange) {
+      const MapLandmark &landmark = map.landmark_list[index];
+      const double dx = landmark.x_f - pose.x, dy = landmark.y_f - pose.y;
+      LandmarkObs obs;
+      obs.id = landmark.id_i;
+      obs.x = c * dx + s * dy;
+      obs.y = -s * dx + c * dy;
+      observations.push_back(obs);
+    }
+    recording.observations.push_back(observations);
+
+    // exact CTRV motion to the next step
+    const double v = control.velocity, w = control.yawrate;
+    pose.x += v / w * (sin(pose.theta + w * delta_t) - sin(pose.theta));
+    pose.y += v / w * (cos(pose.theta) - cos(pose.theta + w * delta_t));
+    pose.theta += w * delta_t;
+  }
+}
+
+// Runs the filter once over the recording, the same way main.cpp drives it
+RunResult run(const Map &map, const Recording &recording, int particles, unsigned int threads, uint64_t seed,
+              bool global)
+{
+  ParticleFilter pf;
+  pf.setThreadCount(threads);
+  if (!map.field.empty()) {
+    pf.setObservationModel(ObservationModel::LIKELIHOOD_FIELD);
+  }
+  pf.setParticleCount(particles);
+  pf.seed(seed);
+
+  // the simulated sensor noise only depends on the seed, so every particle count sees the same data
+  Xoshiro256 sensor(seed ^ 0x73656e736f72ULL);
+  vector<double> noise;
+
+  RunResult result;
+  memset(&result, 0, sizeof(result));
+  result.particles = particles;
+  result.threads = threads;
+  result.steps = recording.gt.size();
+
+  typedef chrono::steady_clock clock;
+  const clock::time_point start = clock::now();
+  vector<LandmarkObs> noisy_observations;
+  for (size_t i = 0; i < result.steps; ++i) {
+    const vector<LandmarkObs> &observations = recording.observations[i];
+    noise.resize(2 * observations.size() + 3);
+    fillGaussian(sensor, noise.data(), noise.size(), 0.0, 1.0);
+    noisy_observations = observations;
+    for (size_t j = 0; j < observations.size(); ++j) {
+      noisy_observations[j].x += noise[2 * j] * sigma_landmark[0];
+      noisy_observations[j].y += noise[2 * j + 1] * sigma_landmark[1];
+    }
+
+    clock::time_point t0 = clock::now();
+    if (!pf.initialized()) {
+      const double *gps_noise = &noise[2 * observations.size()];
+      if (global) {
+        // reported on its own, neither in the prediction nor in the step time
+        pf.initGlobal(noisy_observations, map, sigma_landmark, sigma_pos);
+        const clock::time_point end_global = clock::now();
+        result.global_s = chrono::duration<double>(end_global - t0).count();
+        t0 = end_global;
+      }
+      else {
+        pf.init(recording.gt[i].x + gps_noise[0] * sigma_pos[0], recording.gt[i].y + gps_noise[1] * sigma_pos[1],
+                recording.gt[i].theta + gps_noise[2] * sigma_pos[2], sigma_pos);
+      }
+    }
+    else {
+      pf.prediction(delta_t, sigma_pos, recording.controls[i - 1].velocity, recording.controls[i - 1].yawrate);
+    }
+    clock::time_point t1 = clock::now();
+    result.prediction_s += chrono::duration<double>(t1 - t0).count();
+
+    t0 = clock::now();
+    pf.updateWeights(sensor_range, sigma_landmark, noisy_observations, map);
+    t1 = clock::now();
+    pf.resample();
+    const clock::time_point t2 = clock::now();
+    result.update_s += chrono::duration<double>(t1 - t0).count();
+    result.resample_s += chrono::duration<double>(t2 - t1).count();
+
+    // error of the best particle
+    const FilterEstimate &estimate = pf.getEstimate();
+    const double *error = getError(recording.gt[i].x, recording.gt[i].y, recording.gt[i].theta,
+                                   estimate.best_x, estimate.best_y, estimate.best_theta);
+    for (int k = 0; k < 3; ++k) {
+      result.mean_error[k] += error[k] / result.steps;
+      result.max_error[k] = max(result.max_error[k], error[k]);
+    }
+  }
+  result.total_s = chrono::duration<double>(clock::now() - start).count() - result.global_s;
+  return result;
+}
+
+void printResult(const RunResult &r, bool json)
+{
+  const double perStep = 1e3 / max<size_t>(1, r.steps);
+  const double stepsPerSecond = r.steps / r.total_s;
+  if (json) {
+    cout << "{\"particles\":" << r.particles << ",\"threads\":" << r.threads << ",\"steps\":" << r.steps
+         << ",\"prediction_ms\":" << r.prediction_s * perStep << ",\"update_ms\":" << r.update_s * perStep
+         << ",\"resample_ms\":" << r.resample_s * perStep << ",\"step_ms\":" << r.total_s * perStep
+         << ",\"global_ms\":" << r.global_s * 1e3 << ",\"steps_per_s\":" << stepsPerSecond << ",\"particle_steps_per_s\":" << stepsPerSecond * r.particles
+         << ",\"mean_error\":[" << r.mean_error[0] << "," << r.mean_error[1] << "," << r.mean_error[2] << "]"
+         << ",\"max_error\":[" << r.max_error[0] << "," << r.max_error[1] << "," << r.max_error[2] << "]}" << endl;
+  }
+  else {
+    cout << r.particles << "," << r.threads << "," << r.steps << "," << r.prediction_s * perStep << ","
+         << r.update_s * perStep << "," << r.resample_s * perStep << "," << r.total_s * perStep << ","
+         << r.global_s * 1e3 << "," << stepsPerSecond << "," << stepsPerSecond * r.particles << ","
+         << r.mean_error[0] << "," << r.mean_error[1] << "," << r.mean_error[2] << ","
+         << r.max_error[0] << "," << r.max_error[1] << "," << r.max_error[2] << endl;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  string data_dir;
+  string map_file = "../data/map_data.txt";
+  size_t synthetic_steps = 2000;
+  vector<int> particle_counts;
+  vector<unsigned int> thread_counts;
+  uint64_t seed = 1;
+  bool json = false;
+  bool global = false;
+  double field_resolution = 0.0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+      data_dir = argv[++i];
+    }
+    else if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+      synthetic_steps = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+      map_file = argv[++i];
+    }
+    else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+      istringstream list(argv[++i]);
+      string count;
+      while (getline(list, count, ',')) {
+        particle_counts.push_back(atoi(count.c_str()));
+      }
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      istringstream list(argv[++i]);
+      string count;
+      while (getline(list, count, ',')) {
+        thread_counts.push_back(atoi(count.c_str()));
+      }
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], nullptr, 10);
+    }
+    else if (strcmp(argv[i], "--global") == 0) {
+      global = true;
+    }
+    else if (strcmp(argv[i], "--field") == 0 && i + 1 < argc) {
+      field_resolution = atof(argv[++i]);
+      if (!(field_resolution > 0.0)) {
+        usage();
+        return -1;
+      }
+    }
+    else if (strcmp(argv[i], "--json") == 0) {
+      json = true;
+    }
+    else {
+      usage();
+      return -1;
+    }
+  }
+  if (particle_counts.empty()) {
+    particle_counts = {100, 1000, 10000};
+  }
+
+  Map map;
+  if (!read_map_data(map_file, map)) {
+    cerr << "Error: Could not open map file " << map_file << endl;
+    return -1;
+  }
+
+  // the field has sigma_landmark baked in, the filter uses it in place of the one passed to updateWeights
+  if (field_resolution > 0.0) {
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    map.buildLikelihoodField(field_resolution, sigma_landmark, sensor_range);
+    cerr << "likelihood field: " << field_resolution << " m cells, "
+         << map.field.memoryUsage() / 1e6 << " MB, built in "
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s" << endl;
+  }
+
+  Recording recording;
+  if (!data_dir.empty()) {
+    if (!readRecording(data_dir, recording)) {
+      cerr << "Error: Could not read the recorded data in " << data_dir << endl;
+      return -1;
+    }
+  }
+  else {
+    synthesizeRecording(map, synthetic_steps, recording);
+  }
+
+  // the pool uses one thread per core if no count was given
+  if (thread_counts.empty()) {
+    thread_counts.push_back(0);
+  }
+  for (unsigned int &threads : thread_counts) {
+    if (threads == 0) {
+      threads = max(1u, thread::hardware_concurrency());
+    }
+  }
+
+  if (!json) {
+    cout << "particles,threads,steps,prediction_ms,update_ms,resample_ms,step_ms,global_ms,steps_per_s,particle_steps_per_s,"
+         << "mean_error_x,mean_error_y,mean_error_yaw,max_error_x,max_error_y,max_error_yaw" << endl;
+  }
+  for (const int count : particle_counts) {
+    for (const unsigned int threads : thread_counts) {
+      printResult(run(map, recording, count, threads, seed, global), json);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * fast_math.h
+ *
+ * Branch free math kernels which the compiler can vectorize over the particle arrays.
+ */
+
+#ifndef FAST_MATH_H_
+#define FAST_MATH_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Computes sine and cosine of x at once. The argument is reduced to [-pi/4, pi/4] with a three part
+ * Cody-Waite reduction and both functions are evaluated with the fdlibm minimax polynomials; the quadrant
+ * is applied with selects instead of branches. The error stays within a few ulp for |x| < 1e5, which covers
+ * every heading a particle can accumulate.
+ */
+inline void fast_sincos(double x, double &outSin, double &outCos) {
+
+	const double twoOverPi = 0.636619772367581343076;
+	const double pio2_1  = 1.57079632673412561417e+00;
+	const double pio2_2  = 6.07710050630396597660e-11;
+	const double pio2_2t = 2.02226624879595063154e-21;
+
+	// round to the nearest quadrant without a rounding instruction (valid for |x| < 2^51)
+	const double roundMagic = 6755399441055744.0;
+	const double k = (x * twoOverPi + roundMagic) - roundMagic;
+
+	const double r = ((x - k * pio2_1) - k * pio2_2) - k * pio2_2t;
+	const double z = r * r;
+
+	const double s = r + r * z * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03
+	               + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06
+	               + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+	const double c = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03
+	               + z * (2.48015872894767294178e-05 + z * (-2.75573143513906633035e-07
+	               + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+
+	// quadrant 0: ( s,  c)  1: ( c, -s)  2: (-s, -c)  3: (-c,  s)
+	// the quadrant is kept as a double m = k mod 4 in [-2, 2] (3 shows up as -1), so everything below
+	// compiles to vector compares and blends.
+	const double m = k - 4.0 * ((k * 0.25 + roundMagic) - roundMagic);
+	const double am = fabs(m);
+	const bool swap = (am == 1.0);
+	const bool sinNegative = (am == 2.0) | (m == -1.0);
+	const bool cosNegative = (am == 2.0) | (m == 1.0);
+	outSin = (swap ? c : s) * (sinNegative ? -1.0 : 1.0);
+	outCos = (swap ? s : c) * (cosNegative ? -1.0 : 1.0);
+}
+
+/*
+ * Computes the natural logarithm of a positive, normal x. x is split into 2^e * m with m in [sqrt(2)/2, sqrt(2))
+ * by integer operations and log(m) is evaluated with the fdlibm polynomial; the exponent is converted with the
+ * 2^52 trick instead of an integer conversion, which keeps the function vectorizable. Zero, negative,
+ * subnormal and non finite arguments are not handled.
+ */
+inline double fast_log(double x) {
+
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+
+	// shifting the bits by 1 - sqrt(2)/2 carries every mantissa above sqrt(2) into the exponent, so the fold
+	// needs no compare
+	const uint64_t shifted = bits + (0x3ff0000000000000ULL - 0x3fe6a09e667f3bcdULL);
+
+	// exponent as a double: the 11 exponent bits as mantissa of 2^52
+	const uint64_t exponentBits = (shifted >> 52) | 0x4330000000000000ULL;
+	double e;
+	memcpy(&e, &exponentBits, sizeof(e));
+	e -= 4503599627371519.0;	// 2^52 + 1023
+
+	// mantissa in [sqrt(2)/2, sqrt(2))
+	const uint64_t mantissaBits = (shifted & 0x000fffffffffffffULL) + 0x3fe6a09e667f3bcdULL;
+	double m;
+	memcpy(&m, &mantissaBits, sizeof(m));
+
+	const double f = m - 1.0;
+	const double s = f / (2.0 + f);
+	const double z = s * s;
+	const double w = z * z;
+	const double t1 = w * (3.999999999940941908e-01 + w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01));
+	const double t2 = z * (6.666666666666735130e-01 + w * (2.857142874366239149e-01
+	                + w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+	const double hfsq = 0.5 * f * f;
+	return e * 6.93147180369123816490e-01 - ((hfsq - (s * (hfsq + t1 + t2) + e * 1.90821492927058770002e-10)) - f);
+}
+
+/*
+ * Computes sin(x) / x, continuous at x = 0.
+ */
+inline double sinc(double x) {
+
+	// below the threshold the Taylor series is exact to double precision
+	if (fabs(x) < 1e-4) {
+		return 1.0 - x * x / 6.0;
+	}
+	return sin(x) / x;
+}
+
+#endif /* FAST_MATH_H_ */
@@ -0,0 +1,201 @@
+/*
+ * global_localizer.cpp
+ *
+ * Coarse-to-fine search for the vehicle pose without a prior.
+ */
+
+#include <algorithm>
+#include <math.h>
+
+#include "global_localizer.h"
+
+using namespace std;
+
+// minimum number of cells a worker thread scores
+static const size_t kMinCellsPerThread = 64;
+
+void GlobalLocalizer::localize(const std::vector<LandmarkObs> &inObservations, const Map &map_landmarks,
+                               const double std_landmark[], ThreadPool &pool,
+                               std::vector<PoseHypothesis> &outHypotheses)
+{
+    outHypotheses.clear();
+    if(inObservations.empty() || map_landmarks.grid.empty())
+    {
+        return;
+    }
+
+    map = &map_landmarks;
+    sigma = max(std_landmark[0], std_landmark[1]);
+
+    double maxRange = 0.0;
+    ranges.resize(inObservations.size());
+    for(size_t i = 0; i < inObservations.size(); ++i)
+    {
+        ranges[i] = sqrt(inObservations[i].x * inObservations[i].x + inObservations[i].y * inObservations[i].y);
+        maxRange = max(maxRange, ranges[i]);
+    }
+
+    // the closest observations for the levels
+    vector<size_t> order(inObservations.size());
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ranges[a] < ranges[b]; });
+    order.resize(min(order.size(), max<size_t>(1, config.max_observations)));
+    closest.clear();
+    closestRanges.clear();
+    for(const size_t i: order)
+    {
+        closest.push_back(inObservations[i]);
+        closestRanges.push_back(ranges[i]);
+    }
+
+    // the vehicle is within range of the landmarks it observes, so the search area is the bounding box of
+    // the map grown by the longest observation
+    const vector<MapLandmark> &landmarks = map_landmarks.landmark_list;
+    double minX = landmarks[0].x_f, maxX = minX, minY = landmarks[0].y_f, maxY = minY;
+    for(const auto &landmark: landmarks)
+    {
+        minX = min<double>(minX, landmark.x_f);
+        maxX = max<double>(maxX, landmark.x_f);
+        minY = min<double>(minY, landmark.y_f);
+        maxY = max<double>(maxY, landmark.y_f);
+    }
+    minX -= maxRange;
+    minY -= maxRange;
+    const double width = maxX + maxRange - minX, height = maxY + maxRange - minY;
+
+    // coarse level: the cell size grows with the map so the number of cells stays bounded
+    const int thetaCells = max(1, config.coarse_theta_cells);
+    double cellXY = max(config.min_coarse_xy,
+                        sqrt(width * height * thetaCells / double(max<size_t>(1, config.max_coarse_cells))));
+    double cellTheta = 2.0 * M_PI / thetaCells;
+    const int cols = max(1, int(ceil(width / cellXY)));
+    const int rows = max(1, int(ceil(height / cellXY)));
+
+    vector<Cell> cells;
+    cells.reserve(size_t(cols) * rows * thetaCells);
+    for(int row = 0; row < rows; ++row)
+    {
+        for(int col = 0; col < cols; ++col)
+        {
+            for(int t = 0; t < thetaCells; ++t)
+            {
+                Cell cell;
+                cell.x = minX + (col + 0.5) * cellXY;
+                cell.y = minY + (row + 0.5) * cellXY;
+                cell.theta = -M_PI + (t + 0.5) * cellTheta;
+                cell.error = cell.centerError = 0.0;
+                cells.push_back(cell);
+            }
+        }
+    }
+    score(cells, closest, closestRanges, cellXY * M_SQRT1_2, 0.5 * cellTheta, pool);
+
+    // refine the beam until the cells are fine enough
+    vector<Cell> children;
+    while(cellXY > config.fine_xy || cellTheta > config.fine_theta)
+    {
+        keepBest(cells, config.beam_width);
+
+        const bool splitXY = cellXY > config.fine_xy;
+        const bool splitTheta = cellTheta > config.fine_theta;
+        const double offsetXY = splitXY ? 0.25 * cellXY : 0.0;
+        const double offsetTheta = splitTheta ? 0.25 * cellTheta : 0.0;
+
+        children.clear();
+        for(const Cell &parent: cells)
+        {
+            for(int dy = splitXY ? -1 : 1; dy <= 1; dy += 2)
+            {
+                for(int dx = splitXY ? -1 : 1; dx <= 1; dx += 2)
+                {
+                    for(int dt = splitTheta ? -1 : 1; dt <= 1; dt += 2)
+                    {
+                        Cell child = parent;
+                        child.x += splitXY ? dx * offsetXY : 0.0;
+                        child.y += splitXY ? dy * offsetXY : 0.0;
+                        child.theta += splitTheta ? dt * offsetTheta : 0.0;
+                        children.push_back(child);
+                    }
+                }
+            }
+        }
+
+        cellXY *= splitXY ? 0.5 : 1.0;
+        cellTheta *= splitTheta ? 0.5 : 1.0;
+        score(children, closest, closestRanges, cellXY * M_SQRT1_2, 0.5 * cellTheta, pool);
+        swap(cells, children);
+    }
+
+    // rank the final cells by the error at their centers
+    score(cells, inObservations, ranges, 0.0, 0.0, pool);
+    keepBest(cells, config.max_hypotheses);
+    for(const Cell &cell: cells)
+    {
+        PoseHypothesis hypothesis;
+        hypothesis.x = cell.x;
+        hypothesis.y = cell.y;
+        hypothesis.theta = cell.theta;
+        hypothesis.error = cell.error;
+        outHypotheses.push_back(hypothesis);
+    }
+}
+
+void GlobalLocalizer::score(std::vector<Cell> &cells, const std::vector<LandmarkObs> &obs,
+                            const std::vector<double> &obsRanges, double halfXY, double halfTheta,
+                            ThreadPool &pool) const
+{
+    const Map &map_landmarks = *map;
+    const double norm = 1.0 / (2.0 * sigma * sigma);
+    const double maxError = config.max_error;
+    const double errorReach = sigma * sqrt(2.0 * maxError);
+
+    pool.parallelFor(cells.size(), kMinCellsPerThread, [&](size_t begin, size_t end, unsigned int)
+    {
+        for(size_t c = begin; c < end; ++c)
+        {
+            Cell &cell = cells[c];
+            const double cosTheta = cos(cell.theta), sinTheta = sin(cell.theta);
+
+            double error = 0.0, centerError = 0.0;
+            for(size_t i = 0; i < obs.size(); ++i)
+            {
+                const double transX = cosTheta*obs[i].x - sinTheta*obs[i].y + cell.x;
+                const double transY = sinTheta*obs[i].x + cosTheta*obs[i].y + cell.y;
+
+                // any pose of the cell moves the observation by at most the tolerance
+                const double tolerance = halfXY + obsRanges[i] * halfTheta;
+                const int closest = map_landmarks.grid.nearest(transX, transY, tolerance + errorReach);
+                if(closest < 0)
+                {
+                    error += maxError;
+                    centerError += maxError;
+                    continue;
+                }
+                const auto &landmark = map_landmarks.landmark_list[closest];
+                const double distance = dist(landmark.x_f, landmark.y_f, transX, transY);
+                const double excess = max(0.0, distance - tolerance);
+                error += min(maxError, excess * excess * norm);
+                centerError += min(maxError, distance * distance * norm);
+            }
+            cell.error = error;
+            cell.centerError = centerError;
+        }
+    });
+}
+
+void GlobalLocalizer::keepBest(std::vector<Cell> &cells, size_t count)
+{
+    // the bound is zero for many cells of a dense map, the error at the center decides between them. the sort
+    // is stable, so the result is reproducible.
+    stable_sort(cells.begin(), cells.end(), [](const Cell &a, const Cell &b)
+    {
+        return a.error < b.error || (a.error == b.error && a.centerError < b.centerError);
+    });
+    if(cells.size() > count)
+    {
+        cells.resize(count);
+    }
+}
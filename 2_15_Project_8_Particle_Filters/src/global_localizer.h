@@ -0,0 +1,99 @@
+/*
+ * global_localizer.h
+ *
+ * Coarse-to-fine search for the vehicle pose without a prior.
+ */
+
+#ifndef GLOBAL_LOCALIZER_H_
+#define GLOBAL_LOCALIZER_H_
+
+#include <vector>
+
+#include "helper_functions.h"
+#include "thread_pool.h"
+
+/*
+ * Parameters of the global localization.
+ */
+struct GlobalLocalizationConfig {
+
+	double min_coarse_xy;		// Lower bound of the edge length of the coarse cells [m]
+	int coarse_theta_cells;		// Number of heading cells of the coarse level
+	size_t max_coarse_cells;	// Upper bound of the number of coarse cells, larger maps get larger cells
+	size_t beam_width;			// Number of cells refined per level
+	double fine_xy;				// The search stops once the cells are at most this large in x / y [m]
+	double fine_theta;			// ... and in theta [rad]
+	size_t max_hypotheses;		// Number of poses returned
+	size_t max_observations;	// The levels are scored with at most this many of the closest observations
+	double max_error;			// Error of an observation without a matching landmark (clamp of the error)
+
+	GlobalLocalizationConfig() : min_coarse_xy(8.0), coarse_theta_cells(32), max_coarse_cells(200000),
+	                             beam_width(512), fine_xy(0.5), fine_theta(0.02), max_hypotheses(16),
+	                             max_observations(16), max_error(12.5) {}
+};
+
+/*
+ * A pose candidate and the error of the observations from it (the negative log-likelihood up to a constant).
+ */
+struct PoseHypothesis {
+
+	double x;
+	double y;
+	double theta;
+	double error;
+};
+
+/*
+ * Branch and bound style search over a hierarchical (x, y, theta) grid covering the map. A cell is scored
+ * with an optimistic bound of the observation error of any pose inside it: every observation may be off by
+ * the cell's half diagonal plus its range times half the heading cell, so only the distance to the closest
+ * landmark beyond that tolerance counts. The best cells of a level (the beam) are split into eight children
+ * which are scored with tighter tolerances, until the cells reach the fine resolution. The number of cell
+ * evaluations is bounded by max_coarse_cells + levels * beam_width * 8 regardless of the map size, and every
+ * evaluation is one nearest landmark query for each of the max_observations closest observations (they have
+ * the smallest heading tolerance). Only the final ranking uses all observations.
+ */
+class GlobalLocalizer {
+
+public:
+
+	GlobalLocalizer() : map(nullptr), sigma(1.0) {}
+
+	void setConfig(const GlobalLocalizationConfig &inConfig) { config = inConfig; }
+	const GlobalLocalizationConfig &getConfig() const { return config; }
+
+	//! Searches the poses from which the observations match the map best
+	//! \param observations Landmark observations in vehicle coordinates
+	//! \param map_landmarks The map with its spatial index
+	//! \param std_landmark Landmark measurement uncertainty [x [m], y [m]]
+	//! \param pool Threads the cells are scored on
+	//! \param outHypotheses Receives up to max_hypotheses poses, best first
+	void localize(const std::vector<LandmarkObs> &observations, const Map &map_landmarks,
+	              const double std_landmark[], ThreadPool &pool, std::vector<PoseHypothesis> &outHypotheses);
+
+private:
+
+	struct Cell {
+		double x, y, theta;		// Center of the cell
+		double error;			// Lower bound of the error within the cell
+		double centerError;		// Error at the center, breaks ties of the bound
+	};
+
+	// Scores all cells of one level with the given observations, all cells have the given half sizes
+	void score(std::vector<Cell> &cells, const std::vector<LandmarkObs> &obs, const std::vector<double> &obsRanges,
+	           double halfXY, double halfTheta, ThreadPool &pool) const;
+
+	// Keeps the count cells with the lowest error, sorted
+	static void keepBest(std::vector<Cell> &cells, size_t count);
+
+	GlobalLocalizationConfig config;
+
+	// inputs of the current search
+	const Map *map;
+	std::vector<double> ranges;	// Distance of every observation to the vehicle
+	std::vector<LandmarkObs> closest;	// The closest observations, used for the levels
+	std::vector<double> closestRanges;
+	double sigma;				// Larger one of the landmark deviations, keeps the bound optimistic
+};
+
+#endif /* GLOBAL_LOCALIZER_H_ */
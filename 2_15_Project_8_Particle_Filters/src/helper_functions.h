@@ -111,6 +111,9 @@ inline bool read_map_data(std::string filename, Map& map) {
 		// Add to landmark list of map:
 		map.landmark_list.push_back(single_landmark_temp);
 	}
+
+	// Index the landmarks for the range and nearest neighbour queries of the filter:
+	map.buildIndex();
 	return true;
 }
 
@@ -0,0 +1,159 @@
+/*
+ * kld_sampler.cpp
+ *
+ * KLD-sampling: resampling with an adaptive number of particles.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+
+#include "kld_sampler.h"
+
+using namespace std;
+
+// the histogram has 2^kHashBits slots, of which at most three quarters are used
+static const int kHashBits = 17;
+static const size_t kHashSlots = size_t(1) << kHashBits;
+static const size_t kMaxOccupied = kHashSlots / 4 * 3;
+
+KldSampler::KldSampler(uint64_t seed) : gen(seed), keys(kHashSlots), stamps(kHashSlots, 0), generation(0),
+    occupied(0)
+{
+}
+
+double KldSampler::bound(size_t k) const
+{
+    if(k < 2)
+    {
+        return double(config.min_particles);
+    }
+
+    // Wilson-Hilferty approximation of the chi-square quantile with k-1 degrees of freedom
+    const double a = 2.0 / (9.0 * (k - 1));
+    const double b = 1.0 - a + sqrt(a) * config.z_quantile;
+    return (k - 1) / (2.0 * config.epsilon) * b * b * b;
+}
+
+void KldSampler::buildAliasTable(const std::vector<double> &weights)
+{
+    const size_t n = weights.size();
+    probability.resize(n);
+    alias.resize(n);
+    small.clear();
+    large.clear();
+
+    double total = 0.0;
+    for(const double weight: weights)
+    {
+        total += weight;
+    }
+    const double scale = total > 0.0 ? n / total : 0.0;
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        probability[i] = total > 0.0 ? weights[i] * scale : 1.0;
+        alias[i] = int(i);
+        (probability[i] < 1.0 ? small : large).push_back(int(i));
+    }
+
+    while(!small.empty() && !large.empty())
+    {
+        const int less = small.back();
+        const int more = large.back();
+        small.pop_back();
+
+        alias[less] = more;
+        probability[more] -= 1.0 - probability[less];
+        if(probability[more] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+
+    // whatever is left over is 1 up to rounding
+    for(const int i: small)
+    {
+        probability[i] = 1.0;
+    }
+    for(const int i: large)
+    {
+        probability[i] = 1.0;
+    }
+}
+
+bool KldSampler::insert(double x, double y, double theta)
+{
+    if(occupied >= kMaxOccupied)
+    {
+        return false;
+    }
+
+    const double heading = theta - 2.0 * M_PI * floor(theta / (2.0 * M_PI));
+    const int64_t ix = int64_t(floor(x / config.bin_size_xy));
+    const int64_t iy = int64_t(floor(y / config.bin_size_xy));
+    const int64_t it = int64_t(heading / config.bin_size_theta);
+    const uint64_t key = ((uint64_t(ix) & 0x1fffff) << 42) | ((uint64_t(iy) & 0x1fffff) << 21) | (uint64_t(it) & 0x1fffff);
+
+    // linear probing
+    size_t slot = size_t((key * 0x9e3779b97f4a7c15ULL) >> (64 - kHashBits));
+    for(;;)
+    {
+        if(stamps[slot] != generation)
+        {
+            stamps[slot] = generation;
+            keys[slot] = key;
+            ++occupied;
+            return true;
+        }
+        if(keys[slot] == key)
+        {
+            return false;
+        }
+        slot = (slot + 1) & (kHashSlots - 1);
+    }
+}
+
+void KldSampler::draw(const std::vector<double> &weights, const std::vector<double> &x, const std::vector<double> &y,
+                      const std::vector<double> &theta, std::vector<int> &outIndices)
+{
+    outIndices.clear();
+    if(weights.empty())
+    {
+        return;
+    }
+
+    buildAliasTable(weights);
+
+    // start a new, empty histogram
+    if(++generation == 0)
+    {
+        fill(stamps.begin(), stamps.end(), 0);
+        generation = 1;
+    }
+    occupied = 0;
+
+    const size_t n = weights.size();
+    const size_t minCount = max<size_t>(1, config.min_particles);
+    const size_t maxCount = max(minCount, config.max_particles);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    double required = double(minCount);
+    while(outIndices.size() < maxCount)
+    {
+        const double u = uniform(gen) * n;
+        const size_t column = min(n - 1, size_t(u));
+        const int index = (u - column) < probability[column] ? int(column) : alias[column];
+        outIndices.push_back(index);
+
+        if(insert(x[index], y[index], theta[index]))
+        {
+            required = max(double(minCount), bound(occupied));
+        }
+        if(outIndices.size() >= required)
+        {
+            break;
+        }
+    }
+}
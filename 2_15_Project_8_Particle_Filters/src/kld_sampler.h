@@ -0,0 +1,88 @@
+/*
+ * kld_sampler.h
+ *
+ * KLD-sampling: resampling with an adaptive number of particles.
+ */
+
+#ifndef KLD_SAMPLER_H_
+#define KLD_SAMPLER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "rng.h"
+
+/*
+ * Parameters of the KLD-sampling.
+ */
+struct KldConfig {
+
+	double epsilon;			// Allowed KL-divergence between the sample based and the true posterior
+	double z_quantile;		// Upper 1 - delta quantile of the standard normal distribution (2.326 for delta = 0.01)
+	double bin_size_xy;		// Histogram bin size in x and y [m]
+	double bin_size_theta;	// Histogram bin size in theta [rad]
+	size_t min_particles;	// Lower bound of the particle count
+	size_t max_particles;	// Upper bound of the particle count
+
+	KldConfig() : epsilon(0.05), z_quantile(2.326), bin_size_xy(0.5), bin_size_theta(0.1745),
+	              min_particles(100), max_particles(20000) {}
+};
+
+/*
+ * Draws particles one by one (via an alias table, O(1) per draw) and counts the histogram bins of
+ * (x, y, theta) they fall into, until the number of draws reaches the KLD bound for that many occupied bins
+ * (Fox, "Adapting the sample size in particle filters through KLD-sampling"). The histogram is a fixed size
+ * open addressing hash table which is invalidated with a generation stamp instead of being cleared, so the
+ * overhead per draw stays constant.
+ */
+class KldSampler {
+
+public:
+
+	//! Initializes the sampler
+	//! \param seed Seed of the random generator
+	explicit KldSampler(uint64_t seed = 0x6b6c64ULL);
+
+	void setConfig(const KldConfig &inConfig) { config = inConfig; }
+	const KldConfig &getConfig() const { return config; }
+
+	//! Restarts the random generator
+	void seed(uint64_t inSeed) { gen.seed(inSeed); }
+
+	//! Draws ancestors with probability proportional to weights until the KLD bound is met
+	//! \param weights Normalized or unnormalized particle weights
+	//! \param x, y, theta Poses of the weighted particles, used for the histogram
+	//! \param outIndices Receives the ancestor indices, between min_particles and max_particles many
+	void draw(const std::vector<double> &weights, const std::vector<double> &x, const std::vector<double> &y,
+	          const std::vector<double> &theta, std::vector<int> &outIndices);
+
+	//! Returns the KLD bound on the number of particles for k occupied bins
+	double bound(size_t k) const;
+
+	//! Returns the number of occupied bins of the last draw
+	size_t occupiedBins() const { return occupied; }
+
+private:
+
+	// Builds the alias table of the weights (Vose's method)
+	void buildAliasTable(const std::vector<double> &weights);
+
+	// Inserts the bin of a pose, returns true if the bin was empty
+	bool insert(double x, double y, double theta);
+
+	KldConfig config;
+	Xoshiro256 gen;
+
+	// alias table
+	std::vector<double> probability;
+	std::vector<int> alias;
+	std::vector<int> small, large;
+
+	// hash grid histogram, a slot is occupied if its stamp equals the current generation
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> stamps;
+	uint32_t generation;
+	size_t occupied;
+};
+
+#endif /* KLD_SAMPLER_H_ */
@@ -0,0 +1,210 @@
+/*
+ * landmark_grid.cpp
+ *
+ * Uniform grid spatial index over the map landmarks.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "landmark_grid.h"
+
+using namespace std;
+
+// upper bound for the number of cells, limits the memory of very sparse maps
+static const double kMaxCells = 1 << 22;
+
+void LandmarkGrid::build(const std::vector<MapLandmark> &landmarks, double inCellSize)
+{
+    cellStart.clear();
+    entries.clear();
+    cols = rows = 0;
+
+    if(landmarks.empty())
+    {
+        return;
+    }
+
+    // bounding box of the map
+    double minX = landmarks[0].x_f, maxX = minX;
+    double minY = landmarks[0].y_f, maxY = minY;
+    for(const auto &landmark: landmarks)
+    {
+        minX = min<double>(minX, landmark.x_f);
+        maxX = max<double>(maxX, landmark.x_f);
+        minY = min<double>(minY, landmark.y_f);
+        maxY = max<double>(maxY, landmark.y_f);
+    }
+    const double width = max(maxX - minX, 1e-3);
+    const double height = max(maxY - minY, 1e-3);
+
+    // by default aim for about one landmark per two cells, which keeps the nearest neighbour search short
+    cellSize = inCellSize > 0.0 ? inCellSize : sqrt(0.5 * width * height / landmarks.size());
+    cellSize = max(cellSize, sqrt(width * height / kMaxCells));
+
+    originX = minX;
+    originY = minY;
+    invCellSize = 1.0 / cellSize;
+    cols = int(width * invCellSize) + 1;
+    rows = int(height * invCellSize) + 1;
+
+    // counting sort of the landmarks into their cells
+    vector<int> cellOf(landmarks.size());
+    cellStart.assign(size_t(cols) * rows + 1, 0);
+    for(size_t i = 0; i < landmarks.size(); ++i)
+    {
+        cellOf[i] = cellY(landmarks[i].y_f) * cols + cellX(landmarks[i].x_f);
+        ++cellStart[cellOf[i] + 1];
+    }
+    for(size_t c = 1; c < cellStart.size(); ++c)
+    {
+        cellStart[c] += cellStart[c - 1];
+    }
+
+    entries.resize(landmarks.size());
+    vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for(size_t i = 0; i < landmarks.size(); ++i)
+    {
+        Entry &entry = entries[fill[cellOf[i]]++];
+        entry.x = landmarks[i].x_f;
+        entry.y = landmarks[i].y_f;
+        entry.index = int(i);
+    }
+}
+
+// clamped before the conversion, a coordinate far outside the grid does not fit into an int
+int LandmarkGrid::cellX(double x) const
+{
+    return int(min(max(floor((x - originX) * invCellSize), 0.0), double(cols - 1)));
+}
+
+int LandmarkGrid::cellY(double y) const
+{
+    return int(min(max(floor((y - originY) * invCellSize), 0.0), double(rows - 1)));
+}
+
+void LandmarkGrid::queryRange(double x, double y, double range, std::vector<int> &outIndices) const
+{
+    outIndices.clear();
+    if(entries.empty())
+    {
+        return;
+    }
+
+    const double range2 = range * range;
+    const int x0 = cellX(x - range), x1 = cellX(x + range);
+    const int y0 = cellY(y - range), y1 = cellY(y + range);
+
+    for(int cy = y0; cy <= y1; ++cy)
+    {
+        for(int cx = x0; cx <= x1; ++cx)
+        {
+            const int cell = cy * cols + cx;
+            for(int e = cellStart[cell]; e < cellStart[cell + 1]; ++e)
+            {
+                const double diffX = entries[e].x - x,
+                             diffY = entries[e].y - y;
+                if(diffX*diffX + diffY*diffY < range2)
+                {
+                    outIndices.push_back(entries[e].index);
+                }
+            }
+        }
+    }
+}
+
+void LandmarkGrid::queryBox(double minX, double minY, double maxX, double maxY, std::vector<int> &outIndices) const
+{
+    outIndices.clear();
+    if(entries.empty())
+    {
+        return;
+    }
+
+    const int x0 = cellX(minX), x1 = cellX(maxX);
+    const int y0 = cellY(minY), y1 = cellY(maxY);
+
+    for(int cy = y0; cy <= y1; ++cy)
+    {
+        for(int cx = x0; cx <= x1; ++cx)
+        {
+            const int cell = cy * cols + cx;
+            for(int e = cellStart[cell]; e < cellStart[cell + 1]; ++e)
+            {
+                const Entry &entry = entries[e];
+                if(entry.x >= minX && entry.x <= maxX && entry.y >= minY && entry.y <= maxY)
+                {
+                    outIndices.push_back(entry.index);
+                }
+            }
+        }
+    }
+}
+
+int LandmarkGrid::nearest(double x, double y, double maxRange) const
+{
+    if(entries.empty())
+    {
+        return -1;
+    }
+
+    // a query outside the grid starts at the closest border cell, the ring which covers the whole grid
+    // from there is the last one
+    const int cx = cellX(x), cy = cellY(y);
+    const int maxRing = max(max(cx, cols - 1 - cx), max(cy, rows - 1 - cy));
+
+    // distance of the query to the bounding box of the grid along each axis
+    const double outsideX = max(max(originX - x, x - (originX + cols * cellSize)), 0.0);
+    const double outsideY = max(max(originY - y, y - (originY + rows * cellSize)), 0.0);
+
+    int closest = -1;
+    double closestDist = maxRange < 1e150 ? maxRange * maxRange : numeric_limits<double>::max();
+
+    // visit rings of cells around the query cell. every cell of ring r is at least (r-1) cells further
+    // away than the grid along x or along y, so the search can stop as soon as the next ring cannot
+    // contain anything closer.
+    for(int ring = 0; ring <= maxRing; ++ring)
+    {
+        if(ring > 1)
+        {
+            const double ringDist = (ring - 1) * cellSize;
+            const double alongX = (outsideX + ringDist) * (outsideX + ringDist) + outsideY * outsideY;
+            const double alongY = outsideX * outsideX + (outsideY + ringDist) * (outsideY + ringDist);
+            if(min(alongX, alongY) >= closestDist)
+            {
+                break;
+            }
+        }
+
+        const int x0 = cx - ring, x1 = cx + ring;
+        const int y0 = cy - ring, y1 = cy + ring;
+        for(int gy = max(y0, 0); gy <= min(y1, rows - 1); ++gy)
+        {
+            // inner rows only need the left and right border cells of the ring
+            const bool border = (gy == y0 || gy == y1);
+            const int step = border ? 1 : x1 - x0;
+            for(int gx = x0; gx <= x1; gx += max(step, 1))
+            {
+                if(gx < 0 || gx >= cols)
+                {
+                    continue;
+                }
+                const int cell = gy * cols + gx;
+                for(int e = cellStart[cell]; e < cellStart[cell + 1]; ++e)
+                {
+                    const double diffX = entries[e].x - x,
+                                 diffY = entries[e].y - y;
+                    const double sqrDist = diffX*diffX + diffY*diffY;
+                    if(sqrDist < closestDist)
+                    {
+                        closest = entries[e].index;
+                        closestDist = sqrDist;
+                    }
+                }
+            }
+        }
+    }
+
+    return closest;
+}
@@ -0,0 +1,77 @@
+/*
+ * landmark_grid.h
+ *
+ * Uniform grid spatial index over the map landmarks.
+ */
+
+#ifndef LANDMARK_GRID_H_
+#define LANDMARK_GRID_H_
+
+#include <vector>
+
+/*
+ * Struct representing one landmark of the map.
+ */
+struct MapLandmark {
+
+	int id_i ; // Landmark ID
+	float x_f; // Landmark x-position in the map (global coordinates)
+	float y_f; // Landmark y-position in the map (global coordinates)
+};
+
+/*
+ * Uniform grid over the landmarks of a map. The landmarks are bucketed once into square cells and stored
+ * cell by cell (compressed row storage), so range, box and nearest-neighbour queries only visit the
+ * cells overlapping the query region. All queries return indices into the landmark list the grid was
+ * built from.
+ */
+class LandmarkGrid {
+
+public:
+
+	LandmarkGrid() : originX(0.0), originY(0.0), cellSize(1.0), invCellSize(1.0), cols(0), rows(0) {}
+
+	//! Builds the grid over the given landmarks
+	//! \param landmarks The map landmarks
+	//! \param inCellSize Edge length of a cell [m], a value <= 0 selects a size of roughly one landmark per two cells
+	void build(const std::vector<MapLandmark> &landmarks, double inCellSize = 0.0);
+
+	//! Returns whether the grid contains no landmarks
+	bool empty() const { return entries.empty(); }
+
+	//! Collects all landmarks with a distance below range to (x, y)
+	//! \param outIndices Receives the landmark indices, it is cleared first
+	void queryRange(double x, double y, double range, std::vector<int> &outIndices) const;
+
+	//! Collects all landmarks inside the axis aligned box [minX, maxX] x [minY, maxY]
+	//! \param outIndices Receives the landmark indices, it is cleared first
+	void queryBox(double minX, double minY, double maxX, double maxY, std::vector<int> &outIndices) const;
+
+	//! Finds the landmark closest to (x, y)
+	//! \param maxRange Landmarks further away than this are ignored
+	//! \return The landmark index or -1 if there is no landmark within maxRange
+	int nearest(double x, double y, double maxRange = 1e300) const;
+
+private:
+
+	// Landmark copy stored in cell order
+	struct Entry {
+		float x;
+		float y;
+		int index;
+	};
+
+	// Returns the clamped cell column / row of a coordinate
+	int cellX(double x) const;
+	int cellY(double y) const;
+
+	double originX, originY;
+	double cellSize, invCellSize;
+	int cols, rows;
+
+	// entries of cell (cx, cy) are entries[cellStart[cy*cols+cx] .. cellStart[cy*cols+cx+1])
+	std::vector<int> cellStart;
+	std::vector<Entry> entries;
+};
+
+#endif /* LANDMARK_GRID_H_ */
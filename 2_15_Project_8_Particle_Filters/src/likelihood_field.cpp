@@ -0,0 +1,65 @@
+/*
+ * likelihood_field.cpp
+ *
+ * Precomputed observation likelihood over the map area.
+ */
+
+#include <algorithm>
+#include <math.h>
+
+#include "likelihood_field.h"
+
+using namespace std;
+
+void LikelihoodField::build(const std::vector<MapLandmark> &landmarks, const LandmarkGrid &grid, double inResolution,
+                            const double std_landmark[], double margin, double inMaxError)
+{
+    cells.clear();
+    cols = rows = 0;
+    if(landmarks.empty() || inResolution <= 0.0)
+    {
+        return;
+    }
+
+    double minX = landmarks[0].x_f, maxX = minX;
+    double minY = landmarks[0].y_f, maxY = minY;
+    for(const auto &landmark: landmarks)
+    {
+        minX = min<double>(minX, landmark.x_f);
+        maxX = max<double>(maxX, landmark.x_f);
+        minY = min<double>(minY, landmark.y_f);
+        maxY = max<double>(maxY, landmark.y_f);
+    }
+
+    resolution = inResolution;
+    invResolution = 1.0 / resolution;
+    originX = minX - margin;
+    originY = minY - margin;
+    cols = int((maxX - minX + 2.0 * margin) * invResolution) + 2;
+    rows = int((maxY - minY + 2.0 * margin) * invResolution) + 2;
+
+    maxError = inMaxError;
+    scale = maxError / 65535.0;
+    stdX = std_landmark[0];
+    stdY = std_landmark[1];
+
+    const double xNorm = 2 * std_landmark[0] * std_landmark[0];
+    const double yNorm = 2 * std_landmark[1] * std_landmark[1];
+
+    // the closest landmark in the euclidean sense is also the one with the smallest error as long as the
+    // measurement noise is isotropic, which it is for the sensors of this project
+    cells.resize(size_t(cols) * rows);
+    for(int cy = 0; cy < rows; ++cy)
+    {
+        const double y = originY + cy * resolution;
+        for(int cx = 0; cx < cols; ++cx)
+        {
+            const double x = originX + cx * resolution;
+            const int closest = grid.nearest(x, y);
+            const double xDiff = landmarks[closest].x_f - x;
+            const double yDiff = landmarks[closest].y_f - y;
+            const double error = min(maxError, xDiff*xDiff / xNorm + yDiff*yDiff / yNorm);
+            cells[size_t(cy) * cols + cx] = uint16_t(error / scale + 0.5);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * likelihood_field.h
+ *
+ * Precomputed observation likelihood over the map area.
+ */
+
+#ifndef LIKELIHOOD_FIELD_H_
+#define LIKELIHOOD_FIELD_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "landmark_grid.h"
+
+/*
+ * Raster of the observation error against the closest landmark, dx^2 / (2 sx^2) + dy^2 / (2 sy^2), i.e. the
+ * negative gaussian log-likelihood without its constant term. The values are clamped at a maximum error and
+ * quantized to 16 bit, so a 0.2 m raster of a 1 km^2 map takes 50 MB. Evaluating an observation is one
+ * bilinear lookup instead of a nearest landmark search and an exp.
+ */
+class LikelihoodField {
+
+public:
+
+	LikelihoodField() : originX(0.0), originY(0.0), resolution(1.0), invResolution(1.0), cols(0), rows(0),
+	                    maxError(0.0), scale(0.0), stdX(0.0), stdY(0.0) {}
+
+	//! Rasterizes the field
+	//! \param landmarks The map landmarks
+	//! \param grid Spatial index over landmarks, used to find the closest landmark of every cell
+	//! \param inResolution Edge length of a cell [m]
+	//! \param std_landmark Landmark measurement uncertainty [x [m], y [m]], baked into the raster
+	//! \param margin Extent of the raster beyond the outermost landmarks [m], usually the sensor range
+	//! \param inMaxError Errors above this value are clamped, it also sets the quantization step
+	void build(const std::vector<MapLandmark> &landmarks, const LandmarkGrid &grid, double inResolution,
+	           const double std_landmark[], double margin, double inMaxError = 50.0);
+
+	//! Returns whether the field was built
+	bool empty() const { return cells.empty(); }
+
+	//! Returns the bilinearly interpolated error at (x, y), maxError outside of the raster
+	double error(double x, double y) const {
+		const double fx = (x - originX) * invResolution;
+		const double fy = (y - originY) * invResolution;
+		if (!(fx >= 0.0 && fy >= 0.0 && fx < cols - 1 && fy < rows - 1)) {
+			return maxError;
+		}
+		const int cx = int(fx), cy = int(fy);
+		const double tx = fx - cx, ty = fy - cy;
+		const uint16_t *cell = &cells[size_t(cy) * cols + cx];
+		const double top = cell[0] + tx * (double(cell[1]) - cell[0]);
+		const double bottom = cell[cols] + tx * (double(cell[cols + 1]) - cell[cols]);
+		return (top + ty * (bottom - top)) * scale;
+	}
+
+	//! Returns the clamping value of the error
+	double getMaxError() const { return maxError; }
+
+	//! Returns the landmark measurement uncertainty the field was built with [m]
+	double getStdX() const { return stdX; }
+	double getStdY() const { return stdY; }
+
+	//! Returns the memory taken by the raster in bytes
+	size_t memoryUsage() const { return cells.size() * sizeof(uint16_t); }
+
+private:
+
+	double originX, originY;
+	double resolution, invResolution;
+	int cols, rows;
+	double maxError;
+	double scale;	// error per quantization step
+	double stdX, stdY;	// landmark measurement uncertainty of the raster
+
+	std::vector<uint16_t> cells;
+};
+
+#endif /* LIKELIHOOD_FIELD_H_ */
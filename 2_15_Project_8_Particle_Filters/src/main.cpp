@@ -1,8 +1,10 @@
 #include <uWS/uWS.h>
+#include <algorithm>
 #include <iostream>
 #include "json.hpp"
 #include <math.h>
 #include "particle_filter.h"
+#include "tiled_map.h"
 
 using namespace std;
 
@@ -36,9 +38,11 @@ int main()
   double sigma_pos [3] = {0.3, 0.3, 0.01}; // GPS measurement uncertainty [x [m], y [m], theta [rad]]
   double sigma_landmark [2] = {0.3, 0.3}; // Landmark measurement uncertainty [x [m], y [m]]
 
-  // Read map data
+  // Read map data. A tiled map (see map_convert) is only mapped into memory and the filter works on the
+  // landmarks around the particles, otherwise the whole text map is loaded.
   Map map;
-  if (!read_map_data("../data/map_data.txt", map)) {
+  TiledMap tiled_map;
+  if (!tiled_map.open("../data/map_data.bin") && !read_map_data("../data/map_data.txt", map)) {
 	  cout << "Error: Could not open map file" << endl;
 	  return -1;
   }
@@ -46,7 +50,7 @@ int main()
   // Create particle filter
   ParticleFilter pf;
 
-  h.onMessage([&pf,&map,&delta_t,&sensor_range,&sigma_pos,&sigma_landmark](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+  h.onMessage([&pf,&map,&tiled_map,&delta_t,&sensor_range,&sigma_pos,&sigma_landmark](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
@@ -110,35 +114,33 @@ int main()
 				noisy_observations.push_back(obs);
         	}
 
+		  // Page in the landmarks within sensor range of the particle cloud if the map is tiled
+		  const Map *active_map = &map;
+		  if (tiled_map.isOpen()) {
+			const auto x_range = minmax_element(pf.particles.x.begin(), pf.particles.x.end());
+			const auto y_range = minmax_element(pf.particles.y.begin(), pf.particles.y.end());
+			active_map = &tiled_map.activate(*x_range.first - sensor_range, *y_range.first - sensor_range,
+			                                 *x_range.second + sensor_range, *y_range.second + sensor_range);
+		  }
+
 		  // Update the weights and resample
-		  pf.updateWeights(sensor_range, sigma_landmark, noisy_observations, map);
+		  pf.updateWeights(sensor_range, sigma_landmark, noisy_observations, *active_map);
 		  pf.resample();
 
-		  // Calculate and output the average weighted error of the particle filter over all time steps so far.
-		  vector<Particle> particles = pf.particles;
-		  int num_particles = particles.size();
-		  double highest_weight = -1.0;
-		  Particle best_particle;
-		  double weight_sum = 0.0;
-		  for (int i = 0; i < num_particles; ++i) {
-			if (particles[i].weight > highest_weight) {
-				highest_weight = particles[i].weight;
-				best_particle = particles[i];
-			}
-			weight_sum += particles[i].weight;
-		  }
-		  cout << "highest w " << highest_weight << endl;
-		  cout << "average w " << weight_sum/num_particles << endl;
+		  // The filter keeps the best particle and the weight statistics of the update step
+		  const FilterEstimate &estimate = pf.getEstimate();
+		  cout << "highest w " << estimate.max_weight << endl;
+		  cout << "average w " << estimate.mean_weight << endl;
 
           json msgJson;
-          msgJson["best_particle_x"] = best_particle.x;
-          msgJson["best_particle_y"] = best_particle.y;
-          msgJson["best_particle_theta"] = best_particle.theta;
+          msgJson["best_particle_x"] = estimate.best_x;
+          msgJson["best_particle_y"] = estimate.best_y;
+          msgJson["best_particle_theta"] = estimate.best_theta;
 
           //Optional message data used for debugging particle's sensing and associations
-          msgJson["best_particle_associations"] = pf.getAssociations(best_particle);
-          msgJson["best_particle_sense_x"] = pf.getSenseX(best_particle);
-          msgJson["best_particle_sense_y"] = pf.getSenseY(best_particle);
+          msgJson["best_particle_associations"] = pf.getBestAssociations();
+          msgJson["best_particle_sense_x"] = pf.getBestSenseX();
+          msgJson["best_particle_sense_y"] = pf.getBestSenseY();
 
           auto msg = "42[\"best_particle\"," + msgJson.dump() + "]";
           // std::cout << msg << std::endl;
@@ -8,18 +8,33 @@
 #ifndef MAP_H_
 #define MAP_H_
 
+#include <vector>
+#include "landmark_grid.h"
+#include "likelihood_field.h"
+
 class Map {
 public:
 	
-	struct single_landmark_s{
-
-		int id_i ; // Landmark ID
-		float x_f; // Landmark x-position in the map (global coordinates)
-		float y_f; // Landmark y-position in the map (global coordinates)
-	};
+	typedef MapLandmark single_landmark_s;
 
 	std::vector<single_landmark_s> landmark_list ; // List of landmarks in the map
 
+	LandmarkGrid grid; // Spatial index over landmark_list, see buildIndex
+
+	//! (Re)builds the spatial index, must be called after landmark_list was modified
+	void buildIndex() { grid.build(landmark_list); }
+
+	LikelihoodField field; // Precomputed observation likelihood, only built on request, see buildLikelihoodField
+
+	//! Rasterizes the likelihood field, requires the spatial index
+	//! \param resolution Edge length of a field cell [m]
+	//! \param std_landmark Landmark measurement uncertainty [x [m], y [m]], the field model of
+	//!        ParticleFilter::updateWeights uses this one instead of the one passed to it
+	//! \param margin Extent of the field beyond the outermost landmarks [m]
+	void buildLikelihoodField(double resolution, const double std_landmark[], double margin) {
+		field.build(landmark_list, grid, resolution, std_landmark, margin);
+	}
+
 };
 
 
@@ -0,0 +1,39 @@
+/*
+ * map_convert.cpp
+ *
+ * Converts a text landmark map into the binary tiled format of TiledMap.
+ *
+ * Usage: map_convert <map_data.txt> <map_data.bin> [tile size in m, default 100]
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include "tiled_map.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3)
+    {
+        cerr << "Usage: " << argv[0] << " <map_data.txt> <map_data.bin> [tile size in m]" << endl;
+        return -1;
+    }
+
+    const double tileSize = argc > 3 ? atof(argv[3]) : 100.0;
+    if(!TiledMap::convert(argv[1], argv[2], tileSize))
+    {
+        cerr << "Error: Could not convert " << argv[1] << " to " << argv[2] << endl;
+        return -1;
+    }
+
+    TiledMap tiled;
+    if(!tiled.open(argv[2]))
+    {
+        cerr << "Error: Could not open the written map " << argv[2] << endl;
+        return -1;
+    }
+    cout << "Wrote " << tiled.landmarkCount() << " landmarks to " << argv[2] << endl;
+    return 0;
+}
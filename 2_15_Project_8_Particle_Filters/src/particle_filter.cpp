@@ -14,48 +14,209 @@
 #include <sstream>
 #include <string>
 #include <iterator>
+#include <limits>
 
 #include "particle_filter.h"
+#include "fast_math.h"
 
 using namespace std;
 
+// minimum number of particles a worker thread gets in updateWeights, below that threading does not pay off
+static const size_t kMinParticlesPerThread = 256;
+
+// particles per partial sum of the weight normalization
+static const size_t kNormalizeBlock = 4096;
+
+// particles per random stream of the initialization and the motion noise
+static const size_t kNoiseBlock = 4096;
+
+ParticleFilter::ParticleFilter() : num_particles(0), particle_count(100), is_initialized(false),
+    record_associations(false),
+    pool(new ThreadPool()), effective_sample_size(0.0), resample_threshold(0.5), carry_weights(false),
+    kld_enabled(false), observation_model(ObservationModel::ASSOCIATION), last_map(nullptr),
+    last_sensor_range(0.0), best_strings_valid(false)
+{
+}
+
+void ParticleFilter::setParticleCount(int count)
+{
+    particle_count = max(1, count);
+}
+
+void ParticleFilter::seed(uint64_t inSeed)
+{
+    noise_streams.seed(inSeed);
+    resampler.seed(inSeed ^ 0x7265736d706c72ULL);
+    kld_sampler.seed(inSeed ^ 0x6b6c64ULL);
+}
+
+void ParticleFilter::setKldSampling(bool enable, const KldConfig &config)
+{
+    kld_enabled = enable;
+    kld_sampler.setConfig(config);
+}
+
+void ParticleFilter::setObservationModel(ObservationModel model)
+{
+    observation_model = model;
+}
+
+void ParticleFilter::setResampleMethod(ResampleMethod method)
+{
+    resampler.setMethod(method);
+}
+
+void ParticleFilter::setResampleThreshold(double fraction)
+{
+    resample_threshold = fraction;
+}
+
+void ParticleFilter::setRecordAssociations(bool record)
+{
+    record_associations = record;
+    if(!record)
+    {
+        association_data.clear();
+    }
+}
+
+Particle ParticleFilter::getParticle(size_t index) const
+{
+    Particle particle(int(index), particles.x[index], particles.y[index], particles.theta[index],
+                      particles.weight[index]);
+
+    if(index < association_data.size())
+    {
+        const ParticleAssociations &data = association_data[index];
+        particle.associations = data.associations;
+        particle.sense_x = data.sense_x;
+        particle.sense_y = data.sense_y;
+    }
+
+    return particle;
+}
+
+void ParticleFilter::setThreadCount(unsigned int threadCount)
+{
+    pool.reset(new ThreadPool(threadCount));
+}
+
 void ParticleFilter::init(double x, double y, double theta, double std[]) {
 	// TODO: Set the number of particles. Initialize all particles to first position (based on estimates of 
 	//   x, y, theta and their uncertainties from GPS) and all weights to 1. 
 	// Add random Gaussian noise to each particle.
 	// NOTE: Consult particle_filter.h for more information about this method (and others in this file).
 
-    default_random_engine gen;
+    PoseHypothesis gps;
+    gps.x = x;
+    gps.y = y;
+    gps.theta = theta;
+    gps.error = 0.0;
+    initParticles(vector<PoseHypothesis>(1, gps), std);
+}
+
+bool ParticleFilter::initGlobal(const std::vector<LandmarkObs> &observations, const Map &map_landmarks,
+                                double std_landmark[], double std[], const GlobalLocalizationConfig &config)
+{
+    global_localizer.setConfig(config);
+    global_localizer.localize(observations, map_landmarks, std_landmark, *pool, hypotheses);
+    if(hypotheses.empty())
+    {
+        return false;
+    }
 
-    // set default weight of 1.0 and a particle count of 100
+    initParticles(hypotheses, std);
+    return true;
+}
+
+void ParticleFilter::initParticles(const std::vector<PoseHypothesis> &centers, double std[])
+{
+    // set default weight of 1.0 and the configured particle count. with KLD-sampling the filter starts with the
+    // maximum count and shrinks it as soon as the particles concentrate.
     const double defWeight = 1.0;
-    const int particleCount = 100;
+    const int particleCount = kld_enabled ? int(kld_sampler.getConfig().max_particles) : particle_count;
 
-    // setup member variables and presize particle and weight vector
-    this->particles.clear();
-    this->weights.clear();
+    // setup member variables and presize the particle arrays
     this->num_particles = particleCount;
     this->particles.resize(particleCount);
-    this->weights.resize(particleCount);
-
-    // prepare gaussian distributions with the provided deviations and the provided GPS x and y and theta as center.
-    normal_distribution<double> dist_x(x, std[0]);
-    normal_distribution<double> dist_y(y, std[1]);
-    normal_distribution<double> dist_theta(theta, std[2]);
-
-    for (int i = 0; i < particleCount; ++i)
+    this->association_data.clear();
+    this->carry_weights = false;
+    this->effective_sample_size = particleCount;
+
+    // assign the particles to the centers in proportion to their likelihood exp(-error), with evenly spaced
+    // positions, so every center with a noticeable likelihood gets its share
+    double total = 0.0;
+    for(const auto &center: centers)
+    {
+        total += exp(centers[0].error - center.error);
+    }
+    ancestors.resize(particleCount);
+    size_t c = 0;
+    double cumulative = exp(0.0) / total;
+    for(int i = 0; i < particleCount; ++i)
     {
-        // sample random values in range of the gaussian
-        double sample_x = dist_x(gen);
-        double sample_y = dist_y(gen);
-        double sample_theta = dist_theta(gen);
-        // create new "random" particle
-        this->particles[i] = Particle(i, sample_x, sample_y, sample_theta, defWeight);
+        const double position = (i + 0.5) / particleCount;
+        while(cumulative <= position && c + 1 < centers.size())
+        {
+            cumulative += exp(centers[0].error - centers[++c].error) / total;
+        }
+        ancestors[i] = int(c);
     }
 
+    // sample the particles from gaussians with the provided deviations around their centers
+    noise_x.resize(particleCount);
+    noise_y.resize(particleCount);
+    noise_theta.resize(particleCount);
+    const size_t blocks = (size_t(particleCount) + kNoiseBlock - 1) / kNoiseBlock;
+    noise_streams.reserve(blocks);
+    pool->parallelFor(blocks, 1, [&](size_t beginBlock, size_t endBlock, unsigned int)
+    {
+        for(size_t block = beginBlock; block < endBlock; ++block)
+        {
+            const size_t begin = block * kNoiseBlock;
+            const size_t end = min(size_t(particleCount), begin + kNoiseBlock);
+            drawNoise(block, begin, end, std);
+            for(size_t i = begin; i < end; ++i)
+            {
+                const PoseHypothesis &center = centers[ancestors[i]];
+                particles.x[i] = center.x + noise_x[i];
+                particles.y[i] = center.y + noise_y[i];
+                particles.theta[i] = center.theta + noise_theta[i];
+                particles.weight[i] = defWeight;
+            }
+        }
+    });
+
     is_initialized = true;
 }
 
+void ParticleFilter::drawNoise(size_t block, size_t begin, size_t end, const double std[])
+{
+    Xoshiro256 &stream = noise_streams[block];
+    fillGaussian(stream, &noise_x[begin], end - begin, 0.0, std[0]);
+    fillGaussian(stream, &noise_y[begin], end - begin, 0.0, std[1]);
+    fillGaussian(stream, &noise_theta[begin], end - begin, 0.0, std[2]);
+}
+
+/**
+ * Motion kernel of the prediction step, written as a plain loop over the particle arrays so it is vectorized
+ */
+static void moveParticles(double * __restrict px, double * __restrict py, double * __restrict ptheta,
+                          const double * __restrict nx, const double * __restrict ny,
+                          const double * __restrict ntheta, size_t count,
+                          double halfTurn, double arcLength, double turn)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        double sinHeading, cosHeading;
+        fast_sincos(ptheta[i] + halfTurn, sinHeading, cosHeading);
+
+        px[i] += arcLength * cosHeading + nx[i];
+        py[i] += arcLength * sinHeading + ny[i];
+        ptheta[i] += turn + ntheta[i];
+    }
+}
+
 void ParticleFilter::prediction(double delta_t, double std_pos[], double velocity, double yaw_rate)
 {
 	// TODO: Add measurements to each particle and add random Gaussian noise.
@@ -63,37 +224,40 @@ void ParticleFilter::prediction(double delta_t, double std_pos[], double velocit
 	//  http://en.cppreference.com/w/cpp/numeric/random/normal_distribution
 	//  http://www.cplusplus.com/reference/random/default_random_engine/
 
-    default_random_engine gen;
 
-    double std_x = std_pos[0];
-    double std_y = std_pos[1];
-    double std_theta = std_pos[2];
-
-    // create gaussians with a center of zero and the deviations provided for x, y and theta.
-    normal_distribution<double> dist_x(0, std_x);
-    normal_distribution<double> dist_y(0, std_y);
-    normal_distribution<double> dist_theta(0, std_theta);
-
-    // add the noise to every particle and move / rotate it a bit by simulating a movement and rotation of delta_t seconds.
-    for(auto &particle: this->particles)
+    const size_t count = particles.size();
+    noise_x.resize(count);
+    noise_y.resize(count);
+    noise_theta.resize(count);
+
+    // the motion model moves a particle by v/w * (sin(theta + w*dt) - sin(theta)) in x, which equals
+    // v*dt * sinc(w*dt/2) * cos(theta + w*dt/2) (and the same with sin for y). in this form the straight
+    // movement for a yaw rate of zero is just sinc(0) = 1, so there is no per particle branch and only one
+    // sincos per particle.
+    const double halfTurn = 0.5 * yaw_rate * delta_t;
+    const double arcLength = velocity * delta_t * sinc(halfTurn);
+    const double turn = yaw_rate * delta_t;
+
+    // draw the noise of a block of particles in bulk (with a gaussian of zero mean and the deviations provided
+    // for x, y and theta), add it to every particle and move / rotate it a bit by simulating a movement and
+    // rotation of delta_t seconds.
+    const size_t blocks = (count + kNoiseBlock - 1) / kNoiseBlock;
+    noise_streams.reserve(blocks);
+    pool->parallelFor(blocks, 1, [&](size_t beginBlock, size_t endBlock, unsigned int)
     {
-        const auto ptheta = particle.theta;
-
-        if (abs(yaw_rate) != 0)
+        for(size_t block = beginBlock; block < endBlock; ++block)
         {
-            particle.x += (velocity/yaw_rate) * (sin(ptheta + (yaw_rate*delta_t)) - sin(ptheta)) + dist_x(gen);
-            particle.y += (velocity/yaw_rate) * (cos(ptheta) - cos(ptheta + (yaw_rate*delta_t))) + dist_y(gen);
+            const size_t begin = block * kNoiseBlock;
+            const size_t end = min(count, begin + kNoiseBlock);
+            drawNoise(block, begin, end, std_pos);
+            moveParticles(&particles.x[begin], &particles.y[begin], &particles.theta[begin],
+                          &noise_x[begin], &noise_y[begin], &noise_theta[begin], end - begin,
+                          halfTurn, arcLength, turn);
         }
-        else
-        {
-            particle.x += velocity * delta_t * cos(particle.theta) + dist_x(gen);
-            particle.y += velocity * delta_t * sin(particle.theta) + dist_y(gen);
-        }
-        particle.theta += yaw_rate * delta_t + dist_theta(gen);
-    }
+    });
 }
 
-void ParticleFilter::dataAssociation(std::vector<LandmarkObs> predicted, std::vector<LandmarkObs>& observations)
+void ParticleFilter::dataAssociation(const std::vector<LandmarkObs> &predicted, std::vector<LandmarkObs>& observations)
 {
 	// TODO: Find the predicted measurement that is closest to each observed measurement and assign the 
 	//   observed measurement to this particular landmark.
@@ -135,20 +299,41 @@ void ParticleFilter::getInRange(const Particle &particle, const double sensor_ra
 {
     outPredictions.clear();
 
-    double  px = particle.x,
-            py = particle.y;
-
     // find all landmarks in range of our sensor...
-    for(auto &landmark: map_landmarks.landmark_list)
+    vector<int> inRange;
+    map_landmarks.grid.queryRange(particle.x, particle.y, sensor_range, inRange);
+
+    for(const int index: inRange)
     {
-        if(dist(landmark.x_f, landmark.y_f, px, py)<sensor_range)
-        {
-            outPredictions.push_back(LandmarkObs({landmark.id_i, landmark.x_f, landmark.y_f}));
-        }
+        const auto &landmark = map_landmarks.landmark_list[index];
+        outPredictions.push_back(LandmarkObs({landmark.id_i, landmark.x_f, landmark.y_f}));
     }
 }
 
+/**
+ * Returns the index of the landmark closest to (x, y) among the given landmark indices or -1 if there is none
+ */
+static int closestLandmark(const Map &map_landmarks, const std::vector<int> &candidates, double x, double y)
+{
+    int closest = -1;
+    double closestDist = std::numeric_limits<double>::max();
+
+    for(const int index: candidates)
+    {
+        const auto &landmark = map_landmarks.landmark_list[index];
+        double  diffX = landmark.x_f-x,
+                diffY = landmark.y_f-y;
+        double sqrDist = diffX*diffX + diffY*diffY;
 
+        if(sqrDist<closestDist)
+        {
+            closest = index;
+            closestDist = sqrDist;
+        }
+    }
+
+    return closest;
+}
 
 void ParticleFilter::updateWeights(double sensor_range, double std_landmark[], 
 		const std::vector<LandmarkObs> &observations, const Map &map_landmarks) {
@@ -163,66 +348,360 @@ void ParticleFilter::updateWeights(double sensor_range, double std_landmark[],
 	//   3.33
 	//   http://planning.cs.uiuc.edu/node99.html
 
-	// prepare multiplier and denominators
-	double weightMultiplier = (1.0 / (2.0 * M_PI * std_landmark[0]*std_landmark[1]));
+	// prepare multiplier and denominators. the weights are accumulated as log likelihoods, a product of many
+	// small gaussian densities would underflow to zero.
+	const double logWeightMultiplier = -log(2.0 * M_PI * std_landmark[0]*std_landmark[1]);
 	const double xNorm = 2 * std_landmark[0] * std_landmark[0];
     const double yNorm = 2 * std_landmark[1] * std_landmark[1];
+    const double sqrRange = sensor_range * sensor_range;
 
-    // for all particles...
-	int pIndex = 0;
-    for(auto &particle: this->particles)
+    if(this->particles.empty() || map_landmarks.grid.empty())
     {
-        auto ptheta = particle.theta;
-        auto cos_pt = cos(ptheta),
-            sin_pt = sin(ptheta);
+        return;
+    }
+
+    log_weights.resize(particles.size());
 
-        // check which particles are in range
-        vector<LandmarkObs> inRange;
-        getInRange(particle, sensor_range, std_landmark, observations, map_landmarks, inRange);
+    // keep what is needed to associate the observations of the best particle later on
+    last_observations = observations;
+    last_map = &map_landmarks;
+    last_sensor_range = sensor_range;
+    best_strings_valid = false;
 
-        // transform all observed locations
-        vector<LandmarkObs> mapSpaceObservations(observations.size());
-        int index = 0;
-        for (const auto &observation: observations)
+    // likelihood field: the error of an observation is read from the field of the closest landmark instead of
+    // associating it, which is one bilinear lookup per observation and needs no range search. the errors of
+    // the field were computed with the uncertainty it was built with, so the normalization uses that one too.
+    if(observation_model == ObservationModel::LIKELIHOOD_FIELD && !map_landmarks.field.empty())
+    {
+        association_data.clear();
+        const LikelihoodField &field = map_landmarks.field;
+        const double fieldLogWeightMultiplier = -log(2.0 * M_PI * field.getStdX()*field.getStdY());
+
+        pool->parallelFor(particles.size(), kMinParticlesPerThread,
+                          [&](size_t begin, size_t end, unsigned int)
         {
-            const double transX = cos_pt*observation.x - sin_pt*observation.y + particle.x;
-            const double transY = sin_pt*observation.x + cos_pt*observation.y + particle.y;
-            mapSpaceObservations[index++] = LandmarkObs({observation.id, transX, transY});
-        }
+            for(size_t pIndex = begin; pIndex < end; ++pIndex)
+            {
+                const double px = particles.x[pIndex],
+                             py = particles.y[pIndex];
+                double cos_pt, sin_pt;
+                fast_sincos(particles.theta[pIndex], sin_pt, cos_pt);
 
-        // associate the observations in range of the sensor with all observations
-        dataAssociation(inRange, mapSpaceObservations);
+                double sqrError = 0.0;
+                for (const auto &observation: observations)
+                {
+                    sqrError += field.error(cos_pt*observation.x - sin_pt*observation.y + px,
+                                            sin_pt*observation.x + cos_pt*observation.y + py);
+                }
+
+                const double logWeight = carry_weights ? log_weights[pIndex] : 0.0;
+                log_weights[pIndex] = logWeight + observations.size() * fieldLogWeightMultiplier - sqrError;
+            }
+        });
 
-        particle.weight = 1.0; // reset weight to 1.0
- 	    for (const auto &observation: mapSpaceObservations)
+        normalizeWeights();
+        updateEstimate();
+        carry_weights = false;
+        return;
+    }
+
+    // bounding box of the particle cloud. if the cloud is compact all landmarks a particle can see are
+    // fetched from the grid once for the whole cloud instead of once per particle.
+    const auto xRange = minmax_element(particles.x.begin(), particles.x.end());
+    const auto yRange = minmax_element(particles.y.begin(), particles.y.end());
+    const double minX = *xRange.first, maxX = *xRange.second,
+                 minY = *yRange.first, maxY = *yRange.second;
+    const bool compactCloud = (maxX - minX) <= sensor_range && (maxY - minY) <= sensor_range;
+    vector<int> cloudCandidates;
+    if(compactCloud)
+    {
+        map_landmarks.grid.queryBox(minX - sensor_range, minY - sensor_range,
+                                    maxX + sensor_range, maxY + sensor_range, cloudCandidates);
+    }
+
+    // make sure every worker has its scratch buffers and there is a debug slot per particle if requested
+    if(record_associations)
+    {
+        association_data.resize(particles.size());
+    }
+    if(scratch.size() < pool->size())
+    {
+        scratch.resize(pool->size());
+    }
+
+    // the particles are independent of each other, so they are split into one contiguous chunk per worker.
+    // each worker only writes the weights of its own chunk, which makes the result independent of the
+    // number of threads.
+    pool->parallelFor(particles.size(), kMinParticlesPerThread,
+                      [&](size_t begin, size_t end, unsigned int worker)
+    {
+        UpdateScratch &buffers = scratch[worker];
+
+        for(size_t pIndex = begin; pIndex < end; ++pIndex)
         {
- 	        LandmarkObs predicted;
+            const double px = particles.x[pIndex],
+                         py = particles.y[pIndex];
+            double cos_pt, sin_pt;
+            fast_sincos(particles.theta[pIndex], sin_pt, cos_pt);
 
- 	        // receive coordinate of current observation
-            for(const auto &posPredicted : inRange)
+            // landmarks in sensor range, only collected if an observation needs them
+            bool inRangeValid = false;
+
+            ParticleAssociations *debug = nullptr;
+            if(record_associations)
             {
-                if(posPredicted.id==observation.id)
+                debug = &association_data[pIndex];
+                debug->associations.clear();
+                debug->sense_x.clear();
+                debug->sense_y.clear();
+            }
+
+            // start from the weight kept by the last resample call or reset it to 1.0
+            double logWeight = carry_weights ? log_weights[pIndex] : 0.0;
+            double sqrError = 0.0;
+            for (const auto &observation: observations)
+            {
+                // transform the observed location into map space
+                const double transX = cos_pt*observation.x - sin_pt*observation.y + px;
+                const double transY = sin_pt*observation.x + cos_pt*observation.y + py;
+
+                // associate the observation with the closest landmark of the map. if that one is within sensor
+                // range of the particle it is also the closest of all landmarks in range, otherwise fall back
+                // to searching only the landmarks in range.
+                int closest = map_landmarks.grid.nearest(transX, transY);
+                const auto &candidate = map_landmarks.landmark_list[closest];
+                const double candDiffX = candidate.x_f - px,
+                             candDiffY = candidate.y_f - py;
+                if(candDiffX*candDiffX + candDiffY*candDiffY >= sqrRange)
                 {
-                    predicted = posPredicted;
+                    vector<int> &inRange = buffers.inRange;
+                    if(!inRangeValid)
+                    {
+                        if(compactCloud)
+                        {
+                            inRange.clear();
+                            for(const int index: cloudCandidates)
+                            {
+                                const auto &landmark = map_landmarks.landmark_list[index];
+                                if(dist(landmark.x_f, landmark.y_f, px, py)<sensor_range)
+                                {
+                                    inRange.push_back(index);
+                                }
+                            }
+                        }
+                        else
+                        {
+                            map_landmarks.grid.queryRange(px, py, sensor_range, inRange);
+                        }
+                        inRangeValid = true;
+                    }
+
+                    const int closestInRange = closestLandmark(map_landmarks, inRange, transX, transY);
+                    if(closestInRange >= 0)
+                    {
+                        closest = closestInRange;
+                    }
+                }
+                const auto &predicted = map_landmarks.landmark_list[closest];
+
+                // calculate weight of the predicted coordinate vs where it ought to be.
+                // we do not need to calculate theta here separately as a wrong theta will automatically
+                // also result in wronger predictions through the movement in the prediction step
+                const double xDiff = predicted.x_f - transX;
+                const double yDiff = predicted.y_f - transY;
+                const double xError = (xDiff*xDiff / xNorm);
+                const double yError = (yDiff*yDiff / yNorm);
+
+                sqrError += xError + yError;
+
+                if(debug)
+                {
+                    debug->associations.push_back(predicted.id_i);
+                    debug->sense_x.push_back(transX);
+                    debug->sense_y.push_back(transY);
                 }
             }
 
-            // calculate weight of the predicted coordinate vs where it ought to be.
-            // we do not need to calculate theta here separately as a wrong theta will automatically
-            // also result in wronger predictions through the movement in the prediction step
-            const double xDiff = predicted.x - observation.x;
-            const double yDiff = predicted.y - observation.y;
-            const double xError = (xDiff*xDiff / xNorm);
-            const double yError = (yDiff*yDiff / yNorm);
+            // the new weight will be required in the resampling step to sample by probability.
+            log_weights[pIndex] = logWeight + observations.size() * logWeightMultiplier - sqrError;
+        }
+    });
+
+    normalizeWeights();
+    updateEstimate();
+    carry_weights = false;
+}
 
-            const double observationWeight = weightMultiplier * exp(-(xError + yError));
+void ParticleFilter::normalizeWeights()
+{
+    const size_t count = log_weights.size();
+    if(count == 0)
+    {
+        effective_sample_size = 0.0;
+        return;
+    }
+
+    // log-sum-exp: shift by the largest log weight so the best particle gets exp(0) = 1 and nothing overflows
+    const double maxLog = *max_element(log_weights.begin(), log_weights.end());
+    if(!isfinite(maxLog))
+    {
+        fill(particles.weight.begin(), particles.weight.end(), 1.0 / count);
+        fill(log_weights.begin(), log_weights.end(), -log(double(count)));
+        effective_sample_size = double(count);
+        return;
+    }
+
+    // one exp per particle, in fixed size blocks whose partial sums are added in block order, so the result
+    // does not depend on the number of threads
+    const size_t blocks = (count + kNormalizeBlock - 1) / kNormalizeBlock;
+    block_sums.resize(blocks);
+    pool->parallelFor(blocks, 1, [&](size_t beginBlock, size_t endBlock, unsigned int)
+    {
+        for(size_t block = beginBlock; block < endBlock; ++block)
+        {
+            const size_t begin = block * kNormalizeBlock;
+            const size_t end = min(count, begin + kNormalizeBlock);
+            const double * __restrict logWeight = log_weights.data();
+            double * __restrict weight = particles.weight.data();
 
-            particle.weight *= observationWeight;
+            double sum = 0.0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                weight[i] = exp(logWeight[i] - maxLog);
+                sum += weight[i];
+            }
+            block_sums[block] = sum;
         }
+    });
+
+    double total = 0.0;
+    for(const double sum: block_sums)
+    {
+        total += sum;
+    }
 
-        // assign new weight to global weights array, will be required in the resampling step to sample by probability.
-        this->weights[pIndex++] = particle.weight;
+    const double invTotal = 1.0 / total;
+    const double logShift = maxLog + log(total);
+    double sqrSum = 0.0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        particles.weight[i] *= invTotal;
+        log_weights[i] -= logShift;
+        sqrSum += particles.weight[i] * particles.weight[i];
     }
+    effective_sample_size = 1.0 / sqrSum;
+}
+
+void ParticleFilter::updateEstimate()
+{
+    const size_t count = particles.size();
+    estimate = FilterEstimate();
+    estimate.particle_count = count;
+    estimate.effective_sample_size = effective_sample_size;
+    if(count == 0)
+    {
+        return;
+    }
+
+    // two passes over fixed blocks, like the normalization: the weighted means and the best particle first,
+    // then the covariance around the mean. the partial sums are added in block order.
+    const size_t blocks = (count + kNormalizeBlock - 1) / kNormalizeBlock;
+    estimate_sums.resize(blocks);
+    pool->parallelFor(blocks, 1, [&](size_t beginBlock, size_t endBlock, unsigned int)
+    {
+        for(size_t block = beginBlock; block < endBlock; ++block)
+        {
+            const size_t begin = block * kNormalizeBlock;
+            const size_t end = min(count, begin + kNormalizeBlock);
+            EstimateSums &sums = estimate_sums[block];
+            sums.x = sums.y = sums.sinTheta = sums.cosTheta = 0.0;
+            sums.maxWeight = -1.0;
+            sums.maxIndex = begin;
+            for(size_t i = begin; i < end; ++i)
+            {
+                const double weight = particles.weight[i];
+                double s, c;
+                fast_sincos(particles.theta[i], s, c);
+                sums.x += weight * particles.x[i];
+                sums.y += weight * particles.y[i];
+                sums.sinTheta += weight * s;
+                sums.cosTheta += weight * c;
+                if(weight > sums.maxWeight)
+                {
+                    sums.maxWeight = weight;
+                    sums.maxIndex = i;
+                }
+            }
+        }
+    });
+
+    double sinTheta = 0.0, cosTheta = 0.0;
+    estimate.max_weight = -1.0;
+    for(const EstimateSums &sums: estimate_sums)
+    {
+        estimate.mean_x += sums.x;
+        estimate.mean_y += sums.y;
+        sinTheta += sums.sinTheta;
+        cosTheta += sums.cosTheta;
+        if(sums.maxWeight > estimate.max_weight)
+        {
+            estimate.max_weight = sums.maxWeight;
+            estimate.best_index = sums.maxIndex;
+        }
+    }
+    estimate.mean_theta = atan2(sinTheta, cosTheta);
+    estimate.mean_weight = 1.0 / count;
+    estimate.best_x = particles.x[estimate.best_index];
+    estimate.best_y = particles.y[estimate.best_index];
+    estimate.best_theta = particles.theta[estimate.best_index];
+
+    const double meanX = estimate.mean_x, meanY = estimate.mean_y, meanTheta = estimate.mean_theta;
+    pool->parallelFor(blocks, 1, [&](size_t beginBlock, size_t endBlock, unsigned int)
+    {
+        for(size_t block = beginBlock; block < endBlock; ++block)
+        {
+            const size_t begin = block * kNormalizeBlock;
+            const size_t end = min(count, begin + kNormalizeBlock);
+            double xx = 0.0, xy = 0.0, xt = 0.0, yy = 0.0, yt = 0.0, tt = 0.0;
+            for(size_t i = begin; i < end; ++i)
+            {
+                const double weight = particles.weight[i];
+                const double dx = particles.x[i] - meanX;
+                const double dy = particles.y[i] - meanY;
+                // heading difference wrapped to [-pi, pi]
+                double dt = particles.theta[i] - meanTheta;
+                dt -= 2.0 * M_PI * floor((dt + M_PI) / (2.0 * M_PI));
+                xx += weight * dx * dx;
+                xy += weight * dx * dy;
+                xt += weight * dx * dt;
+                yy += weight * dy * dy;
+                yt += weight * dy * dt;
+                tt += weight * dt * dt;
+            }
+            double *covariance = estimate_sums[block].covariance;
+            covariance[0] = xx;
+            covariance[1] = xy;
+            covariance[2] = xt;
+            covariance[3] = yy;
+            covariance[4] = yt;
+            covariance[5] = tt;
+        }
+    });
+
+    double covariance[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    for(const EstimateSums &sums: estimate_sums)
+    {
+        for(int k = 0; k < 6; ++k)
+        {
+            covariance[k] += sums.covariance[k];
+        }
+    }
+    estimate.covariance[0][0] = covariance[0];
+    estimate.covariance[0][1] = estimate.covariance[1][0] = covariance[1];
+    estimate.covariance[0][2] = estimate.covariance[2][0] = covariance[2];
+    estimate.covariance[1][1] = covariance[3];
+    estimate.covariance[1][2] = estimate.covariance[2][1] = covariance[4];
+    estimate.covariance[2][2] = covariance[5];
 }
 
 void ParticleFilter::resample() {
@@ -230,21 +709,84 @@ void ParticleFilter::resample() {
 	// NOTE: You may find std::discrete_distribution helpful here.
 	//   http://en.cppreference.com/w/cpp/numeric/random/discrete_distribution
 
-	// prepare sampling by probability
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::discrete_distribution<int> probDistributor(weights.begin(), weights.end());
+    const size_t count = particles.size();
+    if(count == 0)
+    {
+        return;
+    }
+
+    // KLD-sampling adapts the particle count on every step, so it does not wait for the weights to degenerate
+    if(kld_enabled)
+    {
+        kld_sampler.draw(particles.weight, particles.x, particles.y, particles.theta, ancestors);
+
+        const size_t newCount = ancestors.size();
+        const bool withAssociations = !association_data.empty();
+        gathered.resize(newCount);
+        gathered_associations.resize(withAssociations ? newCount : 0);
+        for(size_t i = 0; i < newCount; ++i)
+        {
+            const int source = ancestors[i];
+            gathered.x[i] = particles.x[source];
+            gathered.y[i] = particles.y[source];
+            gathered.theta[i] = particles.theta[source];
+            gathered.weight[i] = particles.weight[source];
+            if(withAssociations)
+            {
+                gathered_associations[i] = association_data[source];
+            }
+        }
+        swap(particles, gathered);
+        swap(association_data, gathered_associations);
+
+        this->num_particles = int(newCount);
+        carry_weights = false;
+        return;
+    }
+
+    // only resample if the weights have degenerated, otherwise keep them for the next update
+    if(effective_sample_size >= resample_threshold * count)
+    {
+        carry_weights = true;
+        return;
+    }
 
     // sample num_particles new particles which will replace the old ones.
     // the higher theirs score (weight) is ... so the more precise they are ... the more likely they will
     // be resampled.
-    vector<Particle> newParticles(this->num_particles);
-    for(auto &newParticle:newParticles)
+    resampler.draw(particles.weight, count, *pool, ancestors);
+
+    // gather in place: every particle which is drawn at least once keeps its slot and its additional copies
+    // go to the slots of the particles which were not drawn at all, so only those slots are written.
+    offspring.assign(count, 0);
+    for(const int ancestor: ancestors)
     {
-        newParticle = particles[probDistributor(gen)];
+        ++offspring[ancestor];
+    }
+
+    const bool withAssociations = !association_data.empty();
+    size_t freeSlot = 0;
+    for(size_t source = 0; source < count; ++source)
+    {
+        for(int copy = 1; copy < offspring[source]; ++copy)
+        {
+            while(offspring[freeSlot] != 0)
+            {
+                ++freeSlot;
+            }
+            particles.x[freeSlot] = particles.x[source];
+            particles.y[freeSlot] = particles.y[source];
+            particles.theta[freeSlot] = particles.theta[source];
+            particles.weight[freeSlot] = particles.weight[source];
+            if(withAssociations)
+            {
+                association_data[freeSlot] = association_data[source];
+            }
+            ++freeSlot;
+        }
     }
 
-    particles = newParticles;
+    carry_weights = false;
 }
 
 Particle ParticleFilter::SetAssociations(Particle& particle, const std::vector<int>& associations, 
@@ -262,30 +804,110 @@ Particle ParticleFilter::SetAssociations(Particle& particle, const std::vector<i
     return particle;
 }
 
-string ParticleFilter::getAssociations(Particle best)
+/**
+ * Formats values space separated
+ */
+template <typename Output, typename Value>
+static string joinValues(const vector<Value> &values)
+{
+    ostringstream ss;
+    for(size_t i = 0; i < values.size(); ++i)
+    {
+        if(i > 0)
+        {
+            ss << ' ';
+        }
+        ss << Output(values[i]);
+    }
+    return ss.str();
+}
+
+string ParticleFilter::getAssociations(const Particle &best)
+{
+    return joinValues<int>(best.associations);
+}
+
+string ParticleFilter::getSenseX(const Particle &best)
+{
+    return joinValues<float>(best.sense_x);
+}
+
+string ParticleFilter::getSenseY(const Particle &best)
 {
-	vector<int> v = best.associations;
-	stringstream ss;
-    copy( v.begin(), v.end(), ostream_iterator<int>(ss, " "));
-    string s = ss.str();
-    s = s.substr(0, s.length()-1);  // get rid of the trailing space
-    return s;
-}
-string ParticleFilter::getSenseX(Particle best)
+    return joinValues<float>(best.sense_y);
+}
+
+void ParticleFilter::buildBestStrings()
 {
-	vector<double> v = best.sense_x;
-	stringstream ss;
-    copy( v.begin(), v.end(), ostream_iterator<float>(ss, " "));
-    string s = ss.str();
-    s = s.substr(0, s.length()-1);  // get rid of the trailing space
-    return s;
-}
-string ParticleFilter::getSenseY(Particle best)
+    best_strings_valid = true;
+    ParticleAssociations best;
+    if(last_map && !last_map->grid.empty() && estimate.particle_count > 0)
+    {
+        const Map &map_landmarks = *last_map;
+        const double px = estimate.best_x, py = estimate.best_y;
+        const double cos_pt = cos(estimate.best_theta), sin_pt = sin(estimate.best_theta);
+        const double sqrRange = last_sensor_range * last_sensor_range;
+        vector<int> inRange;
+        bool inRangeValid = false;
+
+        // the same association as in updateWeights: the closest landmark, unless it is out of sensor range
+        for(const auto &observation: last_observations)
+        {
+            const double transX = cos_pt*observation.x - sin_pt*observation.y + px;
+            const double transY = sin_pt*observation.x + cos_pt*observation.y + py;
+
+            int closest = map_landmarks.grid.nearest(transX, transY);
+            const auto &candidate = map_landmarks.landmark_list[closest];
+            const double candDiffX = candidate.x_f - px,
+                         candDiffY = candidate.y_f - py;
+            if(candDiffX*candDiffX + candDiffY*candDiffY >= sqrRange)
+            {
+                if(!inRangeValid)
+                {
+                    map_landmarks.grid.queryRange(px, py, last_sensor_range, inRange);
+                    inRangeValid = true;
+                }
+                const int closestInRange = closestLandmark(map_landmarks, inRange, transX, transY);
+                if(closestInRange >= 0)
+                {
+                    closest = closestInRange;
+                }
+            }
+
+            best.associations.push_back(map_landmarks.landmark_list[closest].id_i);
+            best.sense_x.push_back(transX);
+            best.sense_y.push_back(transY);
+        }
+    }
+
+    best_associations = joinValues<int>(best.associations);
+    best_sense_x = joinValues<float>(best.sense_x);
+    best_sense_y = joinValues<float>(best.sense_y);
+}
+
+const std::string &ParticleFilter::getBestAssociations()
+{
+    if(!best_strings_valid)
+    {
+        buildBestStrings();
+    }
+    return best_associations;
+}
+
+const std::string &ParticleFilter::getBestSenseX()
 {
-	vector<double> v = best.sense_y;
-	stringstream ss;
-    copy( v.begin(), v.end(), ostream_iterator<float>(ss, " "));
-    string s = ss.str();
-    s = s.substr(0, s.length()-1);  // get rid of the trailing space
-    return s;
+    if(!best_strings_valid)
+    {
+        buildBestStrings();
+    }
+    return best_sense_x;
+}
+
+const std::string &ParticleFilter::getBestSenseY()
+{
+    if(!best_strings_valid)
+    {
+        buildBestStrings();
+    }
+    return best_sense_y;
 }
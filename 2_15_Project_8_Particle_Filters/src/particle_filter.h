@@ -9,7 +9,13 @@
 #ifndef PARTICLE_FILTER_H_
 #define PARTICLE_FILTER_H_
 
+#include <memory>
 #include "helper_functions.h"
+#include "global_localizer.h"
+#include "kld_sampler.h"
+#include "resampler.h"
+#include "rng.h"
+#include "thread_pool.h"
 
 class Particle {
 
@@ -33,33 +39,220 @@ public:
 	id(inId), x(inX), y(inY), theta(inTheta), weight(inWeight) {}
 };
 
+/*
+ * Storage of all particles as structure of arrays: every per particle loop of the filter runs over
+ * contiguous arrays of just the components it needs, and resampling only moves four doubles per particle.
+ */
+struct ParticleSet {
+
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> theta;
+	std::vector<double> weight;
+
+	//! Returns the number of particles
+	size_t size() const { return x.size(); }
+
+	//! Returns whether the set is empty
+	bool empty() const { return x.empty(); }
+
+	//! Resizes all component arrays
+	void resize(size_t count) {
+		x.resize(count);
+		y.resize(count);
+		theta.resize(count);
+		weight.resize(count);
+	}
+};
+
+/*
+ * Summary of the weighted particle set, maintained by updateWeights.
+ */
+struct FilterEstimate {
+
+	size_t particle_count;			// Number of particles the estimate was computed from
+	size_t best_index;				// Index of the best particle, only valid until the next resample call
+	double best_x, best_y, best_theta;	// Pose of the particle with the highest weight
+	double mean_x, mean_y, mean_theta;	// Weighted mean pose, theta is the circular mean
+	double covariance[3][3];		// Weighted covariance of (x, y, theta) around the mean
+	double max_weight;				// Highest normalized weight
+	double mean_weight;				// Average normalized weight, 1 / particle_count
+	double effective_sample_size;	// 1 / sum of the squared normalized weights
+
+	FilterEstimate() : particle_count(0), best_index(0), best_x(0.0), best_y(0.0), best_theta(0.0), mean_x(0.0),
+	                   mean_y(0.0), mean_theta(0.0), covariance(), max_weight(0.0), mean_weight(0.0),
+	                   effective_sample_size(0.0) {}
+};
+
+/*
+ * Observation models of updateWeights.
+ */
+enum class ObservationModel {
+	ASSOCIATION,		// every observation is associated with the closest landmark in sensor range
+	LIKELIHOOD_FIELD	// every observation is scored with the precomputed field of the map, see Map::field
+};
+
+/*
+ * Association debug data of one particle, only recorded on request (see ParticleFilter::setRecordAssociations).
+ */
+struct ParticleAssociations {
+
+	std::vector<int> associations;
+	std::vector<double> sense_x;
+	std::vector<double> sense_y;
+};
+
 
 
 class ParticleFilter {
 	
 	// Number of particles to draw
 	int num_particles; 
+
+	// Number of particles init draws
+	int particle_count;
 	
 	
 	
 	// Flag, if filter is initialized
 	bool is_initialized;
 	
-	// Vector of weights of all particles
-	std::vector<double> weights;
+	// Flag, if association debug data is recorded in updateWeights
+	bool record_associations;
+
+	// Association debug data per particle, only filled if record_associations is set
+	std::vector<ParticleAssociations> association_data;
+
+	// Preallocated buffers of one worker thread in updateWeights
+	struct UpdateScratch {
+		std::vector<int> inRange;
+	};
+
+	// Worker threads for the per particle loops
+	std::unique_ptr<ThreadPool> pool;
+
+	// One scratch buffer set per worker thread
+	std::vector<UpdateScratch> scratch;
+
+	// Normalized log weights of all particles, particles.weight holds their exponentials
+	std::vector<double> log_weights;
+
+	// Effective sample size of the current weights
+	double effective_sample_size;
+
+	// Partial sums of the weight normalization
+	std::vector<double> block_sums;
+
+	// Preallocated noise samples of the prediction step
+	std::vector<double> noise_x, noise_y, noise_theta;
+
+	// Random streams of the initialization and the motion noise, one per block of particles so the noise
+	// does not depend on the number of threads
+	RandomStreams noise_streams;
+
+	// Draws the ancestor indices of the resampling step
+	Resampler resampler;
+
+	// Resampling only happens if the effective sample size is below this fraction of the particle count
+	double resample_threshold;
+
+	// Flag, if the weights were kept by the last resample call and have to be carried into the next update
+	bool carry_weights;
+
+	// Preallocated buffers of the resampling step
+	std::vector<int> ancestors, offspring;
+
+	// Draws an adaptive number of particles in the resampling step if kld_enabled is set
+	KldSampler kld_sampler;
+	bool kld_enabled;
+
+	// Target buffers of the KLD resampling step, swapped with particles afterwards
+	ParticleSet gathered;
+	std::vector<ParticleAssociations> gathered_associations;
+
+	// Observation model of updateWeights
+	ObservationModel observation_model;
+
+	// Fills the noise arrays of the particles begin .. end-1 of one block with gaussian samples
+	void drawNoise(size_t block, size_t begin, size_t end, const double std[]);
+
+	// Summary of the weights of the last updateWeights call and its per block partial sums
+	FilterEstimate estimate;
+	struct EstimateSums {
+		double x, y, sinTheta, cosTheta;
+		double covariance[6];
+		double maxWeight;
+		size_t maxIndex;
+	};
+	std::vector<EstimateSums> estimate_sums;
+
+	// Inputs of the last updateWeights call, kept to associate the observations of the best particle on request
+	std::vector<LandmarkObs> last_observations;
+	const Map *last_map;
+	double last_sensor_range;
+
+	// Association debug strings of the best particle, built on the first request after an update
+	bool best_strings_valid;
+	std::string best_associations, best_sense_x, best_sense_y;
+
+	// Searches the initial hypotheses of initGlobal
+	GlobalLocalizer global_localizer;
+	std::vector<PoseHypothesis> hypotheses;
+
+	// Draws the particles around the centers, every center gets a share according to its error
+	void initParticles(const std::vector<PoseHypothesis> &centers, double std[]);
+
+	// Computes estimate from the normalized weights
+	void updateEstimate();
+
+	// Associates the observations of the last update from the pose of the best particle and formats them
+	void buildBestStrings();
+
+	// Normalizes the log weights with the log-sum-exp trick and derives the particle weights and the effective
+	// sample size from them
+	void normalizeWeights();
 	
 public:
 	
 	// Set of current particles
-	std::vector<Particle> particles;
+	ParticleSet particles;
+
+	// Constructor, uses one worker thread per core
+	ParticleFilter();
 
-	// Constructor
-	// @param num_particles Number of particles
-	ParticleFilter() : num_particles(0), is_initialized(false) {}
+	/**
+	 * setThreadCount Sets the number of worker threads used by updateWeights.
+	 * @param threadCount Number of threads including the calling one, 0 selects one per core
+	 */
+	void setThreadCount(unsigned int threadCount);
 
 	// Destructor
 	~ParticleFilter() {}
 
+	/**
+	 * setParticleCount Sets the number of particles init draws, 100 by default. With KLD-sampling init draws
+	 *   the configured maximum count instead.
+	 */
+	void setParticleCount(int count);
+
+	/**
+	 * seed Restarts all random generators of the filter (initialization, motion noise and resampling), so
+	 *   runs with the same seed and inputs give the same particles.
+	 */
+	void seed(uint64_t inSeed);
+
+	/**
+	 * setRecordAssociations Enables recording of the association debug data (landmark ids and the observations
+	 *   in map coordinates) of every particle in updateWeights. It is off by default.
+	 */
+	void setRecordAssociations(bool record);
+
+	/**
+	 * getParticle Assembles one particle including its association debug data, if recorded.
+	 * @param index Index of the particle in particles
+	 */
+	Particle getParticle(size_t index) const;
+
 	/**
 	 * init Initializes particle filter by initializing particles to Gaussian
 	 *   distribution around first position and all the weights to 1.
@@ -71,6 +264,28 @@ public:
 	 */
 	void init(double x, double y, double theta, double std[]);
 
+	/**
+	 * initGlobal Initializes the particle filter without a position estimate (global localization, e.g. after
+	 *   the vehicle was kidnapped): a coarse-to-fine search over the whole map finds the poses from which the
+	 *   observations match the landmarks best, and the particles are drawn around these hypotheses. The search
+	 *   takes a bounded number of steps regardless of the map size, see GlobalLocalizer.
+	 * @param observations Landmark observations of the current time step
+	 * @param map_landmarks Map with its spatial index
+	 * @param std_landmark[] Array of dimension 2 [Landmark measurement uncertainty [x [m], y [m]]]
+	 * @param std[] Array of dimension 3 [spread of the particles around a hypothesis in x [m], y [m], yaw [rad]]
+	 * @param config Resolution and effort of the search
+	 * @return False if nothing was found (no observations or an empty map), the filter stays uninitialized then
+	 */
+	bool initGlobal(const std::vector<LandmarkObs> &observations, const Map &map_landmarks, double std_landmark[],
+	                double std[], const GlobalLocalizationConfig &config = GlobalLocalizationConfig());
+
+	/**
+	 * getHypotheses Returns the poses found by the last initGlobal call, best first.
+	 */
+	const std::vector<PoseHypothesis> &getHypotheses() const {
+		return hypotheses;
+	}
+
 	/**
 	 * prediction Predicts the state for the next time step
 	 *   using the process model.
@@ -88,7 +303,7 @@ public:
 	 * @param predicted Vector of predicted landmark observations
 	 * @param observations Vector of landmark observations
 	 */
-	void dataAssociation(std::vector<LandmarkObs> predicted, std::vector<LandmarkObs>& observations);
+	void dataAssociation(const std::vector<LandmarkObs> &predicted, std::vector<LandmarkObs>& observations);
 
 	/**
 	 * Computes the potential observations within sensor range of the vehicle
@@ -114,6 +329,52 @@ public:
 	void updateWeights(double sensor_range, double std_landmark[], const std::vector<LandmarkObs> &observations,
 			const Map &map_landmarks);
 	
+	/**
+	 * effectiveSampleSize Returns the effective sample size 1 / sum(w_i^2) of the normalized weights of the
+	 *   last updateWeights call.
+	 */
+	double effectiveSampleSize() const {
+		return effective_sample_size;
+	}
+
+	/**
+	 * getLogWeights Returns the normalized log weights of the last updateWeights call.
+	 */
+	const std::vector<double> &getLogWeights() const {
+		return log_weights;
+	}
+
+	/**
+	 * setResampleMethod Selects the resampling algorithm, systematic resampling by default.
+	 */
+	void setResampleMethod(ResampleMethod method);
+
+	/**
+	 * setResampleThreshold Sets when resampling happens.
+	 * @param fraction Particles are resampled if the effective sample size drops below fraction * particle
+	 *   count. 0.5 by default, values above 1 resample on every call.
+	 */
+	void setResampleThreshold(double fraction);
+
+	/**
+	 * setKldSampling Enables KLD-sampling: every resample call then draws as many particles as the KL-divergence
+	 *   bound over a histogram of (x, y, theta) requires, within the configured minimum and maximum count.
+	 *   The resample threshold and method are not used in this mode. Takes effect at the next init call for
+	 *   the initial particle count.
+	 * @param enable True to enable KLD-sampling, it is off by default
+	 * @param config Bounds, bin sizes and error parameters
+	 */
+	void setKldSampling(bool enable, const KldConfig &config = KldConfig());
+
+	/**
+	 * setObservationModel Selects how updateWeights scores the observations. The likelihood field model needs
+	 *   the field of the map (Map::buildLikelihoodField), without it updateWeights uses the association model.
+	 *   The field has the landmark uncertainty of its build baked in, so updateWeights takes it from the field
+	 *   and ignores its std_landmark argument in this mode. It does not record association debug data. The
+	 *   association model is the default.
+	 */
+	void setObservationModel(ObservationModel model);
+
 	/**
 	 * resample Resamples from the updated set of particles to form
 	 *   the new set of particles.
@@ -128,9 +389,28 @@ public:
 		                     const std::vector<double>& sense_x, const std::vector<double>& sense_y);
 
 	
-	std::string getAssociations(Particle best);
-	std::string getSenseX(Particle best);
-	std::string getSenseY(Particle best);
+	std::string getAssociations(const Particle &best);
+	std::string getSenseX(const Particle &best);
+	std::string getSenseY(const Particle &best);
+
+	/**
+	 * getEstimate Returns the best particle, the weighted mean pose with its covariance and the weight
+	 *   statistics of the last updateWeights call. They describe the weighted set, so they stay valid after
+	 *   resample, apart from best_index.
+	 */
+	const FilterEstimate &getEstimate() const {
+		return estimate;
+	}
+
+	/**
+	 * getBestAssociations, getBestSenseX, getBestSenseY Return the association debug strings (landmark ids and
+	 *   observations in map coordinates, space separated) of the best particle of the last updateWeights call.
+	 *   They are only computed when requested and do not need setRecordAssociations. The map passed to that
+	 *   updateWeights call must still exist.
+	 */
+	const std::string &getBestAssociations();
+	const std::string &getBestSenseX();
+	const std::string &getBestSenseY();
 
 	/**
 	* initialized Returns whether particle filter is initialized yet or not.
@@ -0,0 +1,225 @@
+/*
+ * resampler.cpp
+ *
+ * Resampling algorithms of the particle filter.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+
+#include "resampler.h"
+
+using namespace std;
+
+// particles per independent random stream of the Metropolis resampler. the streams only depend on the seed,
+// the call and the block index, so the result does not depend on the number of threads.
+static const size_t kMetropolisBlock = 4096;
+
+Resampler::Resampler(uint64_t seed) : method(ResampleMethod::SYSTEMATIC), metropolisSteps(32)
+{
+    this->seed(seed);
+}
+
+void Resampler::seed(uint64_t inSeed)
+{
+    baseSeed = inSeed;
+    drawCount = 0;
+    gen.seed(inSeed);
+}
+
+void Resampler::draw(const std::vector<double> &weights, size_t count, ThreadPool &pool, std::vector<int> &outIndices)
+{
+    outIndices.clear();
+    ++drawCount;
+    if(weights.empty() || count == 0)
+    {
+        return;
+    }
+
+    if(method == ResampleMethod::METROPOLIS)
+    {
+        drawMetropolis(weights, count, pool, outIndices);
+        return;
+    }
+
+    double total = 0.0;
+    for(const double weight: weights)
+    {
+        total += weight;
+    }
+
+    // without any information all particles are equally likely
+    if(!(total > 0.0) || !isfinite(total))
+    {
+        outIndices.resize(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            outIndices[i] = int(i * weights.size() / count);
+        }
+        return;
+    }
+
+    switch(method)
+    {
+    case ResampleMethod::MULTINOMIAL:
+        drawMultinomial(weights, total, count, outIndices);
+        break;
+    case ResampleMethod::STRATIFIED:
+        drawStratified(weights, total, count, outIndices);
+        break;
+    case ResampleMethod::RESIDUAL:
+        drawResidual(weights, total, count, outIndices);
+        break;
+    default:
+        drawSystematic(weights, total, count, outIndices);
+        break;
+    }
+}
+
+template <typename Positions>
+void Resampler::walk(const std::vector<double> &weights, double total, size_t count, Positions next,
+                     std::vector<int> &outIndices)
+{
+    const size_t last = weights.size() - 1;
+    size_t j = 0;
+    double cumulative = weights[0];
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const double position = next(i) * total;
+        while(cumulative <= position && j < last)
+        {
+            cumulative += weights[++j];
+        }
+        outIndices.push_back(int(j));
+    }
+}
+
+void Resampler::drawMultinomial(const std::vector<double> &weights, double total, size_t count,
+                                std::vector<int> &outIndices)
+{
+    // count + 1 exponential spacings normalized by their sum are count sorted uniform draws
+    exponential_distribution<double> spacing(1.0);
+    residuals.resize(count);
+    double sum = 0.0;
+    for(size_t i = 0; i < count; ++i)
+    {
+        sum += spacing(gen);
+        residuals[i] = sum;
+    }
+    const double norm = 1.0 / (sum + spacing(gen));
+
+    walk(weights, total, count, [&](size_t i) { return residuals[i] * norm; }, outIndices);
+}
+
+void Resampler::drawSystematic(const std::vector<double> &weights, double total, size_t count,
+                               std::vector<int> &outIndices)
+{
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double offset = uniform(gen);
+    const double step = 1.0 / count;
+
+    walk(weights, total, count, [&](size_t i) { return (i + offset) * step; }, outIndices);
+}
+
+void Resampler::drawStratified(const std::vector<double> &weights, double total, size_t count,
+                               std::vector<int> &outIndices)
+{
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double step = 1.0 / count;
+
+    walk(weights, total, count, [&](size_t i) { return (i + uniform(gen)) * step; }, outIndices);
+}
+
+void Resampler::drawResidual(const std::vector<double> &weights, double total, size_t count,
+                             std::vector<int> &outIndices)
+{
+    // deterministic part: floor(count * w) copies of every particle
+    const double scale = count / total;
+    residuals.resize(weights.size());
+    size_t copies = 0;
+    for(size_t j = 0; j < weights.size(); ++j)
+    {
+        const double expected = weights[j] * scale;
+        const double whole = floor(expected);
+        residuals[j] = expected - whole;
+        copies += size_t(whole);
+    }
+
+    // random part: the remaining draws are taken systematically from the residual weights
+    const size_t remaining = count > copies ? count - copies : 0;
+    vector<int> extra;
+    if(remaining > 0)
+    {
+        double residualTotal = 0.0;
+        for(const double residual: residuals)
+        {
+            residualTotal += residual;
+        }
+        if(residualTotal > 0.0)
+        {
+            drawSystematic(residuals, residualTotal, remaining, extra);
+        }
+    }
+
+    // merge both sorted parts
+    size_t e = 0;
+    for(size_t j = 0; j < weights.size() && outIndices.size() < count; ++j)
+    {
+        size_t n = size_t(floor(weights[j] * scale));
+        while(e < extra.size() && extra[e] == int(j))
+        {
+            ++n;
+            ++e;
+        }
+        for(size_t c = 0; c < n && outIndices.size() < count; ++c)
+        {
+            outIndices.push_back(int(j));
+        }
+    }
+
+    // rounding can leave the set one short, fill it up with the heaviest particle
+    if(outIndices.size() < count)
+    {
+        const int heaviest = int(max_element(weights.begin(), weights.end()) - weights.begin());
+        outIndices.resize(count, heaviest);
+        sort(outIndices.begin(), outIndices.end());
+    }
+}
+
+void Resampler::drawMetropolis(const std::vector<double> &weights, size_t count, ThreadPool &pool,
+                               std::vector<int> &outIndices)
+{
+    outIndices.resize(count);
+    const size_t n = weights.size();
+    const size_t blocks = (count + kMetropolisBlock - 1) / kMetropolisBlock;
+    const uint64_t callSeed = baseSeed ^ (drawCount * 0xd1b54a32d192ed03ULL);
+    const int steps = metropolisSteps;
+
+    // every chain starts at its own index and proposes uniformly chosen particles, accepted with the weight
+    // ratio. the chains only read the weights, so they run fully in parallel.
+    pool.parallelFor(blocks, 1, [&](size_t beginBlock, size_t endBlock, unsigned int)
+    {
+        for(size_t block = beginBlock; block < endBlock; ++block)
+        {
+            uint64_t state = callSeed + block * 0x9e3779b97f4a7c15ULL;
+            splitmix64(state);
+
+            const size_t end = min(count, (block + 1) * kMetropolisBlock);
+            for(size_t i = block * kMetropolisBlock; i < end; ++i)
+            {
+                size_t k = i % n;
+                for(int b = 0; b < steps; ++b)
+                {
+                    const size_t j = min(n - 1, size_t(toUnit(splitmix64(state)) * n));
+                    if(toUnit(splitmix64(state)) * weights[k] <= weights[j])
+                    {
+                        k = j;
+                    }
+                }
+                outIndices[i] = int(k);
+            }
+        }
+    });
+}
@@ -0,0 +1,81 @@
+/*
+ * resampler.h
+ *
+ * Resampling algorithms of the particle filter.
+ */
+
+#ifndef RESAMPLER_H_
+#define RESAMPLER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "rng.h"
+#include "thread_pool.h"
+
+/*
+ * Available resampling algorithms. All of them run in O(N).
+ */
+enum class ResampleMethod {
+	MULTINOMIAL,	// independent draws, merged against the cumulative weights via sorted uniforms
+	SYSTEMATIC,		// one uniform offset for N equally spaced pointers (low variance resampling)
+	STRATIFIED,		// one uniform draw inside each of N equally sized strata
+	RESIDUAL,		// floor(N*w) deterministic copies, the remainder drawn systematically
+	METROPOLIS		// parallel Metropolis resampler, needs no sum over the weights (for very large N)
+};
+
+/*
+ * Computes ancestor indices from particle weights. The particle data itself is moved by the caller, see
+ * ParticleFilter::resample, so the algorithms only deal with index arrays.
+ */
+class Resampler {
+
+public:
+
+	//! Initializes the resampler with systematic resampling
+	//! \param seed Seed of the random generator
+	explicit Resampler(uint64_t seed = 0x5eedULL);
+
+	//! Selects the algorithm
+	void setMethod(ResampleMethod inMethod) { method = inMethod; }
+	ResampleMethod getMethod() const { return method; }
+
+	//! Sets the number of Metropolis steps per particle of the METROPOLIS method
+	void setMetropolisSteps(int steps) { metropolisSteps = steps; }
+
+	//! Restarts the random generator
+	void seed(uint64_t inSeed);
+
+	//! Draws count ancestor indices with probability proportional to weights
+	//! \param weights Non negative particle weights, they do not need to be normalized
+	//! \param count Number of particles to draw
+	//! \param pool Worker threads, used by the METROPOLIS method
+	//! \param outIndices Receives the count ancestor indices, sorted ascending for all methods but METROPOLIS
+	void draw(const std::vector<double> &weights, size_t count, ThreadPool &pool, std::vector<int> &outIndices);
+
+private:
+
+	// Walks count sorted positions in [0, 1) against the cumulative weights, positions are produced by next
+	template <typename Positions>
+	static void walk(const std::vector<double> &weights, double total, size_t count, Positions next,
+	                 std::vector<int> &outIndices);
+
+	void drawMultinomial(const std::vector<double> &weights, double total, size_t count, std::vector<int> &outIndices);
+	void drawSystematic(const std::vector<double> &weights, double total, size_t count, std::vector<int> &outIndices);
+	void drawStratified(const std::vector<double> &weights, double total, size_t count, std::vector<int> &outIndices);
+	void drawResidual(const std::vector<double> &weights, double total, size_t count, std::vector<int> &outIndices);
+	void drawMetropolis(const std::vector<double> &weights, size_t count, ThreadPool &pool,
+	                    std::vector<int> &outIndices);
+
+	ResampleMethod method;
+	int metropolisSteps;
+
+	Xoshiro256 gen;
+	uint64_t baseSeed;
+	uint64_t drawCount;
+
+	// scratch buffer of the residual method
+	std::vector<double> residuals;
+};
+
+#endif /* RESAMPLER_H_ */
@@ -0,0 +1,93 @@
+/*
+ * rng.cpp
+ *
+ * Random number generation of the filter: xoshiro256++ streams and bulk gaussian sampling.
+ */
+
+#include <math.h>
+
+#include "rng.h"
+#include "fast_math.h"
+
+using namespace std;
+
+void Xoshiro256::jump()
+{
+    static const uint64_t kJump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                     0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for(const uint64_t word: kJump)
+    {
+        for(int b = 0; b < 64; ++b)
+        {
+            if(word & (uint64_t(1) << b))
+            {
+                s0 ^= s[0];
+                s1 ^= s[1];
+                s2 ^= s[2];
+                s3 ^= s[3];
+            }
+            (*this)();
+        }
+    }
+    s[0] = s0;
+    s[1] = s1;
+    s[2] = s2;
+    s[3] = s3;
+}
+
+void RandomStreams::reserve(size_t count)
+{
+    while(streams.size() < count)
+    {
+        streams.push_back(nextStart);
+        nextStart.jump();
+    }
+}
+
+/**
+ * Box-Muller transform of count pairs of uniforms, stored interleaved in values, into gaussians. the log and
+ * the sincos passes are branch free and vectorized. the square root sets errno for negative arguments, which
+ * keeps its loop scalar, so it gets a pass of its own.
+ */
+static void boxMuller(double * __restrict values, size_t pairs, double mean, double stddev)
+{
+    for(size_t i = 0; i < pairs; ++i)
+    {
+        values[2 * i] = -2.0 * fast_log(values[2 * i]);
+    }
+    for(size_t i = 0; i < pairs; ++i)
+    {
+        values[2 * i] = stddev * sqrt(values[2 * i]);
+    }
+
+    const double twoPi = 2.0 * M_PI;
+    for(size_t i = 0; i < pairs; ++i)
+    {
+        const double radius = values[2 * i];
+        double s, c;
+        fast_sincos(twoPi * values[2 * i + 1], s, c);
+        values[2 * i] = mean + radius * c;
+        values[2 * i + 1] = mean + radius * s;
+    }
+}
+
+void fillGaussian(Xoshiro256 &gen, double *out, size_t count, double mean, double stddev)
+{
+    // the first uniform of a pair is taken from (0, 1] so its log is finite
+    const size_t pairs = count / 2;
+    for(size_t i = 0; i < pairs; ++i)
+    {
+        out[2 * i] = ((gen() >> 11) + 1) * (1.0 / 9007199254740992.0);
+        out[2 * i + 1] = gen.uniform();
+    }
+    boxMuller(out, pairs, mean, stddev);
+
+    if(count & 1)
+    {
+        double last[2] = {((gen() >> 11) + 1) * (1.0 / 9007199254740992.0), gen.uniform()};
+        boxMuller(last, 1, mean, stddev);
+        out[count - 1] = last[0];
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * rng.h
+ *
+ * Random number generation of the filter: xoshiro256++ streams and bulk gaussian sampling.
+ */
+
+#ifndef RNG_H_
+#define RNG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * splitmix64 step, used to expand seeds and as a small counter based generator
+ */
+inline uint64_t splitmix64(uint64_t &state) {
+	uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Converts the upper 53 of 64 random bits to a double in [0, 1)
+ */
+inline double toUnit(uint64_t bits) {
+	return (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * xoshiro256++ generator (Blackman, Vigna). It is a UniformRandomBitGenerator, so it also works with the
+ * distributions of <random>. jump() advances it by 2^128 draws, which splits one seed into non overlapping
+ * streams for parallel use.
+ */
+class Xoshiro256 {
+
+public:
+
+	typedef uint64_t result_type;
+
+	//! Initializes the generator, the seed is expanded with splitmix64
+	explicit Xoshiro256(uint64_t inSeed = 0x5eedULL) { seed(inSeed); }
+
+	//! Restarts the generator
+	void seed(uint64_t inSeed) {
+		uint64_t state = inSeed;
+		for (int i = 0; i < 4; ++i) {
+			s[i] = splitmix64(state);
+		}
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	//! Returns the next 64 random bits
+	result_type operator()() {
+		const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+		const uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	//! Returns a uniformly distributed double in [0, 1)
+	double uniform() { return toUnit((*this)()); }
+
+	//! Advances the generator by 2^128 draws
+	void jump();
+
+private:
+
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	uint64_t s[4];
+};
+
+/*
+ * Independent streams of one seed, stream i is the seeded generator jumped i times. Work that is split into
+ * fixed blocks and draws block i from stream i gives the same result for any number of threads.
+ */
+class RandomStreams {
+
+public:
+
+	explicit RandomStreams(uint64_t inSeed = 0x5eedULL) : nextStart(inSeed) {}
+
+	//! Restarts all streams
+	void seed(uint64_t inSeed) {
+		nextStart.seed(inSeed);
+		streams.clear();
+	}
+
+	//! Makes sure the streams 0 .. count-1 exist, streams which already exist keep their state
+	void reserve(size_t count);
+
+	//! Returns stream i, reserve must have been called for it
+	Xoshiro256 &operator[](size_t i) { return streams[i]; }
+
+	//! Returns the number of streams
+	size_t size() const { return streams.size(); }
+
+private:
+
+	Xoshiro256 nextStart;	// start of the next stream to create
+	std::vector<Xoshiro256> streams;
+};
+
+//! Fills out with count normally distributed values. The uniforms are drawn first and then transformed in
+//! pairs with the Box-Muller method in branch free loops which the compiler vectorizes.
+//! \param gen Source of the uniform values
+//! \param out Target array
+//! \param count Number of values
+//! \param mean, stddev Parameters of the distribution
+void fillGaussian(Xoshiro256 &gen, double *out, size_t count, double mean, double stddev);
+
+#endif /* RNG_H_ */
@@ -0,0 +1,117 @@
+/*
+ * thread_pool.cpp
+ *
+ * Persistent worker threads for data parallel loops of the particle filter.
+ */
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int threadCount) :
+    task(nullptr), taskCount(0), taskChunks(0), generation(0), pending(0), stopping(false)
+{
+    if(threadCount == 0)
+    {
+        threadCount = max(1u, thread::hardware_concurrency());
+    }
+
+    for(unsigned int worker = 1; worker < threadCount; ++worker)
+    {
+        threads.emplace_back(&ThreadPool::workerLoop, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for(auto &thread: threads)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t minChunk, const Task &inTask)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    // use fewer chunks than workers if the chunks would get too small
+    const size_t maxChunks = max<size_t>(1, count / max<size_t>(1, minChunk));
+    const unsigned int chunks = unsigned(min<size_t>(size(), maxChunks));
+
+    if(chunks == 1)
+    {
+        inTask(0, count, 0);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(stateMutex);
+        task = &inTask;
+        taskCount = count;
+        taskChunks = chunks;
+        pending = chunks - 1;
+        ++generation;
+    }
+    wake.notify_all();
+
+    // the calling thread processes the first chunk itself
+    runChunk(0);
+
+    unique_lock<mutex> lock(stateMutex);
+    done.wait(lock, [this]() { return pending == 0; });
+    task = nullptr;
+}
+
+void ThreadPool::runChunk(unsigned int worker)
+{
+    const size_t begin = taskCount * worker / taskChunks;
+    const size_t end = taskCount * (worker + 1) / taskChunks;
+    (*task)(begin, end, worker);
+}
+
+void ThreadPool::workerLoop(unsigned int worker)
+{
+    unsigned long seen = 0;
+
+    for(;;)
+    {
+        {
+            unique_lock<mutex> lock(stateMutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if(stopping)
+            {
+                return;
+            }
+            seen = generation;
+
+            // workers beyond the number of chunks sit this loop out
+            if(worker >= taskChunks)
+            {
+                continue;
+            }
+        }
+
+        runChunk(worker);
+
+        bool last;
+        {
+            lock_guard<mutex> lock(stateMutex);
+            last = (--pending == 0);
+        }
+        if(last)
+        {
+            done.notify_one();
+        }
+    }
+}
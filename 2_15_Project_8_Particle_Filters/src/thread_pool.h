@@ -0,0 +1,67 @@
+/*
+ * thread_pool.h
+ *
+ * Persistent worker threads for data parallel loops of the particle filter.
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads which are created once and reused for every parallel loop. The thread that
+ * calls parallelFor takes part as worker 0, so a pool of size 1 runs everything inline.
+ */
+class ThreadPool {
+
+public:
+
+	//! Loop body, called with the half open range [begin, end) and the index of the executing worker
+	typedef std::function<void(size_t begin, size_t end, unsigned int worker)> Task;
+
+	//! Starts the workers
+	//! \param threadCount Total number of workers including the calling thread, 0 selects the hardware concurrency
+	explicit ThreadPool(unsigned int threadCount = 0);
+
+	//! Stops and joins the workers
+	~ThreadPool();
+
+	//! Returns the number of workers including the calling thread
+	unsigned int size() const { return unsigned(threads.size()) + 1; }
+
+	//! Splits [0, count) into at most size() contiguous chunks of at least minChunk elements and runs task on
+	//! them in parallel. The split only depends on count, minChunk and size(), so a task whose chunks write
+	//! disjoint data gives the same result on every run. Blocks until all chunks are done.
+	void parallelFor(size_t count, size_t minChunk, const Task &task);
+
+private:
+
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+
+	// Main loop of the worker threads
+	void workerLoop(unsigned int worker);
+
+	// Runs the chunk of the current task which belongs to worker
+	void runChunk(unsigned int worker);
+
+	std::vector<std::thread> threads;
+
+	std::mutex stateMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const Task *task;
+	size_t taskCount;
+	unsigned int taskChunks;
+	unsigned long generation;
+	unsigned int pending;
+	bool stopping;
+};
+
+#endif /* THREAD_POOL_H_ */
@@ -0,0 +1,281 @@
+/*
+ * tiled_map.cpp
+ *
+ * Binary, spatially tiled landmark map which is memory-mapped instead of parsed.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tiled_map.h"
+#include "helper_functions.h"
+
+using namespace std;
+
+static const uint32_t kTiledMapVersion = 1;
+
+static_assert(sizeof(MapLandmark) == 12, "the tiled map format stores MapLandmark records as they are");
+
+TiledMap::TiledMap() : data(nullptr), dataSize(0), header(nullptr), tileStart(nullptr), landmarks(nullptr),
+    activeMinCol(0), activeMinRow(0), activeMaxCol(-1), activeMaxRow(-1), cacheSize(64)
+{
+}
+
+TiledMap::~TiledMap()
+{
+    close();
+}
+
+bool TiledMap::convert(const std::string &textFile, const std::string &tiledFile, double tileSize)
+{
+    Map map;
+    if(tileSize <= 0.0 || !read_map_data(textFile, map))
+    {
+        return false;
+    }
+    const vector<MapLandmark> &list = map.landmark_list;
+
+    TiledMapHeader head;
+    memcpy(head.magic, "PFTM", 4);
+    head.version = kTiledMapVersion;
+    head.tile_size = tileSize;
+    head.landmark_count = list.size();
+    head.origin_x = head.origin_y = 0.0;
+    head.cols = head.rows = 1;
+
+    if(!list.empty())
+    {
+        double minX = list[0].x_f, maxX = minX, minY = list[0].y_f, maxY = minY;
+        for(const auto &landmark: list)
+        {
+            minX = min<double>(minX, landmark.x_f);
+            maxX = max<double>(maxX, landmark.x_f);
+            minY = min<double>(minY, landmark.y_f);
+            maxY = max<double>(maxY, landmark.y_f);
+        }
+        head.origin_x = minX;
+        head.origin_y = minY;
+        head.cols = uint32_t((maxX - minX) / tileSize) + 1;
+        head.rows = uint32_t((maxY - minY) / tileSize) + 1;
+    }
+
+    // counting sort of the landmarks by tile
+    const size_t tileCount = size_t(head.cols) * head.rows;
+    vector<uint64_t> starts(tileCount + 1, 0);
+    vector<uint32_t> tileOf(list.size());
+    for(size_t i = 0; i < list.size(); ++i)
+    {
+        const uint32_t col = min(head.cols - 1, uint32_t((list[i].x_f - head.origin_x) / tileSize));
+        const uint32_t row = min(head.rows - 1, uint32_t((list[i].y_f - head.origin_y) / tileSize));
+        tileOf[i] = row * head.cols + col;
+        ++starts[tileOf[i] + 1];
+    }
+    for(size_t tile = 0; tile < tileCount; ++tile)
+    {
+        starts[tile + 1] += starts[tile];
+    }
+    vector<MapLandmark> sorted(list.size());
+    vector<uint64_t> fill(starts.begin(), starts.end() - 1);
+    for(size_t i = 0; i < list.size(); ++i)
+    {
+        sorted[fill[tileOf[i]]++] = list[i];
+    }
+
+    ofstream out(tiledFile.c_str(), ios::binary | ios::trunc);
+    if(!out)
+    {
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(&head), sizeof(head));
+    out.write(reinterpret_cast<const char *>(starts.data()), starts.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char *>(sorted.data()), sorted.size() * sizeof(MapLandmark));
+    return bool(out);
+}
+
+bool TiledMap::open(const std::string &path)
+{
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(TiledMapHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // validate the header and that the file holds everything it announces, the counts are bounded by the
+    // file size first so the expected size cannot overflow
+    const TiledMapHeader *head = static_cast<const TiledMapHeader *>(mapping);
+    const size_t fileSize = size_t(info.st_size);
+    const size_t tileCount = size_t(head->cols) * head->rows;
+    bool valid = memcmp(head->magic, "PFTM", 4) == 0 && head->version == kTiledMapVersion
+                 && head->tile_size > 0.0 && tileCount > 0 && tileCount < fileSize / sizeof(uint64_t)
+                 && head->landmark_count <= fileSize / sizeof(MapLandmark)
+                 && fileSize == sizeof(TiledMapHeader) + (tileCount + 1) * sizeof(uint64_t)
+                                + head->landmark_count * sizeof(MapLandmark);
+
+    // the tiles must partition the landmarks, refresh and advise index the landmarks with these offsets
+    const uint64_t *starts = reinterpret_cast<const uint64_t *>(static_cast<const char *>(mapping)
+                                                                + sizeof(TiledMapHeader));
+    if(valid)
+    {
+        valid = starts[0] == 0 && starts[tileCount] == head->landmark_count;
+        for(size_t tile = 0; valid && tile < tileCount; ++tile)
+        {
+            valid = starts[tile] <= starts[tile + 1];
+        }
+    }
+    if(!valid)
+    {
+        munmap(mapping, fileSize);
+        return false;
+    }
+
+    data = mapping;
+    dataSize = fileSize;
+    header = head;
+    tileStart = starts;
+    landmarks = reinterpret_cast<const MapLandmark *>(tileStart + tileCount + 1);
+
+    // the landmarks are read in small, scattered pieces, read ahead would only waste memory
+    madvise(data, dataSize, MADV_RANDOM);
+    return true;
+}
+
+void TiledMap::close()
+{
+    if(data)
+    {
+        munmap(data, dataSize);
+    }
+    data = nullptr;
+    dataSize = 0;
+    header = nullptr;
+    tileStart = nullptr;
+    landmarks = nullptr;
+    activeMinCol = activeMinRow = 0;
+    activeMaxCol = activeMaxRow = -1;
+    active.landmark_list.clear();
+    active.buildIndex();
+    lru.clear();
+    lruPosition.clear();
+}
+
+size_t TiledMap::landmarkCount() const
+{
+    return header ? size_t(header->landmark_count) : 0;
+}
+
+int TiledMap::tileCol(double x) const
+{
+    const double col = floor((x - header->origin_x) / header->tile_size);
+    return int(max(0.0, min(double(header->cols - 1), col)));
+}
+
+int TiledMap::tileRow(double y) const
+{
+    const double row = floor((y - header->origin_y) / header->tile_size);
+    return int(max(0.0, min(double(header->rows - 1), row)));
+}
+
+void TiledMap::advise(uint32_t tile, int advice) const
+{
+    if(tileStart[tile] == tileStart[tile + 1])
+    {
+        return;
+    }
+
+    // madvise works on whole pages, the neighbouring tiles sharing the outer pages are read only and just
+    // fault them in again if needed
+    const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    const char *base = static_cast<const char *>(data);
+    const size_t begin = reinterpret_cast<const char *>(landmarks + tileStart[tile]) - base;
+    const size_t end = reinterpret_cast<const char *>(landmarks + tileStart[tile + 1]) - base;
+    const size_t alignedBegin = begin / page * page;
+    const size_t alignedEnd = min(dataSize, (end + page - 1) / page * page);
+    madvise(const_cast<char *>(base) + alignedBegin, alignedEnd - alignedBegin, advice);
+}
+
+void TiledMap::touch(uint32_t tile)
+{
+    const auto found = lruPosition.find(tile);
+    if(found != lruPosition.end())
+    {
+        lru.splice(lru.begin(), lru, found->second);
+        return;
+    }
+
+    advise(tile, MADV_WILLNEED);
+    lru.push_front(tile);
+    lruPosition[tile] = lru.begin();
+}
+
+void TiledMap::evict()
+{
+    while(lru.size() > cacheSize)
+    {
+        const uint32_t tile = lru.back();
+        const int col = int(tile % header->cols), row = int(tile / header->cols);
+        if(col >= activeMinCol && col <= activeMaxCol && row >= activeMinRow && row <= activeMaxRow)
+        {
+            // the active tiles are the most recent ones, so all remaining tiles are active
+            break;
+        }
+        advise(tile, MADV_DONTNEED);
+        lruPosition.erase(tile);
+        lru.pop_back();
+    }
+}
+
+const Map &TiledMap::activate(double minX, double minY, double maxX, double maxY)
+{
+    if(!header)
+    {
+        return active;
+    }
+
+    const int minCol = tileCol(minX), maxCol = tileCol(maxX);
+    const int minRow = tileRow(minY), maxRow = tileRow(maxY);
+    if(minCol >= activeMinCol && maxCol <= activeMaxCol && minRow >= activeMinRow && maxRow <= activeMaxRow)
+    {
+        return active;
+    }
+
+    // grow the range by one tile so small movements do not rebuild the active map
+    activeMinCol = max(0, minCol - 1);
+    activeMinRow = max(0, minRow - 1);
+    activeMaxCol = min(int(header->cols) - 1, maxCol + 1);
+    activeMaxRow = min(int(header->rows) - 1, maxRow + 1);
+
+    active.landmark_list.clear();
+    for(int row = activeMinRow; row <= activeMaxRow; ++row)
+    {
+        for(int col = activeMinCol; col <= activeMaxCol; ++col)
+        {
+            const uint32_t tile = uint32_t(row) * header->cols + uint32_t(col);
+            touch(tile);
+            active.landmark_list.insert(active.landmark_list.end(),
+                                        landmarks + tileStart[tile], landmarks + tileStart[tile + 1]);
+        }
+    }
+    active.buildIndex();
+    evict();
+    return active;
+}
@@ -0,0 +1,120 @@
+/*
+ * tiled_map.h
+ *
+ * Binary, spatially tiled landmark map which is memory-mapped instead of parsed.
+ */
+
+#ifndef TILED_MAP_H_
+#define TILED_MAP_H_
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "map.h"
+
+/*
+ * A landmark map stored as a grid of square tiles. The file holds a header, the CSR start offsets of all tiles
+ * and the landmarks (the MapLandmark records) sorted by tile, so opening it is a single mmap and the pages of
+ * a tile are only read when it is used. The filter works on an active Map which holds the landmarks of the
+ * tiles around the particle cloud; the tiles used recently are kept in an LRU list and the pages of tiles
+ * that drop out of it are handed back to the OS.
+ *
+ * File layout (native byte order):
+ *   header        TiledMapHeader
+ *   tile starts   uint64_t[cols * rows + 1], landmark index of the first landmark of every tile (row major)
+ *   landmarks     MapLandmark[landmark_count]
+ */
+class TiledMap {
+
+public:
+
+	TiledMap();
+	~TiledMap();
+
+	//! Converts a text map (see read_map_data) into the tiled format
+	//! \param textFile Path of the text map
+	//! \param tiledFile Path of the binary map to write
+	//! \param tileSize Edge length of a tile [m]
+	//! \return False if a file could not be read or written
+	static bool convert(const std::string &textFile, const std::string &tiledFile, double tileSize = 100.0);
+
+	//! Maps a tiled map file into memory, the landmarks are only read on demand
+	//! \return False if the file could not be opened or is no valid tiled map
+	bool open(const std::string &path);
+
+	//! Unmaps the file and clears the active map
+	void close();
+
+	//! Returns whether a map is open
+	bool isOpen() const { return data != nullptr; }
+
+	//! Returns the total number of landmarks of the map
+	size_t landmarkCount() const;
+
+	//! Sets how many tiles the LRU list keeps resident, 64 by default. The tiles of the active map are always
+	//! kept.
+	void setCacheSize(size_t tiles) { cacheSize = tiles; }
+
+	//! Makes sure the active map contains all landmarks within the given box and returns it. The active map
+	//! covers one tile more than necessary in every direction, so it is only rebuilt once the box moves into
+	//! a tile it does not cover yet.
+	//! \param minX, minY, maxX, maxY Area the filter needs the landmarks of [m], usually the bounding box of
+	//!   the particle cloud grown by the sensor range
+	const Map &activate(double minX, double minY, double maxX, double maxY);
+
+	//! Returns the active map of the last activate call
+	const Map &activeMap() const { return active; }
+
+	//! Returns the number of tiles in the LRU list
+	size_t residentTiles() const { return lru.size(); }
+
+private:
+
+	struct TiledMapHeader {
+		char magic[4];			// "PFTM"
+		uint32_t version;
+		double origin_x;		// Lower left corner of tile (0, 0) [m]
+		double origin_y;
+		double tile_size;		// Edge length of a tile [m]
+		uint32_t cols;
+		uint32_t rows;
+		uint64_t landmark_count;
+	};
+
+	// Returns the tile column / row of a coordinate, clamped to the map
+	int tileCol(double x) const;
+	int tileRow(double y) const;
+
+	// Marks a tile as most recently used and pages it in if it was not resident
+	void touch(uint32_t tile);
+
+	// Drops the least recently used tiles beyond the cache size, except the active ones
+	void evict();
+
+	// Advises the kernel about the pages of a tile's landmarks
+	void advise(uint32_t tile, int advice) const;
+
+	// mapping of the file
+	void *data;
+	size_t dataSize;
+	const TiledMapHeader *header;
+	const uint64_t *tileStart;
+	const MapLandmark *landmarks;
+
+	// tiles of the active map (inclusive range) and the map itself
+	int activeMinCol, activeMinRow, activeMaxCol, activeMaxRow;
+	Map active;
+
+	// recently used tiles, most recent first
+	size_t cacheSize;
+	std::list<uint32_t> lru;
+	std::unordered_map<uint32_t, std::list<uint32_t>::iterator> lruPosition;
+
+	TiledMap(const TiledMap &) = delete;
+	TiledMap &operator=(const TiledMap &) = delete;
+};
+
+#endif /* TILED_MAP_H_ */
@@ -30,3 +30,7 @@ double PID::TotalError()
     return totalError;
 }
 
+double PID::Control(double cte)
+{
+    return -Kp * cte - Kd * (cte - lastError) - Ki * TotalError();
+}
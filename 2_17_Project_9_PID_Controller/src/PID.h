@@ -44,6 +44,12 @@ public:
   * Calculate the total PID error.
   */
   double TotalError();
+
+  /*
+  * Calculate the control value for the cross track error, before the
+  * errors are updated with it.
+  */
+  double Control(double cte);
 };
 
 #endif /* PID_H */
@@ -0,0 +1,136 @@
+#include "PIDBank.h"
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+PIDBank::PIDBank() : scalarReference(false) {}
+
+PIDBank::~PIDBank() {}
+
+size_t PIDBank::Add(double Kp, double Ki, double Kd)
+{
+    const double infinity = numeric_limits<double>::infinity();
+    this->Kp.push_back(Kp);
+    this->Ki.push_back(Ki);
+    this->Kd.push_back(Kd);
+    this->lastError.push_back(0.0);
+    this->totalError.push_back(0.0);
+    this->minOutput.push_back(-infinity);
+    this->maxOutput.push_back(infinity);
+    this->maxTotalError.push_back(infinity);
+    return Size() - 1;
+}
+
+size_t PIDBank::Size() const
+{
+    return Kp.size();
+}
+
+void PIDBank::Init(size_t i, double Kp, double Ki, double Kd)
+{
+    this->Kp[i] = Kp;
+    this->Ki[i] = Ki;
+    this->Kd[i] = Kd;
+    this->lastError[i] = 0.0;
+    this->totalError[i] = 0.0;
+}
+
+void PIDBank::SetOutputLimits(size_t i, double minOutput, double maxOutput)
+{
+    this->minOutput[i] = minOutput;
+    this->maxOutput[i] = maxOutput;
+}
+
+void PIDBank::SetIntegralLimit(size_t i, double maxTotalError)
+{
+    this->maxTotalError[i] = maxTotalError;
+}
+
+void PIDBank::SetScalarReference(bool enabled)
+{
+    scalarReference = enabled;
+}
+
+double PIDBank::LastError(size_t i) const
+{
+    return lastError[i];
+}
+
+double PIDBank::TotalError(size_t i) const
+{
+    return totalError[i];
+}
+
+void PIDBank::UpdateScalar(size_t begin, size_t end, const double *cte,
+                           double *output)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        // PID::Control
+        const double raw = -Kp[i] * cte[i] - Kd[i] * (cte[i] - lastError[i]) - Ki[i] * totalError[i];
+        double clamped = raw < minOutput[i] ? minOutput[i] : raw;
+        clamped = clamped > maxOutput[i] ? maxOutput[i] : clamped;
+        output[i] = clamped;
+
+        // PID::UpdateError, unless the integral part of cte drives the output
+        // further into its limit
+        const double integral = -Ki[i] * cte[i];
+        const bool windup = (raw > maxOutput[i] && integral > 0) || (raw < minOutput[i] && integral < 0);
+        double total = windup ? totalError[i] : totalError[i] + cte[i];
+        total = total < -maxTotalError[i] ? -maxTotalError[i] : total;
+        total = total > maxTotalError[i] ? maxTotalError[i] : total;
+        totalError[i] = total;
+        lastError[i] = cte[i];
+    }
+}
+
+void PIDBank::Update(const double *cte, double *output)
+{
+    const size_t count = Size();
+    size_t i = 0;
+#ifdef __SSE2__
+    if (!scalarReference)
+    {
+        // Same operations as UpdateScalar on two controllers at once. The
+        // negation flips the sign bit like the unary minus, and max(a, b) /
+        // min(a, b) return b unless a > b / a < b, so the clamps treat NaN
+        // like the comparisons of UpdateScalar.
+        const __m128d sign = _mm_set1_pd(-0.0);
+        const __m128d zero = _mm_setzero_pd();
+        for (; i + 2 <= count; i += 2)
+        {
+            const __m128d c = _mm_loadu_pd(cte + i);
+            const __m128d kp = _mm_loadu_pd(&Kp[i]);
+            const __m128d ki = _mm_loadu_pd(&Ki[i]);
+            const __m128d kd = _mm_loadu_pd(&Kd[i]);
+            const __m128d last = _mm_loadu_pd(&lastError[i]);
+            const __m128d total = _mm_loadu_pd(&totalError[i]);
+            const __m128d lo = _mm_loadu_pd(&minOutput[i]);
+            const __m128d hi = _mm_loadu_pd(&maxOutput[i]);
+            const __m128d limit = _mm_loadu_pd(&maxTotalError[i]);
+
+            __m128d raw = _mm_mul_pd(_mm_xor_pd(kp, sign), c);
+            raw = _mm_sub_pd(raw, _mm_mul_pd(kd, _mm_sub_pd(c, last)));
+            raw = _mm_sub_pd(raw, _mm_mul_pd(ki, total));
+            const __m128d clamped = _mm_min_pd(hi, _mm_max_pd(lo, raw));
+            _mm_storeu_pd(output + i, clamped);
+
+            const __m128d integral = _mm_mul_pd(_mm_xor_pd(ki, sign), c);
+            const __m128d windup = _mm_or_pd(
+                _mm_and_pd(_mm_cmpgt_pd(raw, hi), _mm_cmpgt_pd(integral, zero)),
+                _mm_and_pd(_mm_cmplt_pd(raw, lo), _mm_cmplt_pd(integral, zero)));
+            __m128d updated = _mm_or_pd(_mm_and_pd(windup, total),
+                                        _mm_andnot_pd(windup, _mm_add_pd(total, c)));
+            updated = _mm_max_pd(_mm_xor_pd(limit, sign), updated);
+            updated = _mm_min_pd(limit, updated);
+            _mm_storeu_pd(&totalError[i], updated);
+            _mm_storeu_pd(&lastError[i], c);
+        }
+    }
+#endif
+    // the rest, all controllers in the scalar reference mode
+    UpdateScalar(i, count, cte, output);
+}
@@ -0,0 +1,101 @@
+#ifndef PID_BANK_H
+#define PID_BANK_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+* Bank of PID controllers which are all stepped at once, e.g. the steering
+* and speed controllers of a simulated fleet.
+*
+* The coefficients and errors are stored as arrays over the controllers
+* (structure of arrays), so Update evaluates PID::Control and
+* PID::UpdateError for two controllers per SSE2 instruction. The operations
+* are the same as the ones of PID in the same order, so without limits every
+* controller computes bit-for-bit the output of a PID with its coefficients.
+* The scalar reference mode evaluates the controllers one after the other
+* with the expressions of PID instead.
+*/
+class PIDBank {
+public:
+  /*
+  * Constructor
+  */
+  PIDBank();
+
+  /*
+  * Destructor.
+  */
+  virtual ~PIDBank();
+
+  /*
+  * Add a controller, initialized like PID::Init. Returns its index. Its
+  * output and total error are not limited.
+  */
+  size_t Add(double Kp, double Ki, double Kd);
+
+  /*
+  * Number of controllers.
+  */
+  size_t Size() const;
+
+  /*
+  * Initialize controller i like PID::Init, the limits are kept.
+  */
+  void Init(size_t i, double Kp, double Ki, double Kd);
+
+  /*
+  * Clamp the output of controller i to [minOutput, maxOutput].
+  */
+  void SetOutputLimits(size_t i, double minOutput, double maxOutput);
+
+  /*
+  * Integral anti-windup of controller i: the total error is kept within
+  * [-maxTotalError, maxTotalError], and it is not updated while the output
+  * is clamped and the integral part of the error would drive it further
+  * into the limit.
+  */
+  void SetIntegralLimit(size_t i, double maxTotalError);
+
+  /*
+  * Evaluate the controllers one after the other with scalar code (off by
+  * default).
+  */
+  void SetScalarReference(bool enabled);
+
+  /*
+  * Calculate the outputs of all controllers for their cross track errors
+  * and update their errors, like PID::Control followed by
+  * PID::UpdateError. cte and output hold Size() values.
+  */
+  void Update(const double *cte, double *output);
+
+  /*
+  * Errors of controller i
+  */
+  double LastError(size_t i) const;
+  double TotalError(size_t i) const;
+
+private:
+  /*
+  * Update of the controllers [begin, end) with scalar code.
+  */
+  void UpdateScalar(size_t begin, size_t end, const double *cte,
+                    double *output);
+
+  /*
+  * Coefficients, errors and limits of the controllers
+  */
+  std::vector<double> Kp;
+  std::vector<double> Ki;
+  std::vector<double> Kd;
+  std::vector<double> lastError;
+  std::vector<double> totalError;
+  std::vector<double> minOutput;
+  std::vector<double> maxOutput;
+  std::vector<double> maxTotalError;
+
+  bool scalarReference;
+};
+
+#endif /* PID_BANK_H */
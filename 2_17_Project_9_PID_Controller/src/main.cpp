@@ -123,14 +123,14 @@ int main()
           */
 
           // calculate steering angle by combing proportional, derivative and integral part
-          steer_value = -pid.Kp * cte - pid.Kd*(cte-pid.lastError) - pid.Ki * pid.TotalError();
+          steer_value = pid.Control(cte);
 
           double speedCte = fabs(cte)-maxError;
           if(speed>40)
           {
             speedCte *= speed/40.0;
           }
-          double speedValue = -speedPid.Kp * speedCte - speedPid.Kd*(speedCte-speedPid.lastError) - speedPid.Ki * speedPid.TotalError();
+          double speedValue = speedPid.Control(speedCte);
 
           // UpdateError() updates the last error for the derivative part and sums the total error for the integral one.
           pid.UpdateError(cte);
@@ -0,0 +1,118 @@
+/**
+ * Steps a fleet of steering controllers with PID objects, PIDBank in the
+ * scalar reference mode and the vectorized PIDBank, and compares the time per
+ * controller step and the outputs.
+ *
+ * Usage: pid_bank_benchmark [controllers] [ticks]
+ *
+ * Every second controller has output limits and an integral limit, so the
+ * outputs of PID are compared with the ones of the unlimited controllers and
+ * both modes of PIDBank with each other for all of them.
+ * */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <math.h>
+#include <vector>
+#include "PID.h"
+#include "PIDBank.h"
+
+// Cross track error of controller i at a tick, a different sine per controller
+double CrossTrackError(size_t i, size_t tick)
+{
+  return 1.5 * sin(0.01 * tick * (1 + i % 7) + i) + 0.1 * cos(0.37 * tick + 2.0 * i);
+}
+
+// Steps the bank over all ticks, returns the time per controller step in ns
+double Run(PIDBank &bank, size_t ticks, std::vector<double> &outputs)
+{
+  const size_t count = bank.Size();
+  std::vector<double> cte(count);
+  outputs.assign(count * ticks, 0.0);
+  double seconds = 0;
+  for (size_t tick = 0; tick < ticks; ++tick)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      cte[i] = CrossTrackError(i, tick);
+    }
+    auto start = std::chrono::steady_clock::now();
+    bank.Update(cte.data(), &outputs[tick * count]);
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  return 1e9 * seconds / (count * ticks);
+}
+
+int main(int argc, char *argv[])
+{
+  const size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+  const size_t ticks = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000;
+
+  // the steering gains of main.cpp, varied per controller
+  std::vector<PID> pids(count);
+  PIDBank scalar, vectorized;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const double Kp = 0.15 * (1 + 0.01 * (i % 13));
+    const double Ki = 0.002 * (1 + 0.02 * (i % 5));
+    const double Kd = 11.0 * (1 - 0.01 * (i % 11));
+    pids[i].Init(Kp, Ki, Kd);
+    for (PIDBank *bank : {&scalar, &vectorized})
+    {
+      bank->Add(Kp, Ki, Kd);
+      if (i % 2)
+      {
+        bank->SetOutputLimits(i, -1.0, 1.0);
+        bank->SetIntegralLimit(i, 50.0);
+      }
+    }
+  }
+  scalar.SetScalarReference(true);
+
+  // PID objects the way main.cpp steps them
+  std::vector<double> cte(count);
+  std::vector<double> pidOutputs(count * ticks);
+  double seconds = 0;
+  for (size_t tick = 0; tick < ticks; ++tick)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      cte[i] = CrossTrackError(i, tick);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+      pidOutputs[tick * count + i] = pids[i].Control(cte[i]);
+      pids[i].UpdateError(cte[i]);
+    }
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  const double pidNs = 1e9 * seconds / (count * ticks);
+
+  std::vector<double> scalarOutputs, vectorizedOutputs;
+  const double scalarNs = Run(scalar, ticks, scalarOutputs);
+  const double vectorizedNs = Run(vectorized, ticks, vectorizedOutputs);
+
+  size_t pidMismatches = 0;
+  for (size_t tick = 0; tick < ticks; ++tick)
+  {
+    for (size_t i = 0; i < count; i += 2)
+    {
+      const size_t k = tick * count + i;
+      pidMismatches += memcmp(&pidOutputs[k], &scalarOutputs[k], sizeof(double)) != 0;
+      pidMismatches += memcmp(&pidOutputs[k], &vectorizedOutputs[k], sizeof(double)) != 0;
+    }
+  }
+  const bool modesMatch = memcmp(scalarOutputs.data(), vectorizedOutputs.data(),
+                                 scalarOutputs.size() * sizeof(double)) == 0;
+
+  std::cout << count << " controllers, " << ticks << " ticks" << std::endl
+            << "PID        " << pidNs << " ns per controller step" << std::endl
+            << "scalar     " << scalarNs << " ns" << std::endl
+            << "vectorized " << vectorizedNs << " ns" << std::endl
+            << "outputs of the unlimited controllers different from PID: " << pidMismatches << std::endl
+            << "scalar and vectorized outputs identical: " << (modesMatch ? "yes" : "no") << std::endl;
+  return pidMismatches == 0 && modesMatch ? 0 : 1;
+}
@@ -1,245 +1,469 @@
 #include "MPC.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <coin/IpIpoptApplication.hpp>
 #include <cppad/cppad.hpp>
 #include <cppad/ipopt/solve.hpp>
 #include "Eigen-3.3/Eigen/Core"
+#include "fg_eval.h"
+#include "mpc_nlp.h"
 
-using CppAD::AD;
-
-// TODO: Set the timestep length and duration
-size_t N = 10;
-double dt = 0.08;
-
-// This value assumes the model presented in the classroom is used.
-//
-// It was obtained by measuring the radius formed by running the vehicle in the
-// simulator around in a circle with a constant steering angle and velocity on a
-// flat terrain.
 //
-// Lf was tuned until the the radius formed by the simulating the model
-// presented in the classroom matched the previous radius.
+// MPC class definition implementation.
 //
-// This is the length from front to CoG that has a similar radius.
-const double Lf = 2.67;
-
-size_t x_start = 0;
-size_t y_start = x_start + N;
-size_t psi_start = y_start + N;
-size_t v_start = psi_start + N;
-size_t cte_start = v_start + N;
-size_t epsi_start = cte_start + N;
-size_t delta_start = epsi_start + N;
-size_t a_start = delta_start + N - 1;
+MPC::MPC(const MPCConfig &config)
+    : backend_(Backend::IPOPT),
+      derivatives_(Derivatives::TAPE),
+      warm_start_(false),
+      has_previous_(false),
+      verbose_(true),
+      sqp_max_iterations_(0),
+      sqp_tolerance_(0),
+      time_limit_ms_(0),
+      config_(config),
+      layout_(config.N) {
+  stats_ = MPCStats();
+  sqp_ = MakeSqpSolver(config_.N);
+  assert(sqp_);
+  sqp_->Init(config_);
+}
+MPC::~MPC() {}
 
-double ref_v = 70;
+void MPC::SetConfig(const MPCConfig &config) {
+  // the problem has to be set up again if its structure changed, the
+  // reference speed and the weights are parameters and the bounds are set
+  // before every Ipopt solve
+  if (config.N != config_.N || config.dt != config_.dt ||
+      config.Lf != config_.Lf) {
+    ipopt_.reset();
+  }
+  if (config.N != config_.N) {
+    sqp_ = MakeSqpSolver(config.N);
+    assert(sqp_);
+    if (sqp_max_iterations_ > 0) {
+      sqp_->SetTermination(sqp_max_iterations_, sqp_tolerance_);
+    }
+  }
+  config_ = config;
+  layout_ = config.Layout();
+  sqp_->Init(config_);
+  has_previous_ = false;
+}
 
-class FG_eval {
- public:
-  // Fitted polynomial coefficients
-  Eigen::VectorXd coeffs;
-  FG_eval(Eigen::VectorXd coeffs) { this->coeffs = coeffs; }
-
-  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
-  void operator()(ADvector& fg, const ADvector& vars) {
-    // TODO: implement MPC
-    // `fg` a vector of the cost constraints, `vars` is a vector of variable values (state & actuators)
-    // NOTE: You'll probably go back and forth between this function and
-    // the Solver function below.
-
-    fg[0] = 0;
-
-    // The part of the cost based on the reference state.
-    for (int t = 0; t < N; t++) {
-      fg[0] += CppAD::pow(vars[cte_start + t], 2);
-      fg[0] += CppAD::pow(vars[epsi_start + t], 2);
-      fg[0] += CppAD::pow(vars[v_start + t] - ref_v, 2);
+void MPC::SetIpoptOption(const std::string &name, const std::string &value) {
+  for (auto &option : ipopt_options_) {
+    if (option.first == name) {
+      option.second = value;
+      return;
     }
+  }
+  ipopt_options_.push_back(std::make_pair(name, value));
+}
+
+void MPC::SetSqpTermination(int max_iterations, double tolerance) {
+  sqp_max_iterations_ = max_iterations;
+  sqp_tolerance_ = tolerance;
+  sqp_->SetTermination(max_iterations, tolerance);
+}
+
+void MPC::SetInitialActuations(const vector<double> &actuations) {
+  initial_actuations_ = actuations;
+}
 
-    // Minimize the use of actuators.
-    for (int t = 0; t < N - 1; t++) {
-      fg[0] += CppAD::pow(vars[delta_start + t], 2);
-      fg[0] += CppAD::pow(vars[a_start + t], 2);
+void MPC::GetActuations(vector<double> &actuations) const {
+  actuations.resize(2 * (config_.N - 1));
+  for (size_t t = 0; t + 1 < config_.N; ++t) {
+    actuations[2 * t] = sqp_->delta(t);
+    actuations[2 * t + 1] = sqp_->a(t);
+  }
+}
+
+vector<double> MPC::Solve(const Eigen::VectorXd &state,
+                          const Eigen::VectorXd &coeffs) {
+  auto start = std::chrono::steady_clock::now();
+  deadline_ = start + std::chrono::microseconds(
+                          static_cast<long>(time_limit_ms_ * 1000));
+
+  // The previous solution is one control cycle old, so its actuations are
+  // advanced by one step and the last one is held for the new tail step.
+  // The states are not shifted but simulated from the new initial state,
+  // the previous ones are in the vehicle frame of the previous cycle.
+  // An initial guess of the caller replaces both, the multipliers of the
+  // previous solution do not belong to it.
+  const bool seeded = initial_actuations_.size() == 2 * (config_.N - 1);
+  stats_.warm_started = warm_start_ && has_previous_ && !seeded;
+  if (seeded) {
+    for (size_t t = 0; t + 1 < config_.N; ++t) {
+      sqp_->SetActuation(t, initial_actuations_[2 * t],
+                         initial_actuations_[2 * t + 1]);
     }
+  } else if (stats_.warm_started) {
+    sqp_->ShiftActuations();
+  } else {
+    sqp_->ResetActuations();
+  }
+  initial_actuations_.clear();
+
+  vector<double> result = backend_ == Backend::SQP
+                              ? SolveSqp(state, coeffs)
+                              : SolveIpopt(state, coeffs);
+  has_previous_ = true;
+
+  stats_.solve_time_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  if (verbose_) {
+    std::cout << "Cost " << stats_.cost << std::endl;
+    std::cout << "Solve " << stats_.solve_time_ms << " ms, "
+              << stats_.iterations << " iterations"
+              << (stats_.warm_started ? " (warm start)" : "") << std::endl;
+  }
+  return result;
+}
 
-    // Minimize the value gap between sequential actuations.
-    for (int t = 0; t < N - 2; t++) {
-      fg[0] += CppAD::pow(vars[delta_start + t + 1] - vars[delta_start + t], 2);
-      fg[0] += CppAD::pow(vars[a_start + t + 1] - vars[a_start + t], 2);
+vector<double> MPC::SolveSqp(const Eigen::VectorXd &state,
+                             const Eigen::VectorXd &coeffs) {
+  sqp_->SetDeadline(time_limit_ms_ > 0
+                        ? deadline_
+                        : std::chrono::steady_clock::time_point::max());
+  stats_.success = sqp_->Solve(state, coeffs);
+  stats_.iterations = sqp_->iterations();
+  stats_.time_limited = sqp_->timed_out();
+  stats_.status = stats_.success        ? "Converged"
+                  : stats_.time_limited ? "Time_Limit"
+                                        : "Iteration_Limit";
+  stats_.cost = sqp_->cost();
+
+  vector<double> result;
+  result.push_back(sqp_->delta(0));
+  result.push_back(sqp_->a(0));
+  for (size_t i = 0; i < config_.N; ++i) {
+    result.push_back(sqp_->state(i)[0]);
+    result.push_back(sqp_->state(i)[1]);
+  }
+  return result;
+}
+
+// Advances the per time step values of every block of the variable layout by
+// one step and holds the last one. The constraints have the layout of the
+// state blocks, so their multipliers are shifted the same way.
+static void ShiftSteps(const MPCLayout &layout, vector<double> &values) {
+  const size_t starts[] = {layout.x_start,     layout.y_start,
+                           layout.psi_start,   layout.v_start,
+                           layout.cte_start,   layout.epsi_start,
+                           layout.delta_start, layout.a_start};
+  for (size_t b = 0; b < 8; b++) {
+    const size_t length = b < 6 ? layout.N : layout.N - 1;
+    if (starts[b] + length > values.size()) {
+      break;
+    }
+    for (size_t t = 0; t + 1 < length; t++) {
+      values[starts[b] + t] = values[starts[b] + t + 1];
     }
+  }
+}
 
-    //
-    // Setup Constraints
-    //
-    // NOTE: In this section you'll setup the model constraints.
-
-    // Initial constraints
-    //
-    // We add 1 to each of the starting indices due to cost being located at
-    // index 0 of `fg`.
-    // This bumps up the position of all the other values.
-    fg[1 + x_start] = vars[x_start];
-    fg[1 + y_start] = vars[y_start];
-    fg[1 + psi_start] = vars[psi_start];
-    fg[1 + v_start] = vars[v_start];
-    fg[1 + cte_start] = vars[cte_start];
-    fg[1 + epsi_start] = vars[epsi_start];
-
-    // The rest of the constraints
-    for (size_t t = 1; t < N; ++t) {
-      // The state at time t+1
-      AD<double> x1 = vars[x_start + t];
-      AD<double> y1 = vars[y_start + t];
-      AD<double> psi1 = vars[psi_start + t];
-      AD<double> v1 = vars[v_start + t];
-      AD<double> cte1 = vars[cte_start + t];
-      AD<double> epsi1 = vars[epsi_start + t];
-
-      // The state at time t
-      AD<double> x0 = vars[x_start + t - 1];
-      AD<double> y0 = vars[y_start + t - 1];
-      AD<double> psi0 = vars[psi_start + t - 1];
-      AD<double> v0 = vars[v_start + t - 1];
-      AD<double> cte0 = vars[cte_start + t - 1];
-      AD<double> epsi0 = vars[epsi_start + t - 1];
-
-      // Only consider the actuation at time t
-      AD<double> delta0 = vars[delta_start + t - 1];
-      AD<double> a0 = vars[a_start + t - 1];
-
-      AD<double> f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * CppAD::pow(x0, 2) + coeffs[3] * CppAD::pow(x0, 3);
-      AD<double> psides0 = CppAD::atan(coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * CppAD::pow(x0, 2));
-
-      fg[1 + x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
-
-      fg[1 + y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
-
-      fg[1 + psi_start + t] = psi1 - (psi0 - v0 * delta0 / Lf * dt);
-
-      fg[1 + v_start + t] = v1 - (v0 + a0 * dt);
-
-      fg[1 + cte_start + t] = cte1 - (f0 - y0) + (v0 * CppAD::sin(epsi0) * dt);
-
-      fg[1 + epsi_start + t] = epsi1 - (psi0 - psides0 - v0 * delta0 / Lf * dt);
-    }     
+// Name of an Ipopt return status
+static std::string StatusName(Ipopt::ApplicationReturnStatus status) {
+  switch (status) {
+    case Ipopt::Solve_Succeeded:
+      return "Solve_Succeeded";
+    case Ipopt::Solved_To_Acceptable_Level:
+      return "Solved_To_Acceptable_Level";
+    case Ipopt::Infeasible_Problem_Detected:
+      return "Infeasible_Problem_Detected";
+    case Ipopt::Search_Direction_Becomes_Too_Small:
+      return "Search_Direction_Becomes_Too_Small";
+    case Ipopt::Diverging_Iterates:
+      return "Diverging_Iterates";
+    case Ipopt::Restoration_Failed:
+      return "Restoration_Failed";
+    case Ipopt::Maximum_Iterations_Exceeded:
+      return "Maximum_Iterations_Exceeded";
+    case Ipopt::Maximum_CpuTime_Exceeded:
+      return "Maximum_CpuTime_Exceeded";
+    case Ipopt::User_Requested_Stop:
+      return "Time_Limit";
+    default:
+      return "Status_" + std::to_string(static_cast<int>(status));
   }
-};
+}
 
-//
-// MPC class definition implementation.
-//
-MPC::MPC() {}
-MPC::~MPC() {}
+// Sets an option given as text with the type Ipopt registered it with
+static void SetOption(Ipopt::OptionsList &options, const std::string &name,
+                      const std::string &value) {
+  char *end = nullptr;
+  const long integer = strtol(value.c_str(), &end, 10);
+  if (!value.empty() && *end == '\0' &&
+      options.SetIntegerValue(name, static_cast<Ipopt::Index>(integer))) {
+    return;
+  }
+  const double number = strtod(value.c_str(), &end);
+  if (!value.empty() && *end == '\0' && options.SetNumericValue(name, number)) {
+    return;
+  }
+  if (!options.SetStringValue(name, value)) {
+    std::cerr << "Invalid Ipopt option " << name << " = " << value
+              << std::endl;
+  }
+}
 
-vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
-  bool ok = true;
-  size_t i;
-  typedef CPPAD_TESTVECTOR(double) Dvector;
+// The Ipopt application and the problem are created on the first Ipopt
+// solve. The derivative kernels of FG_eval, their sparsity patterns and all
+// bounds except the ones of the initial state stay the same for all later
+// solves.
+struct MPC::IpoptState {
+  std::unique_ptr<FgKernels> fg;
+  Ipopt::SmartPtr<MpcNlp> nlp;
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app;
+  bool has_multipliers;  // Whether the nlp holds the multipliers of a solve
+};
 
-  double x = state[0];
-  double y = state[1];
-  double psi = state[2];
-  double v = state[3];
-  double cte = state[4];
-  double epsi = state[5];  
+void MPC::InitIpopt() {
+  ipopt_.reset(new IpoptState());
 
   // TODO: Set the number of model variables (includes both states and inputs).
   // For example: If the state is a 4 element vector, the actuators is a 2
   // element vector and there are 10 timesteps. The number of variables is:
   //
   // 4 * 10 + 2 * 9
-  size_t n_vars = N * 6 + (N - 1) * 2;
+  size_t n_vars = layout_.n_vars;
   // TODO: Set the number of constraints
-  size_t n_constraints = N * 6;
-
-  // Initial value of the independent variables.
-  // SHOULD BE 0 besides initial state.
-  Dvector vars(n_vars);
-  for (int i = 0; i < n_vars; i++) {
-    vars[i] = 0;
+  size_t n_constraints = layout_.n_constraints;
+
+  // The generated kernels are only available for the horizons, time step and
+  // Lf they were generated for (see CMakeLists.txt), otherwise FG_eval is
+  // taped by CppAD.
+  const GeneratedKernel *kernel =
+      derivatives_ == Derivatives::GENERATED
+          ? FindGeneratedKernel(config_.N, config_.dt, config_.Lf)
+          : nullptr;
+  if (kernel) {
+    ipopt_->fg.reset(new GeneratedFg(*kernel));
+  } else {
+    if (derivatives_ == Derivatives::GENERATED) {
+      std::cout << "No generated kernels for N = " << config_.N
+                << ", dt = " << config_.dt << ", using the CppAD tape"
+                << std::endl;
+    }
+    TapedFg *taped = new TapedFg();
+    ipopt_->fg.reset(taped);
+    const MPCConfig config = config_;
+    taped->Record(n_vars, n_constraints,
+                  vector<double>(MPCConfig::kParameters, 0.0),
+                  [config](TapedFg::ADvector &fg, const TapedFg::ADvector &vars,
+                           const TapedFg::ADvector &params) {
+                    FG_eval<TapedFg::ADvector> fg_eval(config, params);
+                    fg_eval(fg, vars);
+                  });
   }
-
-  Dvector vars_lowerbound(n_vars);
-  Dvector vars_upperbound(n_vars);
+  MpcNlp *nlp = new MpcNlp(*ipopt_->fg);
+  ipopt_->nlp = nlp;
+  ipopt_->has_multipliers = false;
+
+  vector<double> &vars_lowerbound = nlp->x_l;
+  vector<double> &vars_upperbound = nlp->x_u;
+  vars_lowerbound.resize(n_vars);
+  vars_upperbound.resize(n_vars);
   // TODO: Set lower and upper limits for variables.
   // Set all non-actuators upper and lowerlimits
-  // to the max negative and positive values.
-  for (int i = 0; i < delta_start; i++) {
+  // to the max negative and positive values. The actuator limits are set
+  // by every solve.
+  for (size_t i = 0; i < layout_.delta_start; i++) {
     vars_lowerbound[i] = -1.0e19;
     vars_upperbound[i] = 1.0e19;
   }
 
+  // Lower and upper limits for the constraints
+  // Should be 0 besides initial state, which is set by every solve.
+  nlp->g_l.assign(n_constraints, 0);
+  nlp->g_u.assign(n_constraints, 0);
+
+  //
+  // options for IPOPT solver
+  //
+  ipopt_->app = IpoptApplicationFactory();
+  Ipopt::SmartPtr<Ipopt::OptionsList> options = ipopt_->app->Options();
+  // Uncomment this if you'd like more print information
+  options->SetIntegerValue("print_level", 0);
+  options->SetStringValue("sb", "yes");
+  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
+  // Change this as you see fit.
+  options->SetNumericValue("max_cpu_time", 0.5);
+  ipopt_->app->Initialize();
+}
+
+double MPC::InitialGuess(const Eigen::VectorXd &state,
+                         const Eigen::VectorXd &coeffs, vector<double> &vars) {
+  // Without a warm start the actuations are 0, in any case the states are
+  // the ones the actuations lead to, so the initial guess is feasible.
+  sqp_->Simulate(state, coeffs);
+  vars.resize(layout_.n_vars);
+  for (size_t t = 0; t < layout_.N; t++) {
+    const double *z = sqp_->state(t);
+    vars[layout_.x_start + t] = z[0];
+    vars[layout_.y_start + t] = z[1];
+    vars[layout_.psi_start + t] = z[2];
+    vars[layout_.v_start + t] = z[3];
+    vars[layout_.cte_start + t] = z[4];
+    vars[layout_.epsi_start + t] = z[5];
+  }
+  for (size_t t = 0; t + 1 < layout_.N; t++) {
+    vars[layout_.delta_start + t] = sqp_->delta(t);
+    vars[layout_.a_start + t] = sqp_->a(t);
+  }
+  return sqp_->cost();
+}
+
+vector<double> MPC::SolveIpopt(const Eigen::VectorXd &state,
+                               const Eigen::VectorXd &coeffs) {
+  if (derivatives_ == Derivatives::RETAPE) {
+    return SolveRetaped(state, coeffs);
+  }
+  if (!ipopt_) {
+    InitIpopt();
+  }
+  MpcNlp &nlp = *ipopt_->nlp;
+
+  // only the parameters and the bounds of the initial state and of the
+  // actuators change
+  vector<double> params(MPCConfig::kParameters);
+  config_.Parameters(coeffs.data(), params);
+  ipopt_->fg->SetParameters(params);
+
+  const size_t starts[] = {layout_.x_start,   layout_.y_start,
+                           layout_.psi_start, layout_.v_start,
+                           layout_.cte_start, layout_.epsi_start};
+  for (int i = 0; i < 6; i++) {
+    nlp.g_l[starts[i]] = state[i];
+    nlp.g_u[starts[i]] = state[i];
+  }
+
   // The upper and lower limits of delta are set to -25 and 25
   // degrees (values in radians).
-  // NOTE: Feel free to change this to something else.
-  for (int i = delta_start; i < a_start; i++) {
-    vars_lowerbound[i] = -0.436332;
-    vars_upperbound[i] = 0.436332;
+  for (size_t i = layout_.delta_start; i < layout_.a_start; i++) {
+    nlp.x_l[i] = -config_.max_delta;
+    nlp.x_u[i] = config_.max_delta;
   }
 
   // Acceleration/decceleration upper and lower limits.
-  // NOTE: Feel free to change this to something else.
-  for (int i = a_start; i < n_vars; i++) {
-    vars_lowerbound[i] = -1.0;
-    vars_upperbound[i] = 1.0;
+  for (size_t i = layout_.a_start; i < layout_.n_vars; i++) {
+    nlp.x_l[i] = -config_.max_a;
+    nlp.x_u[i] = config_.max_a;
   }
 
-  // Lower and upper limits for the constraints
-  // Should be 0 besides initial state.
-  Dvector constraints_lowerbound(n_constraints);
-  Dvector constraints_upperbound(n_constraints);
-  for (int i = 0; i < n_constraints; i++) {
-    constraints_lowerbound[i] = 0;
-    constraints_upperbound[i] = 0;
+  // Initial value of the independent variables.
+  vector<double> &vars = nlp.x_start;
+  const double initial_cost = InitialGuess(state, coeffs, vars);
+
+  // A warm start also reuses the shifted multipliers of the previous solve
+  // and keeps the starting point close to the previous solution instead of
+  // pushing it far into the interior of the actuator bounds.
+  Ipopt::SmartPtr<Ipopt::OptionsList> options = ipopt_->app->Options();
+  const bool warm = stats_.warm_started && ipopt_->has_multipliers;
+  if (warm) {
+    nlp.z_l_start = nlp.z_l;
+    nlp.z_u_start = nlp.z_u;
+    nlp.lambda_start = nlp.lambda;
+    ShiftSteps(layout_, nlp.z_l_start);
+    ShiftSteps(layout_, nlp.z_u_start);
+    ShiftSteps(layout_, nlp.lambda_start);
+  }
+  options->SetStringValue("warm_start_init_point", warm ? "yes" : "no");
+  options->SetNumericValue("warm_start_bound_push", 1e-6);
+  options->SetNumericValue("warm_start_bound_frac", 1e-6);
+  options->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+  options->SetNumericValue("mu_init", warm ? 1e-3 : 0.1);
+  nlp.deadline = time_limit_ms_ > 0
+                     ? deadline_
+                     : std::chrono::steady_clock::time_point::max();
+  for (const auto &option : ipopt_options_) {
+    SetOption(*options, option.first, option.second);
   }
 
-  constraints_lowerbound[x_start] = x;
-  constraints_lowerbound[y_start] = y;
-  constraints_lowerbound[psi_start] = psi;
-  constraints_lowerbound[v_start] = v;
-  constraints_lowerbound[cte_start] = cte;
-  constraints_lowerbound[epsi_start] = epsi;
-
-  constraints_upperbound[x_start] = x;
-  constraints_upperbound[y_start] = y;
-  constraints_upperbound[psi_start] = psi;
-  constraints_upperbound[v_start] = v;
-  constraints_upperbound[cte_start] = cte;
-  constraints_upperbound[epsi_start] = epsi;
-
-  // object that computes objective and constraints
-  FG_eval fg_eval(coeffs);
-
-  //
-  // NOTE: You don't have to worry about these options
-  //
-  // options for IPOPT solver
-  std::string options;
-  // Uncomment this if you'd like more print information
-  options += "Integer print_level  0\n";
-  // NOTE: Setting sparse to true allows the solver to take advantage
-  // of sparse routines, this makes the computation MUCH FASTER. If you
-  // can uncomment 1 of these and see if it makes a difference or not but
-  // if you uncomment both the computation time should go up in orders of
-  // magnitude.
-  options += "Sparse  true        forward\n";
-  options += "Sparse  true        reverse\n";
-  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
-  // Change this as you see fit.
-  options += "Numeric max_cpu_time          0.5\n";
-
-  // place to return solution
-  CppAD::ipopt::solve_result<Dvector> solution;
+  // The solution and the multipliers of the previous solve were copied into
+  // the starting point, finalize_solution fills them again. If Ipopt returns
+  // without it they stay empty, so a stale solution is not taken for this
+  // one.
+  nlp.x.clear();
+  nlp.z_l.clear();
+  nlp.z_u.clear();
+  nlp.lambda.clear();
 
   // solve the problem
-  CppAD::ipopt::solve<Dvector, FG_eval>(
-      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
-      constraints_upperbound, fg_eval, solution);
+  Ipopt::ApplicationReturnStatus status = ipopt_->app->OptimizeTNLP(ipopt_->nlp);
 
   // Check some of the solution values
-  ok &= solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+  bool ok = status == Ipopt::Solve_Succeeded;
+  if (nlp.x.size() != vars.size()) {
+    // Ipopt stopped before it had a solution
+    nlp.x = vars;
+    nlp.obj_value = 0;
+  }
+  ipopt_->has_multipliers = nlp.z_l.size() == vars.size();
 
   // Cost
-  auto cost = solution.obj_value;
-  std::cout << "Cost " << cost << std::endl;
+  auto cost = nlp.obj_value;
+
+  Ipopt::SmartPtr<Ipopt::SolveStatistics> statistics =
+      ipopt_->app->Statistics();
+  stats_.success = ok;
+  stats_.time_limited = status == Ipopt::User_Requested_Stop;
+  stats_.status = StatusName(status);
+  stats_.iterations =
+      Ipopt::IsValid(statistics) ? statistics->IterationCount() : -1;
+  stats_.cost = cost;
+
+  return IpoptResult(state, coeffs, nlp.x, ok, initial_cost);
+}
+
+vector<double> MPC::IpoptResult(const Eigen::VectorXd &state,
+                                const Eigen::VectorXd &coeffs,
+                                const vector<double> &solution_x, bool ok,
+                                double initial_cost) {
+  if (!ok) {
+    // The states of an unconverged iterate need not satisfy the dynamics.
+    // The best feasible solution so far are the actuations of the iterate
+    // (within their bounds) with the states simulated from them, or the
+    // initial guess if that is cheaper.
+    vector<double> initial;
+    GetActuations(initial);
+    for (size_t t = 0; t + 1 < layout_.N; t++) {
+      sqp_->SetActuation(
+          t,
+          max(-config_.max_delta,
+              min(config_.max_delta, solution_x[layout_.delta_start + t])),
+          max(-config_.max_a,
+              min(config_.max_a, solution_x[layout_.a_start + t])));
+    }
+    sqp_->Simulate(state, coeffs);
+    if (!(sqp_->cost() <= initial_cost)) {
+      for (size_t t = 0; t + 1 < layout_.N; t++) {
+        sqp_->SetActuation(t, initial[2 * t], initial[2 * t + 1]);
+      }
+      sqp_->Simulate(state, coeffs);
+    }
+    stats_.cost = sqp_->cost();
+
+    vector<double> result;
+    result.push_back(sqp_->delta(0));
+    result.push_back(sqp_->a(0));
+    for (size_t i = 0; i < layout_.N; ++i) {
+      result.push_back(sqp_->state(i)[0]);
+      result.push_back(sqp_->state(i)[1]);
+    }
+    return result;
+  }
+
+  // keep the actuations for the next warm start
+  for (size_t t = 0; t + 1 < layout_.N; t++) {
+    sqp_->SetActuation(t, solution_x[layout_.delta_start + t],
+                       solution_x[layout_.a_start + t]);
+  }
 
   // TODO: Return the first actuator values. The variables can be accessed with
   // `solution.x[i]`.
@@ -248,12 +472,143 @@ vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
   // creates a 2 element double vector.
 
   vector<double> result;
-  result.push_back(solution.x[delta_start]);
-  result.push_back(solution.x[a_start]);
-  for (int i = 0; i < N; ++i) {
-    result.push_back(solution.x[x_start + i]);
-    result.push_back(solution.x[y_start + i]);
+  result.push_back(solution_x[layout_.delta_start]);
+  result.push_back(solution_x[layout_.a_start]);
+  for (size_t i = 0; i < layout_.N; ++i) {
+    result.push_back(solution_x[layout_.x_start + i]);
+    result.push_back(solution_x[layout_.y_start + i]);
   }
   
   return result;
 }
+
+// FG_eval for CppAD::ipopt::solve, the parameters of the solve are constants
+// of the tape
+class RetapedFgEval {
+ public:
+  typedef CPPAD_TESTVECTOR(CppAD::AD<double>) ADvector;
+  RetapedFgEval(const MPCConfig &config, const vector<double> &params)
+      : config_(config), params_(params.size()) {
+    for (size_t i = 0; i < params.size(); i++) {
+      params_[i] = params[i];
+    }
+  }
+  void operator()(ADvector &fg, const ADvector &vars) {
+    FG_eval<ADvector> fg_eval(config_, params_);
+    fg_eval(fg, vars);
+  }
+
+ private:
+  MPCConfig config_;
+  ADvector params_;
+};
+
+// Line of an option in the options string of CppAD::ipopt::solve, the type
+// is guessed from the value like SetOption does
+static std::string RetapedOption(const std::string &name,
+                                 const std::string &value) {
+  char *end = nullptr;
+  strtol(value.c_str(), &end, 10);
+  if (!value.empty() && *end == '\0') {
+    return "Integer " + name + " " + value + "\n";
+  }
+  strtod(value.c_str(), &end);
+  if (!value.empty() && *end == '\0') {
+    return "Numeric " + name + " " + value + "\n";
+  }
+  return "String " + name + " " + value + "\n";
+}
+
+vector<double> MPC::SolveRetaped(const Eigen::VectorXd &state,
+                                 const Eigen::VectorXd &coeffs) {
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  const size_t n_vars = layout_.n_vars;
+  const size_t n_constraints = layout_.n_constraints;
+
+  vector<double> initial;
+  const double initial_cost = InitialGuess(state, coeffs, initial);
+  Dvector vars(n_vars);
+  for (size_t i = 0; i < n_vars; i++) {
+    vars[i] = initial[i];
+  }
+
+  Dvector vars_lowerbound(n_vars);
+  Dvector vars_upperbound(n_vars);
+  for (size_t i = 0; i < layout_.delta_start; i++) {
+    vars_lowerbound[i] = -1.0e19;
+    vars_upperbound[i] = 1.0e19;
+  }
+  for (size_t i = layout_.delta_start; i < layout_.a_start; i++) {
+    vars_lowerbound[i] = -config_.max_delta;
+    vars_upperbound[i] = config_.max_delta;
+  }
+  for (size_t i = layout_.a_start; i < n_vars; i++) {
+    vars_lowerbound[i] = -config_.max_a;
+    vars_upperbound[i] = config_.max_a;
+  }
+
+  Dvector constraints_lowerbound(n_constraints);
+  Dvector constraints_upperbound(n_constraints);
+  for (size_t i = 0; i < n_constraints; i++) {
+    constraints_lowerbound[i] = 0;
+    constraints_upperbound[i] = 0;
+  }
+  const size_t starts[] = {layout_.x_start,   layout_.y_start,
+                           layout_.psi_start, layout_.v_start,
+                           layout_.cte_start, layout_.epsi_start};
+  for (int i = 0; i < 6; i++) {
+    constraints_lowerbound[starts[i]] = state[i];
+    constraints_upperbound[starts[i]] = state[i];
+  }
+
+  // object that computes objective and constraints, it is taped again by
+  // every solve
+  vector<double> params(MPCConfig::kParameters);
+  config_.Parameters(coeffs.data(), params);
+  RetapedFgEval fg_eval(config_, params);
+
+  // options for IPOPT solver, the time limit is CPU time here
+  double max_cpu_time = 0.5;
+  if (time_limit_ms_ > 0) {
+    max_cpu_time = max(1e-6, std::chrono::duration<double>(
+                                 deadline_ - std::chrono::steady_clock::now())
+                                 .count());
+  }
+  std::string options;
+  options += "Integer print_level  0\n";
+  options += "Sparse  true        forward\n";
+  options += "Sparse  true        reverse\n";
+  options += "Numeric max_cpu_time " + std::to_string(max_cpu_time) + "\n";
+  for (const auto &option : ipopt_options_) {
+    options += RetapedOption(option.first, option.second);
+  }
+
+  // place to return solution
+  CppAD::ipopt::solve_result<Dvector> solution;
+
+  // solve the problem
+  CppAD::ipopt::solve<Dvector, RetapedFgEval>(
+      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+      constraints_upperbound, fg_eval, solution);
+
+  const bool ok =
+      solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+  vector<double> solution_x = initial;
+  if (solution.x.size() == n_vars) {
+    for (size_t i = 0; i < n_vars; i++) {
+      solution_x[i] = solution.x[i];
+    }
+  }
+
+  stats_.success = ok;
+  stats_.time_limited =
+      !ok && time_limit_ms_ > 0 && std::chrono::steady_clock::now() >= deadline_;
+  stats_.status = ok ? "Solve_Succeeded"
+                     : "Status_" + std::to_string(static_cast<int>(
+                                       solution.status));
+  // CppAD::ipopt::solve does not report the iterations
+  stats_.iterations = -1;
+  stats_.cost = solution.obj_value;
+
+  return IpoptResult(state, coeffs, solution_x, ok, initial_cost);
+}
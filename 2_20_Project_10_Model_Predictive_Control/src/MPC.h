@@ -1,20 +1,151 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
+#include "mpc_config.h"
+#include "sqp_solver.h"
 
 using namespace std;
 
+// Statistics of the last MPC solve
+struct MPCStats {
+  double solve_time_ms;  // Wall time of the solve including the setup
+  int iterations;        // Solver iterations, -1 if the backend does not report
+                         // them
+  bool success;          // Whether the solver converged
+  bool time_limited;     // Whether the time limit stopped the solver
+  std::string status;    // Exit status of the solver, e.g. "Solve_Succeeded"
+  double cost;           // Objective value of the returned solution
+  bool warm_started;     // Whether the solve was seeded with the previous
+                         // solution
+};
+
 class MPC {
  public:
-  MPC();
+  // Solver used for the MPC problem
+  enum class Backend {
+    IPOPT,  // General NLP solve with CppAD derivatives
+    SQP     // Condensed real-time SQP of SqpSolver
+  };
+
+  // Source of the derivatives for the Ipopt backend
+  enum class Derivatives {
+    TAPE,       // CppAD tape of FG_eval, recorded once, interpreted at runtime
+    GENERATED,  // Kernels compiled from the output of mpc_codegen
+    RETAPE      // CppAD::ipopt::solve, records the tape and its sparsity
+                // patterns on every solve like the original solver
+  };
+
+  explicit MPC(const MPCConfig &config = MPCConfig());
 
   virtual ~MPC();
 
+  // Changes the problem. A new horizon, time step or Lf sets the problem up
+  // again, every change drops the previous solution for the warm start.
+  void SetConfig(const MPCConfig &config);
+  const MPCConfig &GetConfig() const { return config_; }
+
+  // Selects the solver, Ipopt by default
+  void SetBackend(Backend backend) { backend_ = backend; }
+  Backend GetBackend() const { return backend_; }
+
+  // Selects the derivatives, the CppAD tape by default. The generated
+  // kernels fall back to the tape if there are none for the problem. Only
+  // has an effect before the first Ipopt solve.
+  void SetDerivatives(Derivatives derivatives) { derivatives_ = derivatives; }
+  Derivatives GetDerivatives() const { return derivatives_; }
+
+  // Seeds every solve with the previous solution shifted by one step (off by
+  // default). Without it the solvers start from zero actuations.
+  void SetWarmStart(bool enabled) { warm_start_ = enabled; }
+  bool GetWarmStart() const { return warm_start_; }
+
+  // Drops the previous solution, e.g. if the MPC was not solved for a while
+  void ResetWarmStart() { has_previous_ = false; }
+
+  // Initial guess of the next solve (only), the actuations
+  // [delta_0, a_0, delta_1, a_1, ...] of the N - 1 steps. It replaces the
+  // warm or cold start, a guess of another size is ignored.
+  void SetInitialActuations(const vector<double> &actuations);
+
+  // Actuations of the last solve in the same layout
+  void GetActuations(vector<double> &actuations) const;
+
+  // Sets an Ipopt option for all later Ipopt solves, it overrides the
+  // defaults of the MPC. The value is set as an integer, number or string,
+  // whichever Ipopt accepts for the option.
+  void SetIpoptOption(const std::string &name, const std::string &value);
+
+  // Sets the iteration limit and the step tolerance of the SQP solver
+  void SetSqpTermination(int max_iterations, double tolerance);
+
+  // Limits every solve to time_limit_ms, 0 (the default) for no limit. The
+  // SQP solver stops at the first iteration which would start after it,
+  // Ipopt at the first iteration which ends after it (in wall clock time,
+  // max_cpu_time counts the CPU time of all threads). The solve returns the
+  // best feasible actuations found so far in either case.
+  void SetTimeLimit(double time_limit_ms) { time_limit_ms_ = time_limit_ms; }
+
+  // Prints the time, iterations and cost of every solve (on by default)
+  void SetVerbose(bool verbose) { verbose_ = verbose; }
+
+  // Statistics of the last solve
+  const MPCStats &GetStats() const { return stats_; }
+
   // Solve the model given an initial state and polynomial coefficients.
   // Return the first actuations.
-  vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs);
+  vector<double> Solve(const Eigen::VectorXd &state,
+                       const Eigen::VectorXd &coeffs);
+
+ private:
+  void InitIpopt();
+  vector<double> SolveIpopt(const Eigen::VectorXd &state,
+                            const Eigen::VectorXd &coeffs);
+  vector<double> SolveSqp(const Eigen::VectorXd &state,
+                          const Eigen::VectorXd &coeffs);
+  vector<double> SolveRetaped(const Eigen::VectorXd &state,
+                              const Eigen::VectorXd &coeffs);
+
+  // Fills vars with the initial guess of an Ipopt solve: the actuations of
+  // sqp_ and the states simulated from them. Returns its cost.
+  double InitialGuess(const Eigen::VectorXd &state,
+                      const Eigen::VectorXd &coeffs, vector<double> &vars);
+
+  // Result of an Ipopt solve, with ok the solution, otherwise the best
+  // feasible actuations of solution_x or the initial guess. Keeps the
+  // actuations in sqp_.
+  vector<double> IpoptResult(const Eigen::VectorXd &state,
+                             const Eigen::VectorXd &coeffs,
+                             const vector<double> &solution_x, bool ok,
+                             double initial_cost);
+
+  Backend backend_;
+  Derivatives derivatives_;
+  bool warm_start_;
+  bool has_previous_;  // Whether a previous solution is available
+  bool verbose_;
+  std::vector<std::pair<std::string, std::string>> ipopt_options_;
+  int sqp_max_iterations_;
+  double sqp_tolerance_;
+  double time_limit_ms_;
+  std::chrono::steady_clock::time_point deadline_;  // Of the current solve
+  vector<double> initial_actuations_;  // Initial guess of the next solve
+  MPCStats stats_;
+  MPCConfig config_;
+  MPCLayout layout_;  // Variable layout of the horizon of config_
+
+  // Persistent Ipopt application and problem
+  struct IpoptState;
+  std::unique_ptr<IpoptState> ipopt_;
+
+  // Real-time solver, also holds the actuations of the previous solution of
+  // both backends and simulates the warm start trajectory for Ipopt
+  std::unique_ptr<SqpSolverBase> sqp_;
 };
 
 #endif /* MPC_H */
@@ -0,0 +1,195 @@
+#include "adaptive_mpc.h"
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+// Solves the decisions are based on
+const size_t kWindow = 10;
+// Longest wait for a step up after steps up which had to be taken back
+const size_t kMaxCalmCycles = 16 * kWindow;
+// Fractions of the budget for a step down and a step up
+const double kStepDown = 0.8;
+const double kStepUp = 0.4;
+// Iteration limits of the levels, the tolerance is the default of
+// SqpSolverBase
+const int kSqpMaxIterations = 10;
+const int kSqpMinIterations = 2;
+const double kSqpTolerance = 1e-4;
+const int kIpoptMaxIterations = 100;
+const int kIpoptMinIterations = 10;
+
+}  // namespace
+
+AdaptiveMpc::AdaptiveMpc(const MPC &prototype, double budget_ms,
+                         size_t min_horizon)
+    : backend_(prototype.GetBackend()),
+      warm_start_(prototype.GetWarmStart()),
+      budget_ms_(budget_ms),
+      verbose_(true),
+      level_(0),
+      last_mpc_(-1),
+      calm_cycles_(kWindow),
+      calm_(0),
+      probing_(false),
+      metrics_() {
+  const MPCConfig &nominal = prototype.GetConfig();
+  min_horizon = max<size_t>(2, min(min_horizon, nominal.N));
+  for (size_t N = nominal.N;; N -= 5) {
+    MPCConfig config = nominal;
+    config.N = N;
+    unique_ptr<MPC> mpc(new MPC(config));
+    mpc->SetBackend(backend_);
+    mpc->SetDerivatives(prototype.GetDerivatives());
+    mpc->SetWarmStart(warm_start_);
+    mpc->SetVerbose(false);
+
+    // the first solve sets Ipopt up, the second one measures the time of an
+    // iteration (on a straight reference 1 m to the side)
+    Eigen::VectorXd state = Eigen::VectorXd::Zero(6);
+    state[3] = nominal.ref_v;
+    state[4] = 1;
+    Eigen::VectorXd coeffs = Eigen::VectorXd::Zero(4);
+    coeffs[0] = 1;
+    mpc->Solve(state, coeffs);
+    mpc->ResetWarmStart();
+    mpc->Solve(state, coeffs);
+    mpc->ResetWarmStart();
+    const MPCStats &stats = mpc->GetStats();
+    iteration_ms_.push_back(stats.solve_time_ms /
+                            max(1, stats.iterations));
+    mpcs_.push_back(std::move(mpc));
+    if (N < min_horizon + 5) {
+      break;
+    }
+  }
+
+  // fewer iterations at the full horizon first, then shorter horizons
+  const bool sqp = backend_ == MPC::Backend::SQP;
+  const int max_iterations = sqp ? kSqpMaxIterations : kIpoptMaxIterations;
+  const int min_iterations = sqp ? kSqpMinIterations : kIpoptMinIterations;
+  for (int iterations = max_iterations;; iterations /= 2) {
+    iterations = max(iterations, min_iterations);
+    levels_.push_back({0, iterations});
+    if (iterations == min_iterations) {
+      break;
+    }
+  }
+  for (size_t m = 1; m < mpcs_.size(); ++m) {
+    levels_.push_back({m, min_iterations});
+  }
+
+  metrics_.horizon = nominal.N;
+  metrics_.max_iterations = max_iterations;
+}
+
+vector<double> AdaptiveMpc::Solve(const Eigen::VectorXd &state,
+                                  const Eigen::VectorXd &coeffs) {
+  const Level &level = levels_[level_];
+  MPC &mpc = *mpcs_[level.mpc];
+  const size_t N = mpc.GetConfig().N;
+  if (backend_ == MPC::Backend::SQP) {
+    mpc.SetSqpTermination(level.max_iterations, kSqpTolerance);
+  } else {
+    mpc.SetIpoptOption("max_iter", to_string(level.max_iterations));
+  }
+  // stop early enough for the last iteration to fit into the budget
+  mpc.SetTimeLimit(
+      max(0.5 * budget_ms_, budget_ms_ - iteration_ms_[level.mpc]));
+
+  // After a switch of the horizon the previous actuations advanced by one
+  // step seed the solve, cut or held to the new horizon. The MPC of the
+  // horizon warm-starts itself if it solved the previous cycle.
+  if (warm_start_ && last_mpc_ >= 0 && size_t(last_mpc_) != level.mpc) {
+    const size_t steps = previous_.size() / 2;
+    vector<double> seed;
+    for (size_t t = 0; t + 1 < N; ++t) {
+      const size_t s = min(t + 1, steps - 1);
+      seed.push_back(previous_[2 * s]);
+      seed.push_back(previous_[2 * s + 1]);
+    }
+    mpc.SetInitialActuations(seed);
+  }
+
+  vector<double> result = mpc.Solve(state, coeffs);
+  mpc.GetActuations(previous_);
+  last_mpc_ = static_cast<int>(level.mpc);
+
+  const MPCStats &stats = mpc.GetStats();
+  if (stats.iterations > 0) {
+    iteration_ms_[level.mpc] = 0.8 * iteration_ms_[level.mpc] +
+                               0.2 * stats.solve_time_ms / stats.iterations;
+  }
+  const bool missed = stats.solve_time_ms > budget_ms_;
+  {
+    lock_guard<mutex> lock(mutex_);
+    ++metrics_.solves;
+    metrics_.deadline_misses += missed;
+    metrics_.time_limited += stats.time_limited;
+    metrics_.horizon = N;
+    metrics_.max_iterations = level.max_iterations;
+    metrics_.last_solve_ms = stats.solve_time_ms;
+  }
+  if (verbose_) {
+    cout << "Adaptive " << stats.solve_time_ms << " ms of " << budget_ms_
+         << " ms, horizon " << N << ", " << stats.iterations << " of "
+         << level.max_iterations << " iterations"
+         << (stats.time_limited ? ", time limit" : "")
+         << (missed ? ", deadline missed" : "") << endl;
+  }
+  Adapt(stats.solve_time_ms, missed);
+  return result;
+}
+
+void AdaptiveMpc::Adapt(double solve_ms, bool missed) {
+  recent_ms_.push_back(solve_ms);
+  if (recent_ms_.size() > kWindow) {
+    recent_ms_.pop_front();
+  }
+  vector<double> sorted(recent_ms_.begin(), recent_ms_.end());
+  sort(sorted.begin(), sorted.end());
+  const double p90 =
+      sorted[static_cast<size_t>(ceil(0.9 * sorted.size())) - 1];
+  calm_ = solve_ms < kStepUp * budget_ms_ ? calm_ + 1 : 0;
+
+  size_t next = level_;
+  if (missed || p90 > kStepDown * budget_ms_) {
+    if (probing_) {
+      // the level above does not fit yet, wait longer for the next try
+      calm_cycles_ = min(2 * calm_cycles_, kMaxCalmCycles);
+      probing_ = false;
+    }
+    if (level_ + 1 < levels_.size()) {
+      next = level_ + 1;
+    }
+  } else {
+    if (probing_ && recent_ms_.size() == kWindow) {
+      // the step up fits
+      calm_cycles_ = kWindow;
+      probing_ = false;
+    }
+    if (level_ > 0 && calm_ >= calm_cycles_ && p90 < kStepUp * budget_ms_) {
+      next = level_ - 1;
+      probing_ = true;
+    }
+  }
+
+  const bool changed = next != level_;
+  if (changed) {
+    level_ = next;
+    recent_ms_.clear();
+    calm_ = 0;
+  }
+  lock_guard<mutex> lock(mutex_);
+  metrics_.recent_p90_ms = p90;
+  metrics_.level_changes += changed;
+}
+
+AdaptiveMpcMetrics AdaptiveMpc::GetMetrics() const {
+  lock_guard<mutex> lock(mutex_);
+  return metrics_;
+}
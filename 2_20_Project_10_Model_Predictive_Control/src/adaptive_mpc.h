@@ -0,0 +1,98 @@
+#ifndef ADAPTIVE_MPC_H
+#define ADAPTIVE_MPC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+// Counters and the current setting of an AdaptiveMpc
+struct AdaptiveMpcMetrics {
+  uint64_t solves;
+  uint64_t deadline_misses;  // Solves which took longer than the budget
+  uint64_t time_limited;     // Solves stopped by the time limit, they return
+                             // the best solution so far
+  uint64_t level_changes;    // Changes of the horizon or the iteration limit
+  size_t horizon;            // Horizon of the last solve
+  int max_iterations;        // Iteration limit of the last solve
+  double last_solve_ms;
+  double recent_p90_ms;      // 90th percentile of the recent solve times
+};
+
+// Deadline-aware MPC for a fixed time budget per control cycle.
+//
+// The problem is solved at one of a ladder of levels which get cheaper step
+// by step: the horizon of the prototype with the full iteration limit, then
+// with half the iteration limit and so on down to a minimum, then shorter
+// horizons (5 steps less each, not below min_horizon) at the minimum
+// iteration limit. After every solve the recent solve times decide the level
+// of the next one: a deadline miss or a 90th percentile above 80 % of the
+// budget moves one level down, a 90th percentile below 40 % for a number of
+// calm cycles one level up. The calm cycles double whenever a step up has to
+// be taken back within them, so the level does not oscillate between one
+// which fits and one which does not.
+//
+// Every solve is additionally limited to the budget (less the time of one
+// iteration) with MPC::SetTimeLimit, so a solve which runs out of time
+// returns the best feasible actuations found so far. Each horizon has its
+// own MPC, a switch seeds the new one with the previous actuations. The
+// time limit of Ipopt has not been run against a real Ipopt yet, so main.cpp
+// and mpc_benchmark only use the SQP backend.
+class AdaptiveMpc {
+ public:
+  // The levels use the backend, the derivatives, the warm start and the
+  // problem of prototype. The MPC of every horizon is set up (and solved
+  // once) here, so a switch does not pay the setup of Ipopt.
+  AdaptiveMpc(const MPC &prototype, double budget_ms, size_t min_horizon = 5);
+
+  // Same result as MPC::Solve: the first actuations and the predicted x, y
+  // of the current horizon
+  vector<double> Solve(const Eigen::VectorXd &state,
+                       const Eigen::VectorXd &coeffs);
+
+  // Statistics of the last solve of the MPC of its horizon
+  const MPCStats &GetStats() const {
+    return mpcs_[std::max(last_mpc_, 0)]->GetStats();
+  }
+
+  // Thread safe, e.g. for the metrics endpoint while the worker solves
+  AdaptiveMpcMetrics GetMetrics() const;
+
+  // Prints the time and the level of every solve (on by default)
+  void SetVerbose(bool verbose) { verbose_ = verbose; }
+
+ private:
+  struct Level {
+    size_t mpc;          // Index into mpcs_
+    int max_iterations;
+  };
+
+  // Moves to the level of the recent solve times
+  void Adapt(double solve_ms, bool missed);
+
+  MPC::Backend backend_;
+  bool warm_start_;
+  double budget_ms_;
+  bool verbose_;
+
+  std::vector<std::unique_ptr<MPC>> mpcs_;  // One per horizon, longest first
+  std::vector<double> iteration_ms_;        // Time per iteration of each MPC
+  std::vector<Level> levels_;               // Most expensive first
+  size_t level_;
+  int last_mpc_;              // MPC of the previous solve, -1 before the first
+  vector<double> previous_;   // ... and its actuations
+
+  std::deque<double> recent_ms_;  // Solve times at the current level
+  size_t calm_cycles_;            // Calm solves needed for a step up
+  size_t calm_;                   // Solves in a row below the step up time
+  bool probing_;                  // Whether the level was just stepped up
+
+  mutable std::mutex mutex_;
+  AdaptiveMpcMetrics metrics_;
+};
+
+#endif /* ADAPTIVE_MPC_H */
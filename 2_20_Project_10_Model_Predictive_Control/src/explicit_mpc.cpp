@@ -0,0 +1,243 @@
+#include "explicit_mpc.h"
+#include <math.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+// "EMPC" and the version of the file format
+static const uint32_t kMagic = 0x43504d45;
+static const uint32_t kVersion = 1;
+
+void ExplicitTable::Coordinates(const Eigen::VectorXd &state,
+                                const Eigen::VectorXd &coeffs,
+                                double *point) {
+  const double x = state[0];
+  const double f = coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+  const double slope = coeffs[1] + x * (2 * coeffs[2] + x * 3 * coeffs[3]);
+  point[V] = state[3];
+  point[CTE] = f - state[1];
+  point[EPSI] = state[2] - atan(slope);
+  point[C2] = coeffs[2] + 3 * coeffs[3] * x;
+  point[C3] = coeffs[3];
+}
+
+void ExplicitTable::Problem(const double *point, Eigen::VectorXd &state,
+                            Eigen::VectorXd &coeffs) {
+  state.resize(6);
+  state << 0, 0, 0, point[V], point[CTE], point[EPSI];
+  coeffs.resize(4);
+  coeffs << point[CTE], -tan(point[EPSI]), point[C2], point[C3];
+}
+
+ExplicitTable::ExplicitTable() {
+  for (int k = 0; k < kAxes; ++k) {
+    strides_[k] = 0;
+  }
+}
+
+void ExplicitTable::Init(const MPCConfig &config,
+                         const std::vector<double> *axes) {
+  config_ = config;
+  size_t size = 1;
+  for (int k = kAxes - 1; k >= 0; --k) {
+    assert(axes[k].size() >= 2);
+    axes_[k] = axes[k];
+    strides_[k] = size;
+    size *= axes_[k].size();
+  }
+  values_.assign(2 * size, 0);
+}
+
+size_t ExplicitTable::Index(const size_t *node) const {
+  size_t index = 0;
+  for (int k = 0; k < kAxes; ++k) {
+    index += node[k] * strides_[k];
+  }
+  return index;
+}
+
+// Fraction of the limit in 16 bit
+static int16_t Quantize(double value, double limit, int scale) {
+  const double fraction = max(-1.0, min(1.0, value / limit));
+  return static_cast<int16_t>(lround(fraction * scale));
+}
+
+void ExplicitTable::Set(size_t index, double delta, double a) {
+  values_[2 * index] = Quantize(delta, config_.max_delta, kScale);
+  values_[2 * index + 1] = Quantize(a, config_.max_a, kScale);
+}
+
+bool ExplicitTable::Interpolate(const double *point, double &delta,
+                                double &a) const {
+  if (values_.empty()) {
+    return false;
+  }
+  size_t base = 0;
+  double t[kAxes];
+  for (int k = 0; k < kAxes; ++k) {
+    const vector<double> &axis = axes_[k];
+    if (!(point[k] >= axis.front() && point[k] <= axis.back())) {
+      return false;
+    }
+    size_t i = upper_bound(axis.begin(), axis.end(), point[k]) - axis.begin();
+    i = min(max<size_t>(i, 1), axis.size() - 1) - 1;
+    t[k] = (point[k] - axis[i]) / (axis[i + 1] - axis[i]);
+    base += i * strides_[k];
+  }
+
+  // weighted sum over the 2^kAxes corners of the cell
+  double sum_delta = 0, sum_a = 0;
+  for (int corner = 0; corner < (1 << kAxes); ++corner) {
+    size_t index = base;
+    double weight = 1;
+    for (int k = 0; k < kAxes; ++k) {
+      if (corner & (1 << k)) {
+        index += strides_[k];
+        weight *= t[k];
+      } else {
+        weight *= 1 - t[k];
+      }
+    }
+    sum_delta += weight * values_[2 * index];
+    sum_a += weight * values_[2 * index + 1];
+  }
+  delta = sum_delta * config_.max_delta / kScale;
+  a = sum_a * config_.max_a / kScale;
+  return true;
+}
+
+bool ExplicitTable::Matches(const MPCConfig &config) const {
+  return config.N == config_.N && config.dt == config_.dt &&
+         config.Lf == config_.Lf && config.ref_v == config_.ref_v &&
+         config.w_cte == config_.w_cte && config.w_epsi == config_.w_epsi &&
+         config.w_v == config_.w_v && config.w_delta == config_.w_delta &&
+         config.w_a == config_.w_a && config.w_ddelta == config_.w_ddelta &&
+         config.w_da == config_.w_da && config.max_delta == config_.max_delta &&
+         config.max_a == config_.max_a;
+}
+
+template <class T>
+static void Write(ofstream &out, const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+static bool Read(ifstream &in, T &value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+bool ExplicitTable::Save(const std::string &path) const {
+  ofstream out(path, ios::binary);
+  Write(out, kMagic);
+  Write(out, kVersion);
+  Write(out, static_cast<uint64_t>(config_.N));
+  const double parameters[] = {
+      config_.dt,    config_.Lf,        config_.latency, config_.ref_v,
+      config_.w_cte, config_.w_epsi,    config_.w_v,     config_.w_delta,
+      config_.w_a,   config_.w_ddelta,  config_.w_da,    config_.max_delta,
+      config_.max_a};
+  for (double parameter : parameters) {
+    Write(out, parameter);
+  }
+  for (int k = 0; k < kAxes; ++k) {
+    Write(out, static_cast<uint32_t>(axes_[k].size()));
+    for (double breakpoint : axes_[k]) {
+      Write(out, breakpoint);
+    }
+  }
+  out.write(reinterpret_cast<const char *>(values_.data()),
+            values_.size() * sizeof(int16_t));
+  return static_cast<bool>(out);
+}
+
+bool ExplicitTable::Load(const std::string &path) {
+  ifstream in(path, ios::binary);
+  uint32_t magic, version;
+  uint64_t N;
+  if (!Read(in, magic) || !Read(in, version) || magic != kMagic ||
+      version != kVersion || !Read(in, N)) {
+    return false;
+  }
+  MPCConfig config;
+  config.N = N;
+  double *parameters[] = {
+      &config.dt,    &config.Lf,       &config.latency, &config.ref_v,
+      &config.w_cte, &config.w_epsi,   &config.w_v,     &config.w_delta,
+      &config.w_a,   &config.w_ddelta, &config.w_da,    &config.max_delta,
+      &config.max_a};
+  for (double *parameter : parameters) {
+    if (!Read(in, *parameter)) {
+      return false;
+    }
+  }
+  vector<double> axes[kAxes];
+  for (int k = 0; k < kAxes; ++k) {
+    uint32_t count;
+    if (!Read(in, count) || count < 2 || count > 1 << 16) {
+      return false;
+    }
+    axes[k].resize(count);
+    for (double &breakpoint : axes[k]) {
+      if (!Read(in, breakpoint)) {
+        return false;
+      }
+    }
+    if (!is_sorted(axes[k].begin(), axes[k].end())) {
+      return false;
+    }
+  }
+  Init(config, axes);
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char *>(values_.data()),
+              values_.size() * sizeof(int16_t)));
+}
+
+ExplicitMpc::ExplicitMpc(MPC &fallback)
+    : fallback_(fallback),
+      loaded_(false),
+      last_hit_(false),
+      hits_(0),
+      misses_(0) {}
+
+bool ExplicitMpc::Load(const std::string &path) {
+  loaded_ = table_.Load(path) && table_.Matches(fallback_.GetConfig());
+  return loaded_;
+}
+
+vector<double> ExplicitMpc::Solve(const Eigen::VectorXd &state,
+                                  const Eigen::VectorXd &coeffs) {
+  double point[ExplicitTable::kAxes];
+  ExplicitTable::Coordinates(state, coeffs, point);
+  double delta, a;
+  if (!loaded_ || !table_.Interpolate(point, delta, a)) {
+    // the previous solution of the fallback is older than one cycle after
+    // lookups
+    if (last_hit_) {
+      fallback_.ResetWarmStart();
+    }
+    last_hit_ = false;
+    ++misses_;
+    return fallback_.Solve(state, coeffs);
+  }
+  last_hit_ = true;
+  ++hits_;
+
+  const MPCConfig &config = table_.config();
+  vector<double> result;
+  result.push_back(delta);
+  result.push_back(a);
+  double x = state[0], y = state[1], psi = state[2], v = state[3];
+  for (size_t t = 0; t < config.N; ++t) {
+    result.push_back(x);
+    result.push_back(y);
+    x += v * cos(psi) * config.dt;
+    y += v * sin(psi) * config.dt;
+    psi -= v * delta / config.Lf * config.dt;
+    v += a * config.dt;
+  }
+  return result;
+}
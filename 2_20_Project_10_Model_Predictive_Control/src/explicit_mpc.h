@@ -0,0 +1,116 @@
+#ifndef EXPLICIT_MPC_H
+#define EXPLICIT_MPC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "mpc_config.h"
+
+// Table of the first actuations of the MPC problem of an MPCConfig over a
+// grid of reduced problem coordinates (see Coordinates), computed offline by
+// mpc_explicit_table.
+//
+// The grid is rectilinear, every axis has its own breakpoints which need not
+// be uniform, so the table can be refined where the control law bends. The
+// actuations are stored as 16 bit fractions of the actuator limits and
+// interpolated multilinearly, which keeps them within the limits.
+class ExplicitTable {
+ public:
+  // Axes of the grid: speed, lateral offset and heading error of the
+  // reference at the vehicle, and the quadratic and cubic coefficient of the
+  // reference polynomial around the vehicle
+  enum Axis { V, CTE, EPSI, C2, C3 };
+  static const int kAxes = 5;
+
+  // Reduced coordinates of the problem of an initial state
+  // [x, y, psi, v, cte, epsi] and reference polynomial: the polynomial is
+  // shifted to the position of the vehicle and the offset and the heading
+  // error are measured there. The rotation of the vehicle frame by psi is
+  // only taken into account for the slope, so the reduction is exact for
+  // psi = 0 and an approximation of second order in psi otherwise. The
+  // cross track and orientation error of the state do not enter, the
+  // optimal actuations do not depend on them (beyond the heading error).
+  static void Coordinates(const Eigen::VectorXd &state,
+                          const Eigen::VectorXd &coeffs, double *point);
+
+  // Problem with the reduced coordinates point: the vehicle at the origin
+  // heading along x
+  static void Problem(const double *point, Eigen::VectorXd &state,
+                      Eigen::VectorXd &coeffs);
+
+  ExplicitTable();
+
+  // Sets the config and the breakpoints (ascending, at least 2 per axis),
+  // all actuations are 0
+  void Init(const MPCConfig &config, const std::vector<double> *axes);
+
+  const MPCConfig &config() const { return config_; }
+  const std::vector<double> &axis(int k) const { return axes_[k]; }
+
+  // Number of grid nodes and the index of the node with the breakpoints
+  // node[k] of the axes
+  size_t size() const { return values_.size() / 2; }
+  size_t Index(const size_t *node) const;
+
+  // Actuations of a node
+  void Set(size_t index, double delta, double a);
+  double delta(size_t index) const {
+    return values_[2 * index] * config_.max_delta / kScale;
+  }
+  double a(size_t index) const {
+    return values_[2 * index + 1] * config_.max_a / kScale;
+  }
+
+  // Interpolates the actuations at the reduced coordinates point, returns
+  // false if the point is outside of the grid
+  bool Interpolate(const double *point, double &delta, double &a) const;
+
+  // Whether the table was computed for the problem of config: the same
+  // horizon, model, reference speed, weights and limits
+  bool Matches(const MPCConfig &config) const;
+
+  // Binary file in host byte order, Load returns false if the file cannot
+  // be read or is not a table
+  bool Save(const std::string &path) const;
+  bool Load(const std::string &path);
+
+ private:
+  static const int kScale = 32767;
+
+  MPCConfig config_;
+  std::vector<double> axes_[kAxes];
+  size_t strides_[kAxes];
+  std::vector<int16_t> values_;  // delta and a of every node
+};
+
+// Explicit MPC: looks the first actuations up in an ExplicitTable and solves
+// the problems outside of the table online with the fallback MPC. The
+// predicted trajectory of a lookup holds the first actuations over the
+// horizon.
+class ExplicitMpc {
+ public:
+  explicit ExplicitMpc(MPC &fallback);
+
+  // Loads the table, returns false if it cannot be read or was computed for
+  // another problem than the one of the fallback
+  bool Load(const std::string &path);
+
+  // Same result as MPC::Solve: the first actuations and the predicted x, y
+  vector<double> Solve(const Eigen::VectorXd &state,
+                       const Eigen::VectorXd &coeffs);
+
+  // Lookups served by the table and solves of the fallback
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  MPC &fallback_;
+  ExplicitTable table_;
+  bool loaded_;
+  bool last_hit_;
+  size_t hits_, misses_;
+};
+
+#endif /* EXPLICIT_MPC_H */
@@ -0,0 +1,141 @@
+#ifndef FG_EVAL_H
+#define FG_EVAL_H
+
+#include <cstddef>
+#include "mpc_config.h"
+
+// Objective and constraints of the MPC problem. The class is a template on
+// the vector type so the same model is recorded by CppAD (with
+// CPPAD_TESTVECTOR(AD<double>)) and differentiated symbolically by the kernel
+// generator (src/mpc_codegen.cpp). The math functions are called unqualified
+// and found by argument dependent lookup of the scalar type.
+//
+// The horizon, the time step and Lf of the config are constants of the model,
+// the reference speed and the cost weights are taken from the parameters
+// (MPCConfig::Parameters), so the tape and the generated kernels do not
+// depend on them. The variables have the MPCLayout of the horizon.
+template <class Vector>
+class FG_eval {
+ public:
+  typedef typename Vector::value_type Scalar;
+
+  // Fitted polynomial coefficients, the reference speed and the cost weights,
+  // dynamic parameters of the tape
+  Vector coeffs;
+  Scalar ref_v;
+  Scalar w_cte, w_epsi, w_v, w_delta, w_a, w_ddelta, w_da;
+  FG_eval(const MPCConfig &config, const Vector &params)
+      : coeffs(4),
+        N(config.N),
+        dt(config.dt),
+        Lf(config.Lf),
+        layout(config.N) {
+    for (int i = 0; i < 4; i++) {
+      coeffs[i] = params[i];
+    }
+    ref_v = params[4];
+    w_cte = params[5];
+    w_epsi = params[6];
+    w_v = params[7];
+    w_delta = params[8];
+    w_a = params[9];
+    w_ddelta = params[10];
+    w_da = params[11];
+  }
+
+  void operator()(Vector& fg, const Vector& vars) {
+    const size_t x_start = layout.x_start;
+    const size_t y_start = layout.y_start;
+    const size_t psi_start = layout.psi_start;
+    const size_t v_start = layout.v_start;
+    const size_t cte_start = layout.cte_start;
+    const size_t epsi_start = layout.epsi_start;
+    const size_t delta_start = layout.delta_start;
+    const size_t a_start = layout.a_start;
+
+    // `fg` a vector of the cost constraints, `vars` is a vector of variable
+    // values (state & actuators)
+    fg[0] = 0;
+
+    // The part of the cost based on the reference state.
+    for (size_t t = 0; t < N; t++) {
+      fg[0] += w_cte * pow(vars[cte_start + t], 2);
+      fg[0] += w_epsi * pow(vars[epsi_start + t], 2);
+      fg[0] += w_v * pow(vars[v_start + t] - ref_v, 2);
+    }
+
+    // Minimize the use of actuators.
+    for (size_t t = 0; t < N - 1; t++) {
+      fg[0] += w_delta * pow(vars[delta_start + t], 2);
+      fg[0] += w_a * pow(vars[a_start + t], 2);
+    }
+
+    // Minimize the value gap between sequential actuations.
+    for (size_t t = 0; t + 2 < N; t++) {
+      fg[0] += w_ddelta *
+               pow(vars[delta_start + t + 1] - vars[delta_start + t], 2);
+      fg[0] += w_da * pow(vars[a_start + t + 1] - vars[a_start + t], 2);
+    }
+
+    //
+    // Setup Constraints
+    //
+    // Initial constraints
+    //
+    // We add 1 to each of the starting indices due to cost being located at
+    // index 0 of `fg`.
+    // This bumps up the position of all the other values.
+    fg[1 + x_start] = vars[x_start];
+    fg[1 + y_start] = vars[y_start];
+    fg[1 + psi_start] = vars[psi_start];
+    fg[1 + v_start] = vars[v_start];
+    fg[1 + cte_start] = vars[cte_start];
+    fg[1 + epsi_start] = vars[epsi_start];
+
+    // The rest of the constraints
+    for (size_t t = 1; t < N; ++t) {
+      // The state at time t+1
+      Scalar x1 = vars[x_start + t];
+      Scalar y1 = vars[y_start + t];
+      Scalar psi1 = vars[psi_start + t];
+      Scalar v1 = vars[v_start + t];
+      Scalar cte1 = vars[cte_start + t];
+      Scalar epsi1 = vars[epsi_start + t];
+
+      // The state at time t
+      Scalar x0 = vars[x_start + t - 1];
+      Scalar y0 = vars[y_start + t - 1];
+      Scalar psi0 = vars[psi_start + t - 1];
+      Scalar v0 = vars[v_start + t - 1];
+      Scalar epsi0 = vars[epsi_start + t - 1];
+
+      // Only consider the actuation at time t
+      Scalar delta0 = vars[delta_start + t - 1];
+      Scalar a0 = vars[a_start + t - 1];
+
+      Scalar f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * pow(x0, 2) +
+                  coeffs[3] * pow(x0, 3);
+      Scalar psides0 = atan(coeffs[1] + 2.0 * coeffs[2] * x0 +
+                            3.0 * coeffs[3] * pow(x0, 2));
+
+      fg[1 + x_start + t] = x1 - (x0 + v0 * cos(psi0) * dt);
+
+      fg[1 + y_start + t] = y1 - (y0 + v0 * sin(psi0) * dt);
+
+      fg[1 + psi_start + t] = psi1 - (psi0 - v0 * delta0 / Lf * dt);
+
+      fg[1 + v_start + t] = v1 - (v0 + a0 * dt);
+
+      fg[1 + cte_start + t] = cte1 - (f0 - y0) + (v0 * sin(epsi0) * dt);
+
+      fg[1 + epsi_start + t] = epsi1 - (psi0 - psides0 - v0 * delta0 / Lf * dt);
+    }
+  }
+
+ private:
+  size_t N;
+  double dt, Lf;
+  MPCLayout layout;
+};
+
+#endif /* FG_EVAL_H */
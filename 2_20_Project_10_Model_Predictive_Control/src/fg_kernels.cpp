@@ -0,0 +1,123 @@
+#include "fg_kernels.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+//
+// TapedFg
+//
+void TapedFg::Record(size_t n_vars, size_t m, const vector<double> &params,
+                     const Model &model) {
+  n_ = n_vars;
+  m_ = m;
+
+  // record the tape with the parameters as dynamic parameters
+  ADvector vars(n_), dynamic(params.size()), fg(m_ + 1);
+  for (size_t i = 0; i < n_; ++i) {
+    vars[i] = 0;
+  }
+  for (size_t i = 0; i < params.size(); ++i) {
+    dynamic[i] = params[i];
+  }
+  const size_t abort_op_index = 0;
+  const bool record_compare = false;
+  CppAD::Independent(vars, abort_op_index, record_compare, dynamic);
+  model(fg, vars, dynamic);
+  fun_.Dependent(vars, fg);
+  fun_.optimize();
+
+  x_.resize(n_);
+  w_.resize(m_ + 1);
+  fg_.resize(m_ + 1);
+  params_.resize(params.size());
+
+  // Jacobian sparsity, forward mode with an identity seed
+  CppAD::sparse_rc<SizeVector> identity(n_, n_, n_);
+  for (size_t k = 0; k < n_; ++k) {
+    identity.set(k, k, k);
+  }
+  const bool transpose = false, dependency = false, internal_bool = true;
+  fun_.for_jac_sparsity(identity, transpose, dependency, internal_bool,
+                        jac_pattern_);
+  jac_subset_ = CppAD::sparse_rcv<SizeVector, Dvector>(jac_pattern_);
+  jac_rows_.assign(jac_pattern_.row().data(),
+                   jac_pattern_.row().data() + jac_pattern_.nnz());
+  jac_cols_.assign(jac_pattern_.col().data(),
+                   jac_pattern_.col().data() + jac_pattern_.nnz());
+
+  // Hessian sparsity of the Lagrangian, uses the forward Jacobian sparsity
+  // stored by the call above. Ipopt only wants the lower triangle.
+  CPPAD_TESTVECTOR(bool) select_range(m_ + 1);
+  for (size_t i = 0; i <= m_; ++i) {
+    select_range[i] = true;
+  }
+  fun_.rev_hes_sparsity(select_range, transpose, internal_bool, hes_pattern_);
+  hes_rows_.clear();
+  hes_cols_.clear();
+  for (size_t k = 0; k < hes_pattern_.nnz(); ++k) {
+    if (hes_pattern_.row()[k] >= hes_pattern_.col()[k]) {
+      hes_rows_.push_back(hes_pattern_.row()[k]);
+      hes_cols_.push_back(hes_pattern_.col()[k]);
+    }
+  }
+  CppAD::sparse_rc<SizeVector> lower_pattern(n_, n_, hes_rows_.size());
+  for (size_t k = 0; k < hes_rows_.size(); ++k) {
+    lower_pattern.set(k, hes_rows_[k], hes_cols_[k]);
+  }
+  hes_subset_ = CppAD::sparse_rcv<SizeVector, Dvector>(lower_pattern);
+
+  // the colorings are computed by the first evaluation and kept in the work
+  // objects
+  jac_work_.clear();
+  hes_work_.clear();
+}
+
+void TapedFg::SetParameters(const vector<double> &params) {
+  assert(params.size() == params_.size());
+  copy(params.begin(), params.end(), &params_[0]);
+  fun_.new_dynamic(params_);
+}
+
+void TapedFg::Evaluate(const double *x, double *fg) {
+  copy(x, x + n_, &x_[0]);
+  fg_ = fun_.Forward(0, x_);
+  copy(&fg_[0], &fg_[0] + m_ + 1, fg);
+}
+
+void TapedFg::Jacobian(const double *x, double *values) {
+  copy(x, x + n_, &x_[0]);
+  const size_t group_max = 1;
+  fun_.sparse_jac_for(group_max, x_, jac_subset_, jac_pattern_, "cppad",
+                      jac_work_);
+  copy(jac_subset_.val().data(), jac_subset_.val().data() + jac_rows_.size(),
+       values);
+}
+
+void TapedFg::Hessian(const double *x, const double *weights,
+                      double *values) {
+  copy(x, x + n_, &x_[0]);
+  copy(weights, weights + m_ + 1, &w_[0]);
+  fun_.sparse_hes(x_, w_, hes_subset_, hes_pattern_, "cppad.symmetric",
+                  hes_work_);
+  copy(hes_subset_.val().data(), hes_subset_.val().data() + hes_rows_.size(),
+       values);
+}
+
+//
+// GeneratedFg
+//
+GeneratedFg::GeneratedFg(const GeneratedKernel &kernel)
+    : kernel_(kernel), params_(kernel.n_params, 0.0) {
+  n_ = kernel.n;
+  m_ = kernel.m;
+  jac_rows_.assign(kernel.jac_rows, kernel.jac_rows + kernel.jac_nnz);
+  jac_cols_.assign(kernel.jac_cols, kernel.jac_cols + kernel.jac_nnz);
+  hes_rows_.assign(kernel.hes_rows, kernel.hes_rows + kernel.hes_nnz);
+  hes_cols_.assign(kernel.hes_cols, kernel.hes_cols + kernel.hes_nnz);
+}
+
+void GeneratedFg::SetParameters(const vector<double> &params) {
+  assert(params.size() == params_.size());
+  params_ = params;
+}
@@ -0,0 +1,129 @@
+#ifndef FG_KERNELS_H
+#define FG_KERNELS_H
+
+#include <cppad/cppad.hpp>
+#include <functional>
+#include <vector>
+
+// Values and derivatives of an optimization problem fg(vars; params), where
+// fg[0] is the objective and fg[1..m] are the constraints. The sparsity
+// patterns are fixed, the values of a pattern are returned in its order.
+class FgKernels {
+ public:
+  virtual ~FgKernels() {}
+
+  size_t n() const { return n_; }
+  size_t m() const { return m_; }
+
+  // Changes the parameters
+  virtual void SetParameters(const std::vector<double> &params) = 0;
+
+  // Values of fg at x
+  virtual void Evaluate(const double *x, double *fg) = 0;
+
+  // Sparse Jacobian of all of fg (the objective gradient is row 0)
+  const std::vector<size_t> &JacobianRows() const { return jac_rows_; }
+  const std::vector<size_t> &JacobianCols() const { return jac_cols_; }
+  virtual void Jacobian(const double *x, double *values) = 0;
+
+  // Lower triangle of the Hessian of sum_i weights[i] * fg[i]
+  const std::vector<size_t> &HessianRows() const { return hes_rows_; }
+  const std::vector<size_t> &HessianCols() const { return hes_cols_; }
+  virtual void Hessian(const double *x, const double *weights,
+                       double *values) = 0;
+
+ protected:
+  FgKernels() : n_(0), m_(0) {}
+
+  size_t n_, m_;
+  std::vector<size_t> jac_rows_, jac_cols_, hes_rows_, hes_cols_;
+};
+
+// CppAD tape of the problem. The tape is recorded once with the params as
+// CppAD dynamic parameters, so changing them does not re-record it. The
+// sparsity patterns of the Jacobian and of the Hessian of the Lagrangian and
+// the colorings CppAD derives from them are computed once as well.
+class TapedFg : public FgKernels {
+ public:
+  typedef CPPAD_TESTVECTOR(CppAD::AD<double>) ADvector;
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef CPPAD_TESTVECTOR(size_t) SizeVector;
+  typedef std::function<void(ADvector &fg, const ADvector &vars,
+                             const ADvector &params)>
+      Model;
+
+  // Records the model for n_vars variables, m constraints and the given
+  // initial parameters and computes the sparsity patterns
+  void Record(size_t n_vars, size_t m, const std::vector<double> &params,
+              const Model &model);
+
+  bool IsRecorded() const { return n_ > 0; }
+
+  // FgKernels
+  void SetParameters(const std::vector<double> &params) override;
+  void Evaluate(const double *x, double *fg) override;
+  void Jacobian(const double *x, double *values) override;
+  void Hessian(const double *x, const double *weights,
+               double *values) override;
+
+ private:
+  CppAD::ADFun<double> fun_;
+  Dvector x_, w_, fg_, params_;
+
+  CppAD::sparse_rc<SizeVector> jac_pattern_, hes_pattern_;
+  CppAD::sparse_rcv<SizeVector, Dvector> jac_subset_, hes_subset_;
+  CppAD::sparse_jac_work jac_work_;
+  CppAD::sparse_hes_work hes_work_;
+};
+
+// Plain C++ kernels of one instance of the problem, emitted ahead of time by
+// src/mpc_codegen.cpp. The sizes and the sparsity patterns are fixed by the
+// generator, the parameters are arguments of the kernels.
+struct GeneratedKernel {
+  // Instance the kernels were generated for
+  size_t N;
+  double dt, Lf;
+
+  size_t n, m, n_params;
+  size_t jac_nnz;
+  const size_t *jac_rows, *jac_cols;
+  size_t hes_nnz;
+  const size_t *hes_rows, *hes_cols;
+
+  void (*fg)(const double *x, const double *params, double *fg);
+  void (*jacobian)(const double *x, const double *params, double *values);
+  void (*hessian)(const double *x, const double *params, const double *weights,
+                  double *values);
+};
+
+// Kernels generated for the horizon N, the time step dt and Lf, nullptr if
+// there are none
+const GeneratedKernel *FindGeneratedKernel(size_t N, double dt, double Lf);
+
+// All generated kernels, count receives their number
+const GeneratedKernel *GeneratedKernels(size_t *count);
+
+// FgKernels of a GeneratedKernel
+class GeneratedFg : public FgKernels {
+ public:
+  explicit GeneratedFg(const GeneratedKernel &kernel);
+
+  // FgKernels
+  void SetParameters(const std::vector<double> &params) override;
+  void Evaluate(const double *x, double *fg) override {
+    kernel_.fg(x, &params_[0], fg);
+  }
+  void Jacobian(const double *x, double *values) override {
+    kernel_.jacobian(x, &params_[0], values);
+  }
+  void Hessian(const double *x, const double *weights,
+               double *values) override {
+    kernel_.hessian(x, &params_[0], weights, values);
+  }
+
+ private:
+  const GeneratedKernel &kernel_;
+  std::vector<double> params_;
+};
+
+#endif /* FG_KERNELS_H */
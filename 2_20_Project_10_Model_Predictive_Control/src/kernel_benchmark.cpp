@@ -0,0 +1,186 @@
+// Compares the CppAD tape of FG_eval with the generated kernels: time per
+// evaluation of the values, the Jacobian and the Hessian of the Lagrangian,
+// and the largest difference of the results.
+//
+// Usage: mpc_kernel_benchmark [repetitions]
+
+#include <math.h>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+#include "fg_eval.h"
+#include "fg_kernels.h"
+
+using namespace std;
+
+namespace {
+
+typedef map<pair<size_t, size_t>, double> SparseMatrix;
+
+SparseMatrix ToMap(const vector<size_t> &rows, const vector<size_t> &cols,
+                   const vector<double> &values) {
+  SparseMatrix matrix;
+  for (size_t k = 0; k < rows.size(); ++k) {
+    matrix[make_pair(rows[k], cols[k])] += values[k];
+  }
+  return matrix;
+}
+
+// Largest difference of two sparse matrices, missing entries are zero
+double MaxDifference(const SparseMatrix &a, const SparseMatrix &b) {
+  double difference = 0;
+  for (const auto &entry : a) {
+    auto found = b.find(entry.first);
+    const double other = found == b.end() ? 0.0 : found->second;
+    difference = max(difference, fabs(entry.second - other));
+  }
+  for (const auto &entry : b) {
+    if (a.find(entry.first) == a.end()) {
+      difference = max(difference, fabs(entry.second));
+    }
+  }
+  return difference;
+}
+
+// Microseconds per call of f over all points
+double Time(size_t repetitions, size_t points,
+            const function<void(size_t)> &f) {
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < repetitions; ++r) {
+    for (size_t p = 0; p < points; ++p) {
+      f(p);
+    }
+  }
+  return chrono::duration<double, micro>(chrono::steady_clock::now() - start)
+             .count() /
+         (repetitions * points);
+}
+
+void Benchmark(const GeneratedKernel &kernel, size_t repetitions) {
+  MPCConfig config;
+  config.N = kernel.N;
+  config.dt = kernel.dt;
+  config.Lf = kernel.Lf;
+  const size_t N = config.N;
+
+  auto record_start = chrono::steady_clock::now();
+  TapedFg taped;
+  taped.Record(kernel.n, kernel.m, vector<double>(kernel.n_params, 0.0),
+               [config](TapedFg::ADvector &fg, const TapedFg::ADvector &vars,
+                        const TapedFg::ADvector &params) {
+                 FG_eval<TapedFg::ADvector> fg_eval(config, params);
+                 fg_eval(fg, vars);
+               });
+  const double record_ms = chrono::duration<double, milli>(
+                               chrono::steady_clock::now() - record_start)
+                               .count();
+  GeneratedFg generated(kernel);
+  FgKernels *kernels[2] = {&taped, &generated};
+
+  // random points around a trajectory at speed, multipliers of both signs
+  const size_t points = 64;
+  mt19937 rng(42);
+  uniform_real_distribution<double> uniform(-1, 1);
+  vector<vector<double>> x(points), w(points);
+  for (size_t p = 0; p < points; ++p) {
+    x[p].resize(kernel.n);
+    w[p].resize(kernel.m + 1);
+    for (size_t t = 0; t < N; ++t) {
+      x[p][t] = 3 * t + uniform(rng);             // x
+      x[p][N + t] = uniform(rng);                 // y
+      x[p][2 * N + t] = 0.2 * uniform(rng);       // psi
+      x[p][3 * N + t] = 30 + 5 * uniform(rng);    // v
+      x[p][4 * N + t] = uniform(rng);             // cte
+      x[p][5 * N + t] = 0.2 * uniform(rng);       // epsi
+    }
+    for (size_t i = 6 * N; i < kernel.n; ++i) {
+      x[p][i] = 0.4 * uniform(rng);
+    }
+    w[p][0] = 1;
+    for (size_t i = 1; i <= kernel.m; ++i) {
+      w[p][i] = 10 * uniform(rng);
+    }
+  }
+  const double coeffs[4] = {0.5, -0.05, 0.002, -1e-5};
+  vector<double> params(MPCConfig::kParameters);
+  config.Parameters(coeffs, params);
+  taped.SetParameters(params);
+  generated.SetParameters(params);
+
+  // timings
+  double times[2][3];
+  vector<double> fg(kernel.m + 1);
+  for (int i = 0; i < 2; ++i) {
+    FgKernels &k = *kernels[i];
+    vector<double> jacobian(k.JacobianRows().size());
+    vector<double> hessian(k.HessianRows().size());
+    times[i][0] = Time(repetitions, points,
+                       [&](size_t p) { k.Evaluate(&x[p][0], &fg[0]); });
+    times[i][1] = Time(repetitions, points,
+                       [&](size_t p) { k.Jacobian(&x[p][0], &jacobian[0]); });
+    times[i][2] = Time(repetitions, points, [&](size_t p) {
+      k.Hessian(&x[p][0], &w[p][0], &hessian[0]);
+    });
+  }
+
+  // largest differences
+  double differences[3] = {0, 0, 0};
+  for (size_t p = 0; p < points; ++p) {
+    vector<double> values[2];
+    SparseMatrix jacobians[2], hessians[2];
+    for (int i = 0; i < 2; ++i) {
+      FgKernels &k = *kernels[i];
+      values[i].resize(kernel.m + 1);
+      k.Evaluate(&x[p][0], &values[i][0]);
+      vector<double> jacobian(k.JacobianRows().size());
+      k.Jacobian(&x[p][0], &jacobian[0]);
+      jacobians[i] = ToMap(k.JacobianRows(), k.JacobianCols(), jacobian);
+      vector<double> hessian(k.HessianRows().size());
+      k.Hessian(&x[p][0], &w[p][0], &hessian[0]);
+      hessians[i] = ToMap(k.HessianRows(), k.HessianCols(), hessian);
+    }
+    for (size_t i = 0; i <= kernel.m; ++i) {
+      differences[0] =
+          max(differences[0], fabs(values[0][i] - values[1][i]));
+    }
+    differences[1] =
+        max(differences[1], MaxDifference(jacobians[0], jacobians[1]));
+    differences[2] =
+        max(differences[2], MaxDifference(hessians[0], hessians[1]));
+  }
+
+  const char *names[3] = {"fg", "Jacobian", "Hessian"};
+  cout << "N = " << N << " (" << kernel.n << " variables, " << kernel.m
+       << " constraints), recording the tape took " << record_ms << " ms"
+       << endl;
+  cout << "  nonzeros    tape: Jacobian " << taped.JacobianRows().size()
+       << ", Hessian " << taped.HessianRows().size() << endl;
+  cout << "         generated: Jacobian " << kernel.jac_nnz << ", Hessian "
+       << kernel.hes_nnz << endl;
+  cout << "  " << setw(10) << "kernel" << setw(12) << "tape [us]" << setw(16)
+       << "generated [us]" << setw(10) << "speedup" << setw(16)
+       << "max difference" << endl;
+  for (int j = 0; j < 3; ++j) {
+    cout << "  " << setw(10) << names[j] << setw(12) << times[0][j]
+         << setw(16) << times[1][j] << setw(10) << times[0][j] / times[1][j]
+         << setw(16) << differences[j] << endl;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const size_t repetitions = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+  size_t count = 0;
+  const GeneratedKernel *kernels = GeneratedKernels(&count);
+  cout << setprecision(3);
+  for (size_t i = 0; i < count; ++i) {
+    Benchmark(kernels[i], repetitions);
+  }
+  return 0;
+}
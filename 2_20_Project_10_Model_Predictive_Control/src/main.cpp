@@ -1,13 +1,22 @@
 #include <math.h>
 #include <uWS/uWS.h>
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <sstream>
 #include <thread>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
-#include "Eigen-3.3/Eigen/QR"
 #include "MPC.h"
+#include "adaptive_mpc.h"
+#include "explicit_mpc.h"
 #include "json.hpp"
+#include "mpc_worker.h"
+#include "multi_start_mpc.h"
+#include "telemetry.h"
 
 // for convenience
 using json = nlohmann::json;
@@ -17,62 +26,357 @@ constexpr double pi() { return M_PI; }
 double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.rfind("}]");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
-  }
-  return "";
+// Solves the MPC problem of an initial state and reference polynomial, the
+// result has the layout of MPC::Solve. Either the MPC itself, the explicit,
+// the multi-start or the adaptive MPC.
+typedef function<vector<double>(const Eigen::VectorXd &,
+                                const Eigen::VectorXd &)>
+    Controller;
+
+// Computes the steering message for a telemetry frame, runs on the MPC
+// worker thread
+string SolveFrame(const MPCConfig &config, const Controller &controller,
+                  const Telemetry &telemetry) {
+  /*
+  * TODO: Calculate steering angle and throttle using MPC.
+  *
+  * Both are in between [-1, 1].
+  *
+  */
+
+  // waypoints in vehicle coordinates and the state after the latency
+  Eigen::VectorXd state, coefficients;
+  PrepareMpcInput(telemetry, config, state, coefficients);
+  const double Lf = config.Lf;
+
+  // Solve MPC using our helper class
+  auto values = controller(state, coefficients);
+
+  json msgJson;
+  // NOTE: Remember to divide by deg2rad(25) before you send the steering value back.
+  // Otherwise the values will be in between [-deg2rad(25), deg2rad(25] instead of [-1, 1].
+  msgJson["steering_angle"] = values[0] / (deg2rad(25) * Lf);
+  msgJson["throttle"] = values[1];
+
+  //Display the MPC predicted trajectory 
+  vector<double> mpc_x_vals;
+  vector<double> mpc_y_vals;
+
+  for (int i = 1; i < values.size()/2; ++i) {
+    mpc_x_vals.push_back(values[i*2]);
+    mpc_y_vals.push_back(values[i*2+1]);
+  }          
+
+  //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+  // the points in the simulator are connected by a Green line
+
+  msgJson["mpc_x"] = mpc_x_vals;
+  msgJson["mpc_y"] = mpc_y_vals;
+
+  //Display the waypoints/reference line
+  vector<double> next_x_vals;
+  vector<double> next_y_vals;
+
+  double polyStep = 2.0;
+  int polyPointCount = 20;
+  
+  for (int i = 1; i < polyPointCount; ++i) {
+    next_x_vals.push_back(polyStep * i);
+    next_y_vals.push_back(polyeval(coefficients, polyStep * i));
+  }          
+
+  //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+  // the points in the simulator are connected by a Yellow line
+
+  msgJson["next_x"] = next_x_vals;
+  msgJson["next_y"] = next_y_vals;
+
+
+  auto msg = "42[\"steer\"," + msgJson.dump() + "]";
+  return msg;
 }
 
-// Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x) {
-  double result = 0.0;
-  for (int i = 0; i < coeffs.size(); i++) {
-    result += coeffs[i] * pow(x, i);
+// Event loop side of the MPC worker: the results wait for the simulated
+// actuation latency in a uS::Timer before they are sent to the simulator.
+// The worker wakes the event loop through a uS::Async, so neither the solve
+// nor the latency blocks the event loop.
+struct Delivery {
+  struct Pending {
+    chrono::steady_clock::time_point due;
+    MpcWorker::Result result;
+  };
+
+  MpcWorker *worker;
+  uS::Timer *timer;
+  bool timer_running;
+  chrono::milliseconds latency;
+  deque<Pending> pending;
+
+  // The connected simulator
+  uWS::WebSocket<uWS::SERVER> ws;
+  bool connected;
+};
+
+void ScheduleDelivery(Delivery &delivery);
+
+// Timer callback, sends the results which are due
+void Deliver(uS::Timer *timer) {
+  Delivery &delivery = *static_cast<Delivery *>(timer->getData());
+  // The epoll backend of uWS keeps the expired timer queued until the
+  // callback returns and takes the wait of the loop from the front of the
+  // queue when the timer is started. Starting it again below without
+  // stopping it first would make the loop poll without waiting until the
+  // next result is due.
+  timer->stop();
+  delivery.timer_running = false;
+  const auto now = chrono::steady_clock::now();
+  while (!delivery.pending.empty() && delivery.pending.front().due <= now) {
+    const MpcWorker::Result &result = delivery.pending.front().result;
+    if (delivery.connected) {
+      delivery.ws.send(result.message.data(), result.message.length(),
+                       uWS::OpCode::TEXT);
+      delivery.worker->RecordDelivery(result);
+    }
+    delivery.pending.pop_front();
   }
-  return result;
+  ScheduleDelivery(delivery);
 }
 
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
-                        int order) {
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
-
-  for (int i = 0; i < xvals.size(); i++) {
-    A(i, 0) = 1.0;
+// Starts the timer for the next pending result
+void ScheduleDelivery(Delivery &delivery) {
+  if (delivery.timer_running || delivery.pending.empty()) {
+    return;
   }
+  const auto wait = chrono::duration_cast<chrono::milliseconds>(
+      delivery.pending.front().due - chrono::steady_clock::now());
+  delivery.timer->start(Deliver, max<int>(0, wait.count() + 1), 0);
+  delivery.timer_running = true;
+}
 
-  for (int j = 0; j < xvals.size(); j++) {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
-    }
+// Async callback, collects the result of the worker
+void CollectResult(uS::Async *async) {
+  Delivery &delivery = *static_cast<Delivery *>(async->getData());
+  Delivery::Pending pending;
+  if (!delivery.worker->TakeResult(pending.result)) {
+    return;
   }
+  // Latency
+  // The purpose is to mimic real driving conditions where
+  // the car does actuate the commands instantly.
+  //
+  // Feel free to play around with this value but should be to drive
+  // around the track with 100ms latency.
+  pending.due = pending.result.solved + delivery.latency;
+  delivery.pending.push_back(std::move(pending));
+  ScheduleDelivery(delivery);
+}
 
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
+// Metrics of the worker (if any) and of the adaptive MPC (if any) in the
+// Prometheus text format
+string FormatMetrics(const MpcWorker *worker, const AdaptiveMpc *adaptive) {
+  ostringstream out;
+  if (worker) {
+    const MpcWorkerMetrics metrics = worker->GetMetrics();
+    out << "mpc_frames_received_total " << metrics.received << "\n"
+        << "mpc_frames_dropped_total " << metrics.dropped << "\n"
+        << "mpc_frames_solved_total " << metrics.solved << "\n"
+        << "mpc_results_delivered_total " << metrics.delivered << "\n"
+        << "mpc_frame_queue_ms " << metrics.last_queue_ms << "\n"
+        << "mpc_frame_queue_max_ms " << metrics.max_queue_ms << "\n"
+        << "mpc_solve_ms " << metrics.last_solve_ms << "\n"
+        << "mpc_frame_delivery_age_ms " << metrics.last_delivery_ms << "\n"
+        << "mpc_frame_delivery_age_max_ms " << metrics.max_delivery_ms
+        << "\n";
+  }
+  if (adaptive) {
+    const AdaptiveMpcMetrics adaptive_metrics = adaptive->GetMetrics();
+    out << "mpc_deadline_misses_total " << adaptive_metrics.deadline_misses
+        << "\n"
+        << "mpc_time_limited_solves_total " << adaptive_metrics.time_limited
+        << "\n"
+        << "mpc_level_changes_total " << adaptive_metrics.level_changes
+        << "\n"
+        << "mpc_horizon " << adaptive_metrics.horizon << "\n"
+        << "mpc_max_iterations " << adaptive_metrics.max_iterations << "\n"
+        << "mpc_solve_p90_ms " << adaptive_metrics.recent_p90_ms << "\n";
+  }
+  return out.str();
 }
 
-int main() {
+int main(int argc, char *argv[]) {
   uWS::Hub h;
 
   // MPC is initialized here!
   MPC mpc;
 
-  h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
-                     uWS::OpCode opCode) {
+  // The solver can be chosen on the command line, --warm / --cold turn the
+  // warm start on / off (on for sqp, off for ipopt by default), --generated uses the generated derivative kernels instead of the
+  // CppAD tape, --retape records the tape on every solve like the original
+  // solver, --horizon changes the number of time steps, --explicit
+  // looks the actuations up in a table of mpc_explicit_table,
+  // --multi-start solves several candidates on a thread pool within a
+  // deadline and --budget adapts horizon and iterations to a solve time
+  // budget, both with the sqp backend. --async solves on a worker thread and delays the results in the
+  // event loop instead of solving and sleeping in the message handler:
+  // ./mpc [ipopt|sqp] [--warm|--cold] [--generated|--retape] [--horizon N]
+  //       [--explicit table] [--multi-start [--threads N] [--deadline ms]]
+  //       [--budget ms] [--async]
+  MPCConfig config;
+  string explicit_table;
+  bool async = false;
+  bool ipopt = false;  // Whether ipopt was given
+  int warm_start = -1;  // Not given
+  bool multi_start = false;
+  size_t threads = max(1u, thread::hardware_concurrency());
+  double deadline_ms = 50;
+  double budget_ms = 0;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--horizon" && i + 1 < argc) {
+      config.N = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--explicit" && i + 1 < argc) {
+      explicit_table = argv[++i];
+    } else if (arg == "--async") {
+      async = true;
+    } else if (arg == "--multi-start") {
+      multi_start = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--deadline" && i + 1 < argc) {
+      deadline_ms = atof(argv[++i]);
+    } else if (arg == "--budget" && i + 1 < argc) {
+      budget_ms = atof(argv[++i]);
+    } else if (arg == "sqp") {
+      mpc.SetBackend(MPC::Backend::SQP);
+      ipopt = false;
+    } else if (arg == "--warm") {
+      warm_start = 1;
+    } else if (arg == "--cold") {
+      warm_start = 0;
+    } else if (arg == "--generated") {
+      mpc.SetDerivatives(MPC::Derivatives::GENERATED);
+    } else if (arg == "--retape") {
+      mpc.SetDerivatives(MPC::Derivatives::RETAPE);
+    } else if (arg == "ipopt") {
+      mpc.SetBackend(MPC::Backend::IPOPT);
+      ipopt = true;
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [ipopt|sqp] [--warm|--cold] [--generated|--retape]"
+                   " [--horizon N] [--explicit table]"
+                   " [--multi-start [--threads N] [--deadline ms]]"
+                   " [--budget ms] [--async]"
+                << std::endl;
+      return -1;
+    }
+  }
+  if (multi_start + !explicit_table.empty() + (budget_ms > 0) > 1) {
+    std::cerr << "--explicit, --multi-start and --budget exclude each other"
+              << std::endl;
+    return -1;
+  }
+  // Ipopt with MUMPS and the recording of CppAD tapes are not thread safe,
+  // so Ipopt candidates could only run one after the other
+  if (multi_start) {
+    if (ipopt) {
+      std::cerr << "--multi-start needs the sqp backend" << std::endl;
+      return -1;
+    }
+    mpc.SetBackend(MPC::Backend::SQP);
+  }
+  // The solves of the adaptive MPC are limited with MPC::SetTimeLimit, which
+  // has only been tested with the SQP solver
+  if (budget_ms > 0) {
+    if (ipopt) {
+      std::cerr << "--budget needs the sqp backend" << std::endl;
+      return -1;
+    }
+    mpc.SetBackend(MPC::Backend::SQP);
+  }
+  if (config.N < 2 || config.N > size_t(SqpSolverBase::kMaxSteps)) {
+    std::cerr << "The horizon has to be between 2 and "
+              << SqpSolverBase::kMaxSteps << std::endl;
+    return -1;
+  }
+  mpc.SetConfig(config);
+  // The warm start of the SQP solver has been measured to save iterations,
+  // the one of Ipopt has not been measured yet
+  mpc.SetWarmStart(warm_start < 0 ? mpc.GetBackend() == MPC::Backend::SQP
+                                  : warm_start != 0);
+
+  Controller controller = [&mpc](const Eigen::VectorXd &state,
+                                 const Eigen::VectorXd &coeffs) {
+    return mpc.Solve(state, coeffs);
+  };
+
+  // Problems outside of the table are solved by mpc
+  std::unique_ptr<ExplicitMpc> explicit_mpc;
+  if (!explicit_table.empty()) {
+    explicit_mpc.reset(new ExplicitMpc(mpc));
+    if (!explicit_mpc->Load(explicit_table)) {
+      std::cerr << "Cannot load " << explicit_table
+                << " or it was computed for another problem" << std::endl;
+      return -1;
+    }
+    ExplicitMpc *explicit_controller = explicit_mpc.get();
+    controller = [explicit_controller](const Eigen::VectorXd &state,
+                                       const Eigen::VectorXd &coeffs) {
+      return explicit_controller->Solve(state, coeffs);
+    };
+  }
+
+  // The candidates take the backend (sqp) and the problem of mpc
+  std::unique_ptr<MultiStartMpc> multi_start_mpc;
+  if (multi_start) {
+    multi_start_mpc.reset(new MultiStartMpc(
+        mpc, MultiStartMpc::DefaultCandidates(config.ref_v), threads,
+        deadline_ms));
+    MultiStartMpc *multi_start_controller = multi_start_mpc.get();
+    controller = [multi_start_controller](const Eigen::VectorXd &state,
+                                          const Eigen::VectorXd &coeffs) {
+      return multi_start_controller->Solve(state, coeffs);
+    };
+  }
+
+  // The levels of the adaptive MPC take the backend and the problem of mpc
+  std::unique_ptr<AdaptiveMpc> adaptive_mpc;
+  if (budget_ms > 0) {
+    adaptive_mpc.reset(new AdaptiveMpc(mpc, budget_ms));
+    AdaptiveMpc *adaptive_controller = adaptive_mpc.get();
+    controller = [adaptive_controller](const Eigen::VectorXd &state,
+                                       const Eigen::VectorXd &coeffs) {
+      return adaptive_controller->Solve(state, coeffs);
+    };
+  }
+
+  // By default the message handler solves the frame and sleeps for the
+  // latency. With --async the MPC runs on a worker thread, the event loop
+  // only parses the frames and sends the results.
+  Delivery delivery;
+  delivery.worker = nullptr;
+  delivery.timer = nullptr;
+  delivery.timer_running = false;
+  delivery.latency = chrono::milliseconds(
+      static_cast<int>(mpc.GetConfig().latency * 1000 + 0.5));
+  delivery.connected = false;
+  std::unique_ptr<MpcWorker> worker;
+  if (async) {
+    delivery.timer = new uS::Timer(h.getLoop());
+    delivery.timer->setData(&delivery);
+    uS::Async *result_ready = new uS::Async(h.getLoop());
+    result_ready->setData(&delivery);
+    result_ready->start(CollectResult);
+    worker.reset(new MpcWorker(
+        [&config, &controller](const Telemetry &telemetry) {
+          return SolveFrame(config, controller, telemetry);
+        },
+        [result_ready] { result_ready->send(); }));
+    delivery.worker = worker.get();
+  }
+
+  h.onMessage([&config, &controller, &delivery](
+                  uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+                  uWS::OpCode opCode) {
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
@@ -85,119 +389,24 @@ int main() {
         string event = j[0].get<string>();
         if (event == "telemetry") {
           // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          double px = j[1]["x"];
-          double py = j[1]["y"];
-          double psi = j[1]["psi"];
-          double v = j[1]["speed"];
-          double delta = j[1]["steering_angle"];
-          double a = j[1]["throttle"];
-
-          /*
-          * TODO: Calculate steering angle and throttle using MPC.
-          *
-          * Both are in between [-1, 1].
-          *
-          */
-
-          // the points we get are global so we first of all need to
-          // transform them into local space to be able to later
-          // make a local decision
-          Eigen::VectorXd dirpoints_x(ptsx.size());
-          Eigen::VectorXd dirpoints_y(ptsy.size());
-          
-          for (int i = 0; i < ptsx.size(); i++) {
-            // get relative x/y
-            double x = ptsx[i] - px;
-            double y = ptsy[i] - py;
-            // rotate around zero point
-            dirpoints_x[i] = x*cos(-psi) - y*sin(-psi);
-            dirpoints_y[i] = x*sin(-psi) + y*cos(-psi);
+          Telemetry frame;
+          TelemetryFromJson(j[1], frame);
+          frame.received = chrono::steady_clock::now();
+          if (delivery.worker) {
+            // The frame is solved by the worker, a frame which is still
+            // waiting is replaced by this one.
+            delivery.worker->Post(frame);
+          } else {
+            const string msg = SolveFrame(config, controller, frame);
+            // Latency
+            // The purpose is to mimic real driving conditions where
+            // the car does actuate the commands instantly.
+            //
+            // Feel free to play around with this value but should be to drive
+            // around the track with 100ms latency.
+            this_thread::sleep_for(delivery.latency);
+            ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
           }
-          
-          // fit a third grade polnoymial to the relative, optimal line         
-          auto coefficients = polyfit(dirpoints_x, dirpoints_y, 3);
-
-          // Calculate the initial cross track error
-          // Note: The points are provided and transformed to be relative to the
-          // car. The closer we are to the perfect line, the small the cte
-          double cte = polyeval(coefficients, 0);
-
-          // Calculate the initial orientation error
-          // As we calculate the points relative to the car the only valid value
-          // is the orientation provided at index 1
-          double eps = -atan(coefficients[1]);
-
-          const double dt = 0.1;
-          const double Lf = 2.67;
-
-          double next_x = v * dt;
-          double next_y = 0;
-          double next_psi = v * -delta / Lf * dt;
-          double next_v = v + a * dt;
-          double next_cte = cte + v * sin(eps) * dt;
-          double next_eps = eps + -delta / Lf * dt;
-
-          Eigen::VectorXd state(6);
-          state << next_x, next_y, next_psi, next_v, next_cte, next_eps;
-          
-          // Solve MPC using our helper class
-          auto values = mpc.Solve(state, coefficients);
-
-          json msgJson;
-          // NOTE: Remember to divide by deg2rad(25) before you send the steering value back.
-          // Otherwise the values will be in between [-deg2rad(25), deg2rad(25] instead of [-1, 1].
-          msgJson["steering_angle"] = values[0] / (deg2rad(25) * Lf);
-          msgJson["throttle"] = values[1];
-
-          //Display the MPC predicted trajectory 
-          vector<double> mpc_x_vals;
-          vector<double> mpc_y_vals;
-
-          for (int i = 1; i < values.size()/2; ++i) {
-            mpc_x_vals.push_back(values[i*2]);
-            mpc_y_vals.push_back(values[i*2+1]);
-          }          
-
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Green line
-
-          msgJson["mpc_x"] = mpc_x_vals;
-          msgJson["mpc_y"] = mpc_y_vals;
-
-          //Display the waypoints/reference line
-          vector<double> next_x_vals;
-          vector<double> next_y_vals;
-
-          double polyStep = 2.0;
-          int polyPointCount = 20;
-          
-          for (int i = 1; i < polyPointCount; ++i) {
-            next_x_vals.push_back(polyStep * i);
-            next_y_vals.push_back(polyeval(coefficients, polyStep * i));
-          }          
-
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Yellow line
-
-          msgJson["next_x"] = next_x_vals;
-          msgJson["next_y"] = next_y_vals;
-
-
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          // std::cout << msg << std::endl;
-          // Latency
-          // The purpose is to mimic real driving conditions where
-          // the car does actuate the commands instantly.
-          //
-          // Feel free to play around with this value but should be to drive
-          // around the track with 100ms latency.
-          //
-          // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
-          // SUBMITTING.
-          this_thread::sleep_for(chrono::milliseconds(100));
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
         }
       } else {
         // Manual driving
@@ -207,26 +416,36 @@ int main() {
     }
   });
 
-  // We don't need this since we're not using HTTP but if it's removed the
-  // program
-  // doesn't compile :-(
-  h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
-                     size_t, size_t) {
+  // With --async the frame ages and the drop counts of the worker are served
+  // at /metrics, with --budget the deadline misses and the horizon
+  const MpcWorker *worker_metrics = worker.get();
+  const AdaptiveMpc *adaptive_metrics = adaptive_mpc.get();
+  h.onHttpRequest([worker_metrics, adaptive_metrics](uWS::HttpResponse *res,
+                                              uWS::HttpRequest req,
+                                              char *data, size_t, size_t) {
     const std::string s = "<h1>Hello world!</h1>";
     if (req.getUrl().valueLength == 1) {
       res->end(s.data(), s.length());
+    } else if (req.getUrl().toString() == "/metrics") {
+      const std::string metrics = FormatMetrics(worker_metrics, adaptive_metrics);
+      res->end(metrics.data(), metrics.length());
     } else {
       // i guess this should be done more gracefully?
       res->end(nullptr, 0);
     }
   });
 
-  h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+  h.onConnection([&delivery](uWS::WebSocket<uWS::SERVER> ws,
+                            uWS::HttpRequest req) {
+    delivery.ws = ws;
+    delivery.connected = true;
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
-                         char *message, size_t length) {
+  h.onDisconnection([&delivery](uWS::WebSocket<uWS::SERVER> ws, int code,
+                                char *message, size_t length) {
+    delivery.connected = false;
+    delivery.pending.clear();
     ws.close();
     std::cout << "Disconnected" << std::endl;
   });
@@ -0,0 +1,440 @@
+// Replays telemetry through the preprocessing of main.cpp (PrepareMpcInput)
+// and MPC::Solve for several solver configurations and compares them side by
+// side: distribution of the solve time, solver iterations, exit statuses,
+// cost and the difference of the first steering angle to the first variant.
+//
+// Usage: mpc_benchmark [--log <file>]... [--track <waypoints.csv>]
+//                      [--frames N] [--repeat R] [variant]...
+//
+// The telemetry comes from logs of mpc (it prints every message it receives,
+// the 42["telemetry",...] lines are replayed) or, with --track, is
+// synthesized along the waypoints of a track, e.g. lake_track_waypoints.csv.
+// A variant is a comma separated list of options:
+//
+//   ipopt | sqp                    backend
+//   warm | cold                    warm start on / off, by default only sqp
+//                                  is warm started
+//   generated                      generated kernels instead of the CppAD tape
+//   retape                         CppAD::ipopt::solve, tapes every solve
+//   horizon=N, dt=, latency=, ref_v=, w_cte=, ..., max_a=   MPCConfig fields
+//   sqp_iterations=N, sqp_tolerance=x   termination of the SQP solver
+//   ipopt.<option>=<value>         any Ipopt option, e.g. ipopt.max_iter=20
+//   budget=ms                      AdaptiveMpc with this time budget (sqp)
+//
+// Without variants "ipopt", "ipopt,warm", "sqp" and "sqp,cold" are compared.
+
+#include <math.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "MPC.h"
+#include "adaptive_mpc.h"
+#include "telemetry.h"
+
+using namespace std;
+
+namespace {
+
+// A solver configuration of the comparison
+struct Variant {
+  string name;
+  MPC::Backend backend = MPC::Backend::IPOPT;
+  int warm_start = -1;  // -1 for the default of the backend
+  MPC::Derivatives derivatives = MPC::Derivatives::TAPE;
+  MPCConfig config;
+  int sqp_iterations = 0;
+  double sqp_tolerance = 1e-4;
+  vector<pair<string, string>> ipopt_options;
+  double budget_ms = 0;
+};
+
+// Results of one variant over all frames
+struct Result {
+  double first_ms;              // First solve, includes the problem setup
+  vector<double> times_ms;      // All later solves
+  vector<int> iterations;
+  map<string, size_t> statuses;
+  size_t successes;
+  double cost_sum;
+  vector<double> deltas;        // First steering angle of every solve
+  // AdaptiveMpc only
+  uint64_t deadline_misses;
+  uint64_t time_limited;
+  uint64_t level_changes;
+  map<size_t, size_t> horizons;  // Solves per horizon
+};
+
+bool ParseVariant(const string &text, Variant &variant) {
+  variant.name = text;
+  stringstream stream(text);
+  string option;
+  bool ipopt = false;  // Whether ipopt was given
+  while (getline(stream, option, ',')) {
+    const size_t equals = option.find('=');
+    const string key = option.substr(0, equals);
+    const string value = equals == string::npos ? "" : option.substr(equals + 1);
+    const double number = atof(value.c_str());
+    MPCConfig &config = variant.config;
+    if (key == "ipopt") {
+      variant.backend = MPC::Backend::IPOPT;
+      ipopt = true;
+    } else if (key == "sqp") {
+      variant.backend = MPC::Backend::SQP;
+      ipopt = false;
+    } else if (key == "warm") {
+      variant.warm_start = 1;
+    } else if (key == "cold") {
+      variant.warm_start = 0;
+    } else if (key == "generated") {
+      variant.derivatives = MPC::Derivatives::GENERATED;
+    } else if (key == "retape") {
+      variant.derivatives = MPC::Derivatives::RETAPE;
+    } else if (key.compare(0, 6, "ipopt.") == 0 && !value.empty()) {
+      variant.ipopt_options.push_back(make_pair(key.substr(6), value));
+    } else if (value.empty()) {
+      return false;
+    } else if (key == "horizon") {
+      config.N = strtoul(value.c_str(), NULL, 10);
+    } else if (key == "dt") {
+      config.dt = number;
+    } else if (key == "latency") {
+      config.latency = number;
+    } else if (key == "ref_v") {
+      config.ref_v = number;
+    } else if (key == "w_cte") {
+      config.w_cte = number;
+    } else if (key == "w_epsi") {
+      config.w_epsi = number;
+    } else if (key == "w_v") {
+      config.w_v = number;
+    } else if (key == "w_delta") {
+      config.w_delta = number;
+    } else if (key == "w_a") {
+      config.w_a = number;
+    } else if (key == "w_ddelta") {
+      config.w_ddelta = number;
+    } else if (key == "w_da") {
+      config.w_da = number;
+    } else if (key == "max_delta") {
+      config.max_delta = number;
+    } else if (key == "max_a") {
+      config.max_a = number;
+    } else if (key == "sqp_iterations") {
+      variant.sqp_iterations = atoi(value.c_str());
+    } else if (key == "sqp_tolerance") {
+      variant.sqp_tolerance = number;
+    } else if (key == "budget") {
+      variant.budget_ms = number;
+    } else {
+      return false;
+    }
+  }
+  // The time limit of Ipopt has not been tested against a real Ipopt yet,
+  // so a budget implies the sqp backend
+  if (variant.budget_ms > 0) {
+    if (ipopt) {
+      return false;
+    }
+    variant.backend = MPC::Backend::SQP;
+  }
+  return variant.config.N >= 2 &&
+         variant.config.N <= size_t(SqpSolverBase::kMaxSteps);
+}
+
+// Appends the telemetry frames of a log of mpc
+bool ReadLog(const string &path, vector<Telemetry> &frames) {
+  ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  string line;
+  while (getline(in, line)) {
+    Telemetry frame;
+    if (line.find("\"telemetry\"") != string::npos &&
+        ParseTelemetry(line, frame)) {
+      frames.push_back(frame);
+    }
+  }
+  return true;
+}
+
+// Synthesizes frames along the closed track of a waypoint file ("x,y" per
+// line after a header): the vehicle moves along the track with a varying
+// lateral offset, heading error and speed and sees the 6 waypoints from the
+// one behind it on, like in the simulator.
+bool SynthesizeFrames(const string &path, size_t count,
+                      vector<Telemetry> &frames) {
+  ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  vector<double> wx, wy;
+  string line;
+  getline(in, line);
+  while (getline(in, line)) {
+    double x, y;
+    char comma;
+    stringstream stream(line);
+    if (stream >> x >> comma >> y) {
+      wx.push_back(x);
+      wy.push_back(y);
+    }
+  }
+  const size_t n = wx.size();
+  if (n < 6) {
+    return false;
+  }
+  vector<double> arc(n + 1, 0.0);
+  for (size_t i = 0; i < n; ++i) {
+    arc[i + 1] = arc[i] + hypot(wx[(i + 1) % n] - wx[i], wy[(i + 1) % n] - wy[i]);
+  }
+
+  for (size_t k = 0; k < count; ++k) {
+    const double s = arc[n] * k / count;
+    size_t i = upper_bound(arc.begin(), arc.end(), s) - arc.begin() - 1;
+    const size_t j = (i + 1) % n;
+    const double f = (s - arc[i]) / (arc[i + 1] - arc[i]);
+    const double heading = atan2(wy[j] - wy[i], wx[j] - wx[i]);
+    const double offset = 1.0 * sin(2 * M_PI * k / 37.0);
+
+    Telemetry frame;
+    frame.x = wx[i] + f * (wx[j] - wx[i]) - offset * sin(heading);
+    frame.y = wy[i] + f * (wy[j] - wy[i]) + offset * cos(heading);
+    frame.psi = heading + 0.1 * sin(2 * M_PI * k / 23.0);
+    frame.speed = 40 + 15 * sin(2 * M_PI * k / 50.0);
+    frame.steering_angle = 0.05 * sin(2 * M_PI * k / 29.0);
+    frame.throttle = 0.3;
+    for (size_t p = 0; p < 6; ++p) {
+      const size_t w = (i + n - 1 + p) % n;
+      frame.ptsx.push_back(wx[w]);
+      frame.ptsy.push_back(wy[w]);
+    }
+    frames.push_back(frame);
+  }
+  return true;
+}
+
+Result Run(const Variant &variant, const vector<Telemetry> &frames,
+           size_t repeat) {
+  MPC mpc(variant.config);
+  mpc.SetBackend(variant.backend);
+  mpc.SetWarmStart(variant.warm_start < 0
+                       ? variant.backend == MPC::Backend::SQP
+                       : variant.warm_start != 0);
+  mpc.SetDerivatives(variant.derivatives);
+  mpc.SetVerbose(false);
+  if (variant.sqp_iterations > 0) {
+    mpc.SetSqpTermination(variant.sqp_iterations, variant.sqp_tolerance);
+  }
+  for (const auto &option : variant.ipopt_options) {
+    mpc.SetIpoptOption(option.first, option.second);
+  }
+
+  Result result = Result();
+  Eigen::VectorXd state, coeffs;
+  for (size_t r = 0; r < repeat; ++r) {
+    // every pass starts without a previous solution
+    mpc.SetConfig(mpc.GetConfig());
+    unique_ptr<AdaptiveMpc> adaptive;
+    if (variant.budget_ms > 0) {
+      adaptive.reset(new AdaptiveMpc(mpc, variant.budget_ms));
+      adaptive->SetVerbose(false);
+    }
+    for (const Telemetry &frame : frames) {
+      PrepareMpcInput(frame, mpc.GetConfig(), state, coeffs);
+      const vector<double> values = adaptive ? adaptive->Solve(state, coeffs)
+                                             : mpc.Solve(state, coeffs);
+      const MPCStats &stats = adaptive ? adaptive->GetStats() : mpc.GetStats();
+      if (adaptive) {
+        ++result.horizons[adaptive->GetMetrics().horizon];
+      }
+      if (r == 0 && &frame == &frames.front()) {
+        result.first_ms = stats.solve_time_ms;
+      } else {
+        result.times_ms.push_back(stats.solve_time_ms);
+      }
+      result.iterations.push_back(stats.iterations);
+      ++result.statuses[stats.status];
+      result.successes += stats.success;
+      result.cost_sum += stats.cost;
+      if (r == 0) {
+        result.deltas.push_back(values[0]);
+      }
+    }
+    if (adaptive) {
+      const AdaptiveMpcMetrics metrics = adaptive->GetMetrics();
+      result.deadline_misses += metrics.deadline_misses;
+      result.time_limited += metrics.time_limited;
+      result.level_changes += metrics.level_changes;
+    }
+  }
+  return result;
+}
+
+// Nearest rank percentile of sorted values
+double Percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(ceil(p * sorted.size()));
+  return sorted[max<size_t>(rank, 1) - 1];
+}
+
+void Report(const vector<Variant> &variants, const vector<Result> &results) {
+  size_t width = 10;
+  for (const Variant &variant : variants) {
+    width = max(width, variant.name.size() + 2);
+  }
+  // times in ms, the largest difference of the first steering angle to the
+  // first variant in rad
+  cout << fixed << setprecision(3);
+  cout << left << setw(width) << "variant" << right << setw(10) << "first"
+       << setw(9) << "mean" << setw(9) << "p50" << setw(9) << "p90"
+       << setw(9) << "p99" << setw(9) << "max" << setw(8) << "iter"
+       << setw(8) << "max" << setw(9) << "success" << setw(13) << "mean cost"
+       << setw(12) << "max ddelta" << endl;
+  for (size_t v = 0; v < variants.size(); ++v) {
+    const Result &result = results[v];
+    vector<double> times = result.times_ms;
+    sort(times.begin(), times.end());
+    double sum = 0;
+    for (double t : times) {
+      sum += t;
+    }
+    double iterations = 0;
+    int max_iterations = 0;
+    for (int i : result.iterations) {
+      iterations += i;
+      max_iterations = max(max_iterations, i);
+    }
+    const size_t solves = result.iterations.size();
+    double ddelta = 0;
+    for (size_t i = 0; i < result.deltas.size(); ++i) {
+      ddelta = max(ddelta, fabs(result.deltas[i] - results[0].deltas[i]));
+    }
+    cout << left << setw(width) << variants[v].name << right << setw(10)
+         << result.first_ms << setw(9)
+         << (times.empty() ? 0 : sum / times.size()) << setw(9)
+         << Percentile(times, 0.5) << setw(9) << Percentile(times, 0.9)
+         << setw(9) << Percentile(times, 0.99) << setw(9)
+         << (times.empty() ? 0 : times.back()) << setw(8) << setprecision(1)
+         << iterations / solves << setw(8) << max_iterations << setw(8)
+         << 100.0 * result.successes / solves << "%" << setprecision(4)
+         << scientific << setw(13) << result.cost_sum / solves << setw(12)
+         << ddelta << fixed << setprecision(3) << endl;
+  }
+
+  cout << endl << "exit statuses" << endl;
+  for (size_t v = 0; v < variants.size(); ++v) {
+    cout << "  " << variants[v].name << ":";
+    for (const auto &status : results[v].statuses) {
+      cout << " " << status.first << " " << status.second;
+    }
+    cout << endl;
+  }
+
+  bool adaptive = false;
+  for (const Variant &variant : variants) {
+    adaptive = adaptive || variant.budget_ms > 0;
+  }
+  if (!adaptive) {
+    return;
+  }
+  cout << endl << "time budgets" << endl;
+  for (size_t v = 0; v < variants.size(); ++v) {
+    const Result &result = results[v];
+    if (variants[v].budget_ms <= 0) {
+      continue;
+    }
+    cout << "  " << variants[v].name << ": " << result.deadline_misses
+         << " deadline misses, " << result.time_limited << " time limited, "
+         << result.level_changes << " level changes, horizons";
+    for (const auto &horizon : result.horizons) {
+      cout << " " << horizon.first << " " << horizon.second;
+    }
+    cout << endl;
+  }
+}
+
+void Usage(const char *program) {
+  cerr << "Usage: " << program
+       << " [--log <file>]... [--track <waypoints.csv>] [--frames N]"
+          " [--repeat R] [variant]..."
+       << endl
+       << "A variant is a comma separated list of: ipopt, sqp, warm, cold,"
+          " generated, retape, horizon=N, dt=, latency=, ref_v=, w_cte=, w_epsi=, w_v=,"
+          " w_delta=, w_a=, w_ddelta=, w_da=, max_delta=, max_a=,"
+          " sqp_iterations=, sqp_tolerance=, ipopt.<option>=<value>,"
+          " budget=ms (implies sqp)"
+       << endl;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  vector<string> logs;
+  string track;
+  size_t frame_count = 500;
+  size_t repeat = 1;
+  vector<Variant> variants;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if (arg == "--log" && i + 1 < argc) {
+      logs.push_back(argv[++i]);
+    } else if (arg == "--track" && i + 1 < argc) {
+      track = argv[++i];
+    } else if (arg == "--frames" && i + 1 < argc) {
+      frame_count = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = max<size_t>(1, strtoul(argv[++i], NULL, 10));
+    } else {
+      Variant variant;
+      if (arg.compare(0, 2, "--") == 0 || !ParseVariant(arg, variant)) {
+        Usage(argv[0]);
+        return -1;
+      }
+      variants.push_back(variant);
+    }
+  }
+  if (variants.empty()) {
+    for (const char *name : {"ipopt", "ipopt,warm", "sqp", "sqp,cold"}) {
+      Variant variant;
+      ParseVariant(name, variant);
+      variants.push_back(variant);
+    }
+  }
+
+  vector<Telemetry> frames;
+  for (const string &log : logs) {
+    if (!ReadLog(log, frames)) {
+      cerr << "Cannot read " << log << endl;
+      return -1;
+    }
+  }
+  if (!track.empty() && !SynthesizeFrames(track, frame_count, frames)) {
+    cerr << "Cannot read the waypoints of " << track << endl;
+    return -1;
+  }
+  if (frames.empty()) {
+    Usage(argv[0]);
+    cerr << "No telemetry, pass a log of mpc or a track" << endl;
+    return -1;
+  }
+
+  cout << frames.size() << " frames, " << repeat << " pass(es)" << endl
+       << endl;
+  vector<Result> results;
+  for (const Variant &variant : variants) {
+    results.push_back(Run(variant, frames, repeat));
+  }
+  Report(variants, results);
+  return 0;
+}
@@ -0,0 +1,493 @@
+// Ahead-of-time generator of the MPC derivative kernels.
+//
+// FG_eval is evaluated with a symbolic scalar which records an expression
+// graph (identical subexpressions are merged and constants are folded). The
+// graph is differentiated symbolically into the sparse Jacobian of fg and the
+// lower triangle of the Hessian of the Lagrangian, and all of it is emitted
+// as straight-line C++ with the parameters (polynomial coefficients,
+// reference speed and cost weights) as arguments. The horizon, the time step and Lf are
+// constants of the generated code, so one instance is emitted per horizon.
+//
+// Usage: mpc_codegen <output.cpp> <dt> <Lf> <N>...
+
+#include <math.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "fg_eval.h"
+
+using namespace std;
+
+namespace {
+
+//
+// Expression graph
+//
+enum Op { CONST, VAR, PARAM, WEIGHT, ADD, SUB, MUL, DIV, NEG, SIN, COS, ATAN };
+
+struct Node {
+  Op op;
+  int a, b;      // operands, the index of VAR, PARAM and WEIGHT leaves in a
+  double value;  // CONST
+};
+
+class Graph {
+ public:
+  void Clear() {
+    nodes_.clear();
+    index_.clear();
+    variables_.clear();
+    derivatives_.clear();
+  }
+
+  int Const(double value) { return Insert(Node{CONST, -1, -1, value}); }
+  int Leaf(Op op, int index) { return Insert(Node{op, index, -1, 0}); }
+  int Unary(Op op, int a);
+  int Binary(Op op, int a, int b);
+
+  // Partial derivative of node with respect to the variable var
+  int Derivative(int node, int var);
+
+  const Node &node(int i) const { return nodes_[i]; }
+  size_t size() const { return nodes_.size(); }
+  bool IsConst(int i, double value) const {
+    return nodes_[i].op == CONST && nodes_[i].value == value;
+  }
+
+  // Sorted indices of the variables node depends on
+  const vector<int> &Variables(int node) const { return variables_[node]; }
+
+ private:
+  int Insert(const Node &node);
+
+  vector<Node> nodes_;
+  map<tuple<int, int, int, double>, int> index_;
+  vector<vector<int>> variables_;
+  map<pair<int, int>, int> derivatives_;
+};
+
+Graph graph;
+
+int Graph::Insert(const Node &node) {
+  const auto key = make_tuple(int(node.op), node.a, node.b, node.value);
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    return found->second;
+  }
+  // the operands already exist, so the node indices are a topological order
+  vector<int> variables;
+  if (node.op == VAR) {
+    variables.push_back(node.a);
+  } else if (node.op >= ADD) {
+    variables = variables_[node.a];
+    if (node.b >= 0) {
+      vector<int> merged;
+      set_union(variables.begin(), variables.end(),
+                variables_[node.b].begin(), variables_[node.b].end(),
+                back_inserter(merged));
+      variables.swap(merged);
+    }
+  }
+  nodes_.push_back(node);
+  variables_.push_back(variables);
+  index_[key] = nodes_.size() - 1;
+  return nodes_.size() - 1;
+}
+
+int Graph::Unary(Op op, int a) {
+  const Node x = nodes_[a];
+  if (x.op == CONST) {
+    switch (op) {
+      case NEG: return Const(-x.value);
+      case SIN: return Const(sin(x.value));
+      case COS: return Const(cos(x.value));
+      default: return Const(atan(x.value));
+    }
+  }
+  if (op == NEG && x.op == NEG) {
+    return x.a;
+  }
+  return Insert(Node{op, a, -1, 0});
+}
+
+int Graph::Binary(Op op, int a, int b) {
+  const Node x = nodes_[a];
+  const Node y = nodes_[b];
+  if (x.op == CONST && y.op == CONST) {
+    switch (op) {
+      case ADD: return Const(x.value + y.value);
+      case SUB: return Const(x.value - y.value);
+      case MUL: return Const(x.value * y.value);
+      default: return Const(x.value / y.value);
+    }
+  }
+  switch (op) {
+    case ADD:
+      if (IsConst(a, 0)) return b;
+      if (IsConst(b, 0)) return a;
+      break;
+    case SUB:
+      if (IsConst(b, 0)) return a;
+      if (IsConst(a, 0)) return Unary(NEG, b);
+      if (a == b) return Const(0);
+      break;
+    case MUL:
+      if (IsConst(a, 0) || IsConst(b, 0)) return Const(0);
+      if (IsConst(a, 1)) return b;
+      if (IsConst(b, 1)) return a;
+      if (IsConst(a, -1)) return Unary(NEG, b);
+      if (IsConst(b, -1)) return Unary(NEG, a);
+      break;
+    default:
+      if (IsConst(a, 0)) return Const(0);
+      if (IsConst(b, 1)) return a;
+      break;
+  }
+  if ((op == ADD || op == MUL) && b < a) {
+    swap(a, b);
+  }
+  return Insert(Node{op, a, b, 0});
+}
+
+int Graph::Derivative(int node, int var) {
+  if (!binary_search(variables_[node].begin(), variables_[node].end(), var)) {
+    return Const(0);
+  }
+  const Node x = nodes_[node];
+  if (x.op == VAR) {
+    return Const(1);
+  }
+  const auto key = make_pair(node, var);
+  auto found = derivatives_.find(key);
+  if (found != derivatives_.end()) {
+    return found->second;
+  }
+
+  const int da = Derivative(x.a, var);
+  const int db = x.b >= 0 ? Derivative(x.b, var) : -1;
+  int result;
+  switch (x.op) {
+    case ADD:
+      result = Binary(ADD, da, db);
+      break;
+    case SUB:
+      result = Binary(SUB, da, db);
+      break;
+    case MUL:
+      result = Binary(ADD, Binary(MUL, da, x.b), Binary(MUL, x.a, db));
+      break;
+    case DIV:
+      // (da - (a / b) db) / b
+      result = Binary(DIV, Binary(SUB, da, Binary(MUL, node, db)), x.b);
+      break;
+    case NEG:
+      result = Unary(NEG, da);
+      break;
+    case SIN:
+      result = Binary(MUL, Unary(COS, x.a), da);
+      break;
+    case COS:
+      result = Unary(NEG, Binary(MUL, Unary(SIN, x.a), da));
+      break;
+    default:  // ATAN
+      result = Binary(DIV, da,
+                      Binary(ADD, Const(1), Binary(MUL, x.a, x.a)));
+      break;
+  }
+  derivatives_[key] = result;
+  return result;
+}
+
+//
+// Symbolic scalar FG_eval is evaluated with
+//
+struct Sym {
+  int id;
+
+  Sym(double value = 0) : id(graph.Const(value)) {}
+  static Sym Of(int id) {
+    Sym s;
+    s.id = id;
+    return s;
+  }
+
+  Sym &operator+=(const Sym &other) {
+    id = graph.Binary(ADD, id, other.id);
+    return *this;
+  }
+};
+
+Sym operator+(const Sym &a, const Sym &b) {
+  return Sym::Of(graph.Binary(ADD, a.id, b.id));
+}
+Sym operator-(const Sym &a, const Sym &b) {
+  return Sym::Of(graph.Binary(SUB, a.id, b.id));
+}
+Sym operator*(const Sym &a, const Sym &b) {
+  return Sym::Of(graph.Binary(MUL, a.id, b.id));
+}
+Sym operator/(const Sym &a, const Sym &b) {
+  return Sym::Of(graph.Binary(DIV, a.id, b.id));
+}
+Sym sin(const Sym &a) { return Sym::Of(graph.Unary(SIN, a.id)); }
+Sym cos(const Sym &a) { return Sym::Of(graph.Unary(COS, a.id)); }
+Sym atan(const Sym &a) { return Sym::Of(graph.Unary(ATAN, a.id)); }
+Sym pow(const Sym &a, int n) {
+  // only the small integer powers of FG_eval, expanded into products
+  Sym result(1.0);
+  for (int i = 0; i < n; ++i) {
+    result = result * a;
+  }
+  return result;
+}
+
+//
+// Emission
+//
+string Literal(double value) {
+  ostringstream out;
+  out.precision(17);
+  out << value;
+  string s = out.str();
+  if (s.find_first_of(".en") == string::npos) {
+    s += ".0";
+  }
+  return value < 0 ? "(" + s + ")" : s;
+}
+
+string Operand(int i) {
+  const Node &node = graph.node(i);
+  switch (node.op) {
+    case CONST: return Literal(node.value);
+    case VAR: return "x[" + to_string(node.a) + "]";
+    case PARAM: return "p[" + to_string(node.a) + "]";
+    case WEIGHT: return "w[" + to_string(node.a) + "]";
+    default: return "v" + to_string(i);
+  }
+}
+
+// Emits the body of a kernel which stores the roots into output[0..]
+// Returns the number of operations.
+size_t EmitBody(ostream &out, const vector<int> &roots, const string &output) {
+  vector<bool> used(graph.size(), false);
+  vector<int> stack(roots.begin(), roots.end());
+  while (!stack.empty()) {
+    const int i = stack.back();
+    stack.pop_back();
+    if (used[i]) {
+      continue;
+    }
+    used[i] = true;
+    const Node &node = graph.node(i);
+    if (node.op >= ADD) {
+      stack.push_back(node.a);
+      if (node.b >= 0) {
+        stack.push_back(node.b);
+      }
+    }
+  }
+
+  size_t operations = 0;
+  for (size_t i = 0; i < graph.size(); ++i) {
+    const Node &node = graph.node(i);
+    if (!used[i] || node.op < ADD) {
+      continue;
+    }
+    const string a = Operand(node.a);
+    const string b = node.b >= 0 ? Operand(node.b) : "";
+    string expression;
+    switch (node.op) {
+      case ADD: expression = a + " + " + b; break;
+      case SUB: expression = a + " - " + b; break;
+      case MUL: expression = a + " * " + b; break;
+      case DIV: expression = a + " / " + b; break;
+      case NEG: expression = "-" + a; break;
+      case SIN: expression = "sin(" + a + ")"; break;
+      case COS: expression = "cos(" + a + ")"; break;
+      default: expression = "atan(" + a + ")"; break;
+    }
+    out << "  const double v" << i << " = " << expression << ";\n";
+    ++operations;
+  }
+  for (size_t k = 0; k < roots.size(); ++k) {
+    out << "  " << output << "[" << k << "] = " << Operand(roots[k]) << ";\n";
+  }
+  return operations;
+}
+
+void EmitArray(ostream &out, const string &name, const vector<size_t> &values) {
+  out << "const size_t " << name << "[] = {";
+  for (size_t k = 0; k < values.size(); ++k) {
+    out << (k % 16 == 0 ? "\n    " : " ") << values[k]
+        << (k + 1 < values.size() ? "," : "");
+  }
+  out << "};\n";
+}
+
+// Emits the kernels of the horizon N, returns the initializer of its
+// GeneratedKernel
+string EmitInstance(ostream &out, size_t N, double dt, double Lf) {
+  MPCConfig config;
+  config.N = N;
+  config.dt = dt;
+  config.Lf = Lf;
+  const MPCLayout layout = config.Layout();
+  const size_t n_vars = layout.n_vars;
+  const size_t m = layout.n_constraints;
+  const size_t n_params = MPCConfig::kParameters;
+
+  graph.Clear();
+  vector<Sym> vars(n_vars), params(n_params), fg(m + 1);
+  for (size_t i = 0; i < n_vars; ++i) {
+    vars[i] = Sym::Of(graph.Leaf(VAR, i));
+  }
+  for (size_t i = 0; i < n_params; ++i) {
+    params[i] = Sym::Of(graph.Leaf(PARAM, i));
+  }
+  FG_eval<vector<Sym>> fg_eval(config, params);
+  fg_eval(fg, vars);
+
+  // Jacobian, row by row
+  vector<size_t> jac_rows, jac_cols;
+  vector<int> jacobian;
+  // (the variable sets are copied, differentiating adds nodes)
+  for (size_t i = 0; i <= m; ++i) {
+    const vector<int> variables = graph.Variables(fg[i].id);
+    for (int j : variables) {
+      const int d = graph.Derivative(fg[i].id, j);
+      if (!graph.IsConst(d, 0)) {
+        jac_rows.push_back(i);
+        jac_cols.push_back(j);
+        jacobian.push_back(d);
+      }
+    }
+  }
+
+  // lower triangle of the Hessian of sum_i w[i] fg[i]
+  map<pair<size_t, size_t>, int> lagrangian;
+  for (size_t i = 0; i <= m; ++i) {
+    const int weight = graph.Leaf(WEIGHT, i);
+    const vector<int> variables = graph.Variables(fg[i].id);
+    for (int j : variables) {
+      const int gradient = graph.Derivative(fg[i].id, j);
+      const vector<int> gradient_variables = graph.Variables(gradient);
+      for (int k : gradient_variables) {
+        if (k > j) {
+          break;
+        }
+        const int h = graph.Derivative(gradient, k);
+        if (graph.IsConst(h, 0)) {
+          continue;
+        }
+        const auto entry = make_pair(size_t(j), size_t(k));
+        const int term = graph.Binary(MUL, weight, h);
+        auto found = lagrangian.find(entry);
+        if (found == lagrangian.end()) {
+          lagrangian[entry] = term;
+        } else {
+          found->second = graph.Binary(ADD, found->second, term);
+        }
+      }
+    }
+  }
+  vector<size_t> hes_rows, hes_cols;
+  vector<int> hessian;
+  for (const auto &entry : lagrangian) {
+    hes_rows.push_back(entry.first.first);
+    hes_cols.push_back(entry.first.second);
+    hessian.push_back(entry.second);
+  }
+
+  const string suffix = to_string(N);
+  out << "//\n// N = " << N << "\n//\n";
+  EmitArray(out, "kJacobianRows" + suffix, jac_rows);
+  EmitArray(out, "kJacobianCols" + suffix, jac_cols);
+  EmitArray(out, "kHessianRows" + suffix, hes_rows);
+  EmitArray(out, "kHessianCols" + suffix, hes_cols);
+
+  vector<int> values;
+  for (const Sym &s : fg) {
+    values.push_back(s.id);
+  }
+  out << "\nvoid Fg" << suffix
+      << "(const double *x, const double *p, double *fg) {\n";
+  const size_t fg_operations = EmitBody(out, values, "fg");
+  out << "}\n\nvoid Jacobian" << suffix
+      << "(const double *x, const double *p, double *values) {\n";
+  const size_t jac_operations = EmitBody(out, jacobian, "values");
+  out << "}\n\nvoid Hessian" << suffix
+      << "(const double *x, const double *p, const double *w,\n"
+      << "    double *values) {\n";
+  const size_t hes_operations = EmitBody(out, hessian, "values");
+  out << "}\n\n";
+
+  cout << "N = " << N << ": fg " << fg_operations << " operations, Jacobian "
+       << jacobian.size() << " entries / " << jac_operations
+       << " operations, Hessian " << hessian.size() << " entries / "
+       << hes_operations << " operations" << endl;
+
+  ostringstream kernel;
+  kernel << "{" << N << ", " << Literal(dt) << ", " << Literal(Lf) << ", "
+         << n_vars << ", " << m << ", " << n_params << ",\n     "
+         << jacobian.size() << ", kJacobianRows" << suffix << ", kJacobianCols"
+         << suffix << ",\n     " << hessian.size() << ", kHessianRows" << suffix
+         << ", kHessianCols" << suffix << ",\n     Fg" << suffix << ", Jacobian"
+         << suffix << ", Hessian" << suffix << "}";
+  return kernel.str();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 5) {
+    cerr << "Usage: " << argv[0] << " <output.cpp> <dt> <Lf> <N>..." << endl;
+    return 1;
+  }
+  const double dt = strtod(argv[2], NULL);
+  const double Lf = strtod(argv[3], NULL);
+
+  ostringstream out;
+  out << "// Generated by mpc_codegen from src/fg_eval.h, do not edit.\n"
+      << "#include <math.h>\n#include \"fg_kernels.h\"\n\nnamespace {\n\n";
+  vector<string> kernels;
+  for (int i = 4; i < argc; ++i) {
+    const size_t N = strtoul(argv[i], NULL, 10);
+    if (N < 2) {
+      cerr << "Invalid horizon " << argv[i] << endl;
+      return 1;
+    }
+    kernels.push_back(EmitInstance(out, N, dt, Lf));
+  }
+  out << "const GeneratedKernel kKernels[] = {\n";
+  for (const string &kernel : kernels) {
+    out << "    " << kernel << ",\n";
+  }
+  out << "};\n\n}  // namespace\n\n"
+      << "const GeneratedKernel *FindGeneratedKernel(size_t N, double dt,\n"
+      << "                                           double Lf) {\n"
+      << "  for (const GeneratedKernel &kernel : kKernels) {\n"
+      << "    if (kernel.N == N && kernel.dt == dt && kernel.Lf == Lf) {\n"
+      << "      return &kernel;\n"
+      << "    }\n"
+      << "  }\n"
+      << "  return nullptr;\n"
+      << "}\n\n"
+      << "const GeneratedKernel *GeneratedKernels(size_t *count) {\n"
+      << "  *count = sizeof(kKernels) / sizeof(kKernels[0]);\n"
+      << "  return kKernels;\n"
+      << "}\n";
+
+  ofstream file(argv[1]);
+  file << out.str();
+  if (!file) {
+    cerr << "Cannot write " << argv[1] << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef MPC_CONFIG_H
+#define MPC_CONFIG_H
+
+#include <cstddef>
+
+// Offsets of the blocks of the variable vector for the horizon N: N values of
+// each of x, y, psi, v, cte, epsi followed by N - 1 values of each of delta,
+// a. The constraints have the layout of the state blocks.
+struct MPCLayout {
+  size_t N;
+  size_t x_start, y_start, psi_start, v_start, cte_start, epsi_start,
+      delta_start, a_start;
+  size_t n_vars;         // Number of variables
+  size_t n_constraints;  // Number of constraints
+
+  explicit MPCLayout(size_t N)
+      : N(N),
+        x_start(0),
+        y_start(x_start + N),
+        psi_start(y_start + N),
+        v_start(psi_start + N),
+        cte_start(v_start + N),
+        epsi_start(cte_start + N),
+        delta_start(epsi_start + N),
+        a_start(delta_start + N - 1),
+        n_vars(N * 6 + (N - 1) * 2),
+        n_constraints(N * 6) {}
+};
+
+// Parameters of the MPC problem. The horizon, the time step and Lf define the
+// structure of the problem, the reference speed, the cost weights and the
+// bounds can change between solves.
+struct MPCConfig {
+  size_t N;        // Number of time steps of the horizon
+  double dt;       // Time step of the model [s]
+  double Lf;       // Length from front to CoG [m]
+  double latency;  // Time the initial state is predicted ahead to cover the
+                   // actuation latency [s]
+  double ref_v;    // Reference speed
+
+  // Cost weights of the cross track error, the orientation error, the speed
+  // error, the use of the actuators and the gap between sequential
+  // actuations
+  double w_cte, w_epsi, w_v;
+  double w_delta, w_a;
+  double w_ddelta, w_da;
+
+  // Actuator limits, the steering angle is limited to 25 degrees (in radians)
+  double max_delta, max_a;
+
+  // This value of Lf assumes the model presented in the classroom is used.
+  //
+  // It was obtained by measuring the radius formed by running the vehicle in
+  // the simulator around in a circle with a constant steering angle and
+  // velocity on a flat terrain.
+  //
+  // Lf was tuned until the the radius formed by the simulating the model
+  // presented in the classroom matched the previous radius.
+  //
+  // This is the length from front to CoG that has a similar radius.
+  MPCConfig()
+      : N(10),
+        dt(0.08),
+        Lf(2.67),
+        latency(0.1),
+        ref_v(70),
+        w_cte(1),
+        w_epsi(1),
+        w_v(1),
+        w_delta(1),
+        w_a(1),
+        w_ddelta(1),
+        w_da(1),
+        max_delta(0.436332),
+        max_a(1.0) {}
+
+  MPCLayout Layout() const { return MPCLayout(N); }
+
+  // Number of parameters of FG_eval: the 4 polynomial coefficients, the
+  // reference speed and the 7 cost weights
+  static const size_t kParameters = 12;
+
+  // Fills the kParameters parameters of FG_eval
+  template <class Vector>
+  void Parameters(const double *coeffs, Vector &params) const {
+    for (int i = 0; i < 4; i++) {
+      params[i] = coeffs[i];
+    }
+    params[4] = ref_v;
+    params[5] = w_cte;
+    params[6] = w_epsi;
+    params[7] = w_v;
+    params[8] = w_delta;
+    params[9] = w_a;
+    params[10] = w_ddelta;
+    params[11] = w_da;
+  }
+};
+
+#endif /* MPC_CONFIG_H */
@@ -0,0 +1,286 @@
+// Computes the ExplicitTable of the MPC problem: samples the first optimal
+// actuations over a grid of the reduced problem coordinates (speed, offset
+// and heading error of the reference, quadratic and cubic coefficient) and
+// refines the grid adaptively. Every round estimates the interpolation error
+// in the middle of every interval of every axis (at random nodes of the
+// other axes) and splits the worst interval, until the error is below the
+// tolerance or the table would exceed the node limit. The table is
+// validated at random points afterwards.
+//
+// Usage: mpc_explicit_table <table> [ipopt|sqp] [--horizon N] [--ref-v v]
+//                           [--range <axis> <min> <max> <breakpoints>]...
+//                           [--tolerance e] [--max-nodes n] [--validate n]
+//
+// The axes are v, cte, epsi, c2 and c3, the tolerance is a fraction of the
+// actuator limits.
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "MPC.h"
+#include "explicit_mpc.h"
+
+using namespace std;
+
+namespace {
+
+const int kAxes = ExplicitTable::kAxes;
+const char *kAxisNames[kAxes] = {"v", "cte", "epsi", "c2", "c3"};
+
+// Optimal first actuations at the reduced coordinates point
+void Solve(MPC &mpc, const double *point, double &delta, double &a) {
+  Eigen::VectorXd state, coeffs;
+  ExplicitTable::Problem(point, state, coeffs);
+  const vector<double> result = mpc.Solve(state, coeffs);
+  delta = result[0];
+  a = result[1];
+}
+
+// Error of the actuations relative to the limits
+double Error(const MPCConfig &config, double delta, double a,
+             double true_delta, double true_a) {
+  return max(fabs(delta - true_delta) / config.max_delta,
+             fabs(a - true_a) / config.max_a);
+}
+
+// Solves the nodes of table, the ones which are also nodes of previous are
+// copied. Returns the number of solves.
+size_t Fill(MPC &mpc, ExplicitTable &table, const ExplicitTable *previous) {
+  size_t solves = 0;
+  for (size_t index = 0; index < table.size(); ++index) {
+    // the last axis varies fastest
+    size_t node[kAxes], old_node[kAxes];
+    double point[kAxes];
+    bool known = previous != nullptr;
+    size_t rest = index;
+    for (int k = kAxes - 1; k >= 0; --k) {
+      node[k] = rest % table.axis(k).size();
+      rest /= table.axis(k).size();
+      point[k] = table.axis(k)[node[k]];
+      if (known) {
+        const vector<double> &axis = previous->axis(k);
+        auto found = lower_bound(axis.begin(), axis.end(), point[k]);
+        known = found != axis.end() && *found == point[k];
+        old_node[k] = found - axis.begin();
+      }
+    }
+    if (known) {
+      const size_t old_index = previous->Index(old_node);
+      table.Set(index, previous->delta(old_index), previous->a(old_index));
+    } else {
+      double delta, a;
+      Solve(mpc, point, delta, a);
+      table.Set(index, delta, a);
+      ++solves;
+    }
+  }
+  return solves;
+}
+
+// Largest interpolation error in the middle of interval i of axis k at
+// random nodes of the other axes
+double IntervalError(MPC &mpc, const ExplicitTable &table, int k, size_t i,
+                     size_t samples, mt19937 &rng) {
+  double error = 0;
+  for (size_t s = 0; s < samples; ++s) {
+    size_t node[kAxes];
+    double point[kAxes];
+    for (int j = 0; j < kAxes; ++j) {
+      node[j] = uniform_int_distribution<size_t>(0, table.axis(j).size() - 1)(rng);
+      point[j] = table.axis(j)[node[j]];
+    }
+    node[k] = i;
+    point[k] = 0.5 * (table.axis(k)[i] + table.axis(k)[i + 1]);
+    const size_t lo = table.Index(node);
+    ++node[k];
+    const size_t hi = table.Index(node);
+    double delta, a;
+    Solve(mpc, point, delta, a);
+    error = max(error, Error(table.config(), 0.5 * (table.delta(lo) + table.delta(hi)),
+                             0.5 * (table.a(lo) + table.a(hi)), delta, a));
+  }
+  return error;
+}
+
+void Validate(MPC &mpc, const ExplicitTable &table, size_t count) {
+  mt19937 rng(7);
+  double max_error = 0, sum_error = 0;
+  double lookup_us = 0, solve_us = 0;
+  for (size_t p = 0; p < count; ++p) {
+    double point[kAxes];
+    for (int k = 0; k < kAxes; ++k) {
+      point[k] = uniform_real_distribution<double>(table.axis(k).front(),
+                                                   table.axis(k).back())(rng);
+    }
+    Eigen::VectorXd state, coeffs;
+    ExplicitTable::Problem(point, state, coeffs);
+
+    auto start = chrono::steady_clock::now();
+    double reduced[kAxes], delta, a;
+    ExplicitTable::Coordinates(state, coeffs, reduced);
+    table.Interpolate(reduced, delta, a);
+    auto end = chrono::steady_clock::now();
+    lookup_us += chrono::duration<double, micro>(end - start).count();
+
+    double true_delta, true_a;
+    Solve(mpc, point, true_delta, true_a);
+    solve_us += chrono::duration<double, micro>(chrono::steady_clock::now() -
+                                                end)
+                    .count();
+    const double error = Error(table.config(), delta, a, true_delta, true_a);
+    max_error = max(max_error, error);
+    sum_error += error;
+  }
+  cout << "Validation at " << count << " random points: mean error "
+       << sum_error / count << ", max error " << max_error
+       << " (of the limits)" << endl;
+  cout << "Lookup " << lookup_us / count << " us, online solve "
+       << solve_us / count << " us" << endl;
+}
+
+void Usage(const char *program) {
+  cerr << "Usage: " << program
+       << " <table> [ipopt|sqp] [--horizon N] [--ref-v v]"
+          " [--range <v|cte|epsi|c2|c3> <min> <max> <breakpoints>]..."
+          " [--tolerance e] [--max-nodes n] [--validate n]"
+       << endl;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    Usage(argv[0]);
+    return -1;
+  }
+  const string path = argv[1];
+  MPCConfig config;
+  MPC::Backend backend = MPC::Backend::SQP;
+  double tolerance = 0.02;
+  size_t max_nodes = 200000;
+  size_t validate = 500;
+  // default ranges cover the lake track at the reference speed
+  double ranges[kAxes][2] = {
+      {0, 100}, {-2, 2}, {-0.4, 0.4}, {-0.01, 0.01}, {-2e-4, 2e-4}};
+  size_t breakpoints[kAxes] = {6, 5, 5, 3, 3};
+  for (int i = 2; i < argc; ++i) {
+    const string arg = argv[i];
+    if (arg == "ipopt") {
+      backend = MPC::Backend::IPOPT;
+    } else if (arg == "sqp") {
+      backend = MPC::Backend::SQP;
+    } else if (arg == "--horizon" && i + 1 < argc) {
+      config.N = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--ref-v" && i + 1 < argc) {
+      config.ref_v = atof(argv[++i]);
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (arg == "--max-nodes" && i + 1 < argc) {
+      max_nodes = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--validate" && i + 1 < argc) {
+      validate = strtoul(argv[++i], NULL, 10);
+    } else if (arg == "--range" && i + 4 < argc) {
+      const string name = argv[++i];
+      int k = 0;
+      while (k < kAxes && name != kAxisNames[k]) {
+        ++k;
+      }
+      if (k == kAxes) {
+        Usage(argv[0]);
+        return -1;
+      }
+      ranges[k][0] = atof(argv[++i]);
+      ranges[k][1] = atof(argv[++i]);
+      breakpoints[k] = max<size_t>(2, strtoul(argv[++i], NULL, 10));
+    } else {
+      Usage(argv[0]);
+      return -1;
+    }
+  }
+  if (config.N < 2 || config.N > size_t(SqpSolverBase::kMaxSteps)) {
+    cerr << "The horizon has to be between 2 and " << SqpSolverBase::kMaxSteps
+         << endl;
+    return -1;
+  }
+
+  // every sample is a cold, tightly converged solve
+  MPC mpc(config);
+  mpc.SetBackend(backend);
+  mpc.SetWarmStart(false);
+  mpc.SetSqpTermination(50, 1e-8);
+  mpc.SetVerbose(false);
+
+  vector<double> axes[kAxes];
+  for (int k = 0; k < kAxes; ++k) {
+    for (size_t i = 0; i < breakpoints[k]; ++i) {
+      axes[k].push_back(ranges[k][0] + (ranges[k][1] - ranges[k][0]) * i /
+                                           (breakpoints[k] - 1));
+    }
+  }
+  ExplicitTable table;
+  table.Init(config, axes);
+  size_t solves = Fill(mpc, table, nullptr);
+
+  // error estimates of the intervals by axis and lower breakpoint, only the
+  // split intervals are estimated again
+  const size_t samples = 16;
+  mt19937 rng(1);
+  map<pair<int, double>, double> errors;
+  while (true) {
+    int worst_axis = -1;
+    size_t worst_interval = 0;
+    double worst_error = tolerance;
+    for (int k = 0; k < kAxes; ++k) {
+      for (size_t i = 0; i + 1 < table.axis(k).size(); ++i) {
+        const auto key = make_pair(k, table.axis(k)[i]);
+        if (errors.find(key) == errors.end()) {
+          errors[key] = IntervalError(mpc, table, k, i, samples, rng);
+          solves += samples;
+        }
+        if (errors[key] > worst_error) {
+          worst_error = errors[key];
+          worst_axis = k;
+          worst_interval = i;
+        }
+      }
+    }
+    if (worst_axis < 0 ||
+        table.size() / table.axis(worst_axis).size() *
+                (table.axis(worst_axis).size() + 1) >
+            max_nodes) {
+      break;
+    }
+    const int k = worst_axis;
+    const double lo = table.axis(k)[worst_interval];
+    const double mid = 0.5 * (lo + table.axis(k)[worst_interval + 1]);
+    cout << "Splitting " << kAxisNames[k] << " at " << mid << " (error "
+         << worst_error << ")" << endl;
+    axes[k].insert(axes[k].begin() + worst_interval + 1, mid);
+    errors.erase(make_pair(k, lo));
+
+    ExplicitTable refined;
+    refined.Init(config, axes);
+    solves += Fill(mpc, refined, &table);
+    table = refined;
+  }
+
+  cout << "Table of " << table.size() << " nodes (" << solves << " solves):";
+  for (int k = 0; k < kAxes; ++k) {
+    cout << " " << kAxisNames[k] << " " << table.axis(k).size();
+  }
+  cout << ", " << table.size() * 2 * sizeof(int16_t) / 1024 << " kB" << endl;
+  if (!table.Save(path)) {
+    cerr << "Cannot write " << path << endl;
+    return -1;
+  }
+  if (validate > 0) {
+    Validate(mpc, table, validate);
+  }
+  return 0;
+}
@@ -0,0 +1,178 @@
+#include "mpc_nlp.h"
+#include <algorithm>
+
+using namespace std;
+
+//
+// MpcNlp
+//
+MpcNlp::MpcNlp(FgKernels &fg)
+    : deadline(chrono::steady_clock::time_point::max()),
+      status(Ipopt::UNASSIGNED),
+      obj_value(0),
+      fg_(fg),
+      fg_values_(fg.m() + 1),
+      jacobian_(fg.JacobianRows().size()),
+      weights_(fg.m() + 1),
+      values_valid_(false),
+      jacobian_valid_(false) {
+  const vector<size_t> &rows = fg_.JacobianRows();
+  for (size_t k = 0; k < rows.size(); ++k) {
+    (rows[k] == 0 ? gradient_entries_ : constraint_entries_).push_back(k);
+  }
+}
+
+bool MpcNlp::get_nlp_info(Ipopt::Index &n, Ipopt::Index &m,
+                          Ipopt::Index &nnz_jac_g, Ipopt::Index &nnz_h_lag,
+                          IndexStyleEnum &index_style) {
+  n = fg_.n();
+  m = fg_.m();
+  nnz_jac_g = constraint_entries_.size();
+  nnz_h_lag = fg_.HessianRows().size();
+  index_style = C_STYLE;
+  return true;
+}
+
+bool MpcNlp::get_bounds_info(Ipopt::Index n, Ipopt::Number *x_l,
+                             Ipopt::Number *x_u, Ipopt::Index m,
+                             Ipopt::Number *g_l, Ipopt::Number *g_u) {
+  copy(this->x_l.begin(), this->x_l.begin() + n, x_l);
+  copy(this->x_u.begin(), this->x_u.begin() + n, x_u);
+  copy(this->g_l.begin(), this->g_l.begin() + m, g_l);
+  copy(this->g_u.begin(), this->g_u.begin() + m, g_u);
+  return true;
+}
+
+bool MpcNlp::get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number *x,
+                                bool init_z, Ipopt::Number *z_L,
+                                Ipopt::Number *z_U, Ipopt::Index m,
+                                bool init_lambda, Ipopt::Number *lambda) {
+  if (init_x) {
+    copy(x_start.begin(), x_start.begin() + n, x);
+  }
+  if (init_z) {
+    if (z_l_start.size() != size_t(n) || z_u_start.size() != size_t(n)) {
+      return false;
+    }
+    copy(z_l_start.begin(), z_l_start.end(), z_L);
+    copy(z_u_start.begin(), z_u_start.end(), z_U);
+  }
+  if (init_lambda) {
+    if (lambda_start.size() != size_t(m)) {
+      return false;
+    }
+    copy(lambda_start.begin(), lambda_start.end(), lambda);
+  }
+  values_valid_ = jacobian_valid_ = false;
+  return true;
+}
+
+void MpcNlp::UpdateValues(const Ipopt::Number *x, bool new_x) {
+  if (new_x) {
+    values_valid_ = jacobian_valid_ = false;
+  }
+  if (!values_valid_) {
+    fg_.Evaluate(x, &fg_values_[0]);
+    values_valid_ = true;
+  }
+}
+
+void MpcNlp::UpdateJacobian(const Ipopt::Number *x, bool new_x) {
+  if (new_x) {
+    values_valid_ = jacobian_valid_ = false;
+  }
+  if (!jacobian_valid_) {
+    fg_.Jacobian(x, &jacobian_[0]);
+    jacobian_valid_ = true;
+  }
+}
+
+bool MpcNlp::eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                    Ipopt::Number &obj_value) {
+  UpdateValues(x, new_x);
+  obj_value = fg_values_[0];
+  return true;
+}
+
+bool MpcNlp::eval_grad_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                         Ipopt::Number *grad_f) {
+  UpdateJacobian(x, new_x);
+  fill(grad_f, grad_f + n, 0.0);
+  for (size_t k : gradient_entries_) {
+    grad_f[fg_.JacobianCols()[k]] = jacobian_[k];
+  }
+  return true;
+}
+
+bool MpcNlp::eval_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                    Ipopt::Index m, Ipopt::Number *g) {
+  UpdateValues(x, new_x);
+  copy(fg_values_.begin() + 1, fg_values_.end(), g);
+  return true;
+}
+
+bool MpcNlp::eval_jac_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                        Ipopt::Index m, Ipopt::Index nele_jac,
+                        Ipopt::Index *iRow, Ipopt::Index *jCol,
+                        Ipopt::Number *values) {
+  if (values == NULL) {
+    for (size_t i = 0; i < constraint_entries_.size(); ++i) {
+      const size_t k = constraint_entries_[i];
+      iRow[i] = fg_.JacobianRows()[k] - 1;
+      jCol[i] = fg_.JacobianCols()[k];
+    }
+    return true;
+  }
+  UpdateJacobian(x, new_x);
+  for (size_t i = 0; i < constraint_entries_.size(); ++i) {
+    values[i] = jacobian_[constraint_entries_[i]];
+  }
+  return true;
+}
+
+bool MpcNlp::eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                    Ipopt::Number obj_factor, Ipopt::Index m,
+                    const Ipopt::Number *lambda, bool new_lambda,
+                    Ipopt::Index nele_hess, Ipopt::Index *iRow,
+                    Ipopt::Index *jCol, Ipopt::Number *values) {
+  if (values == NULL) {
+    for (Ipopt::Index k = 0; k < nele_hess; ++k) {
+      iRow[k] = fg_.HessianRows()[k];
+      jCol[k] = fg_.HessianCols()[k];
+    }
+    return true;
+  }
+  if (new_x) {
+    values_valid_ = jacobian_valid_ = false;
+  }
+  weights_[0] = obj_factor;
+  copy(lambda, lambda + m, weights_.begin() + 1);
+  fg_.Hessian(x, &weights_[0], values);
+  return true;
+}
+
+bool MpcNlp::intermediate_callback(
+    Ipopt::AlgorithmMode mode, Ipopt::Index iter, Ipopt::Number obj_value,
+    Ipopt::Number inf_pr, Ipopt::Number inf_du, Ipopt::Number mu,
+    Ipopt::Number d_norm, Ipopt::Number regularization_size,
+    Ipopt::Number alpha_du, Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+    const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  return chrono::steady_clock::now() < deadline;
+}
+
+void MpcNlp::finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n,
+                               const Ipopt::Number *x,
+                               const Ipopt::Number *z_L,
+                               const Ipopt::Number *z_U, Ipopt::Index m,
+                               const Ipopt::Number *g,
+                               const Ipopt::Number *lambda,
+                               Ipopt::Number obj_value,
+                               const Ipopt::IpoptData *ip_data,
+                               Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  this->status = status;
+  this->x.assign(x, x + n);
+  this->z_l.assign(z_L, z_L + n);
+  this->z_u.assign(z_U, z_U + n);
+  this->lambda.assign(lambda, lambda + m);
+  this->obj_value = obj_value;
+}
@@ -0,0 +1,88 @@
+#ifndef MPC_NLP_H
+#define MPC_NLP_H
+
+#include <coin/IpTNLP.hpp>
+#include <chrono>
+#include <vector>
+#include "fg_kernels.h"
+
+// Ipopt view of an FgKernels. The bounds and the starting point are set before
+// every solve, the solution and the multipliers are kept for a warm start of
+// the next one.
+class MpcNlp : public Ipopt::TNLP {
+ public:
+  explicit MpcNlp(FgKernels &fg);
+
+  // Bounds of the variables and of the constraints
+  std::vector<double> x_l, x_u, g_l, g_u;
+
+  // Starting point, the multipliers are only used if Ipopt is asked for a
+  // warm start (warm_start_init_point)
+  std::vector<double> x_start, z_l_start, z_u_start, lambda_start;
+
+  // Wall clock time after which Ipopt is stopped at the next iteration
+  // (User_Requested_Stop), time_point::max() by default. Unlike
+  // max_cpu_time it does not count the CPU time of other threads.
+  std::chrono::steady_clock::time_point deadline;
+
+  // Solution of the last solve
+  Ipopt::SolverReturn status;
+  std::vector<double> x, z_l, z_u, lambda;
+  double obj_value;
+
+  // Ipopt::TNLP
+  bool get_nlp_info(Ipopt::Index &n, Ipopt::Index &m, Ipopt::Index &nnz_jac_g,
+                    Ipopt::Index &nnz_h_lag,
+                    IndexStyleEnum &index_style) override;
+  bool get_bounds_info(Ipopt::Index n, Ipopt::Number *x_l, Ipopt::Number *x_u,
+                       Ipopt::Index m, Ipopt::Number *g_l,
+                       Ipopt::Number *g_u) override;
+  bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number *x,
+                          bool init_z, Ipopt::Number *z_L, Ipopt::Number *z_U,
+                          Ipopt::Index m, bool init_lambda,
+                          Ipopt::Number *lambda) override;
+  bool eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+              Ipopt::Number &obj_value) override;
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                   Ipopt::Number *grad_f) override;
+  bool eval_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+              Ipopt::Index m, Ipopt::Number *g) override;
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                  Ipopt::Index m, Ipopt::Index nele_jac, Ipopt::Index *iRow,
+                  Ipopt::Index *jCol, Ipopt::Number *values) override;
+  bool eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+              Ipopt::Number obj_factor, Ipopt::Index m,
+              const Ipopt::Number *lambda, bool new_lambda,
+              Ipopt::Index nele_hess, Ipopt::Index *iRow, Ipopt::Index *jCol,
+              Ipopt::Number *values) override;
+  bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter,
+                             Ipopt::Number obj_value, Ipopt::Number inf_pr,
+                             Ipopt::Number inf_du, Ipopt::Number mu,
+                             Ipopt::Number d_norm,
+                             Ipopt::Number regularization_size,
+                             Ipopt::Number alpha_du, Ipopt::Number alpha_pr,
+                             Ipopt::Index ls_trials,
+                             const Ipopt::IpoptData *ip_data,
+                             Ipopt::IpoptCalculatedQuantities *ip_cq) override;
+  void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n,
+                         const Ipopt::Number *x, const Ipopt::Number *z_L,
+                         const Ipopt::Number *z_U, Ipopt::Index m,
+                         const Ipopt::Number *g, const Ipopt::Number *lambda,
+                         Ipopt::Number obj_value,
+                         const Ipopt::IpoptData *ip_data,
+                         Ipopt::IpoptCalculatedQuantities *ip_cq) override;
+
+ private:
+  // Updates the cached fg values / Jacobian for x if it changed
+  void UpdateValues(const Ipopt::Number *x, bool new_x);
+  void UpdateJacobian(const Ipopt::Number *x, bool new_x);
+
+  FgKernels &fg_;
+  std::vector<double> fg_values_, jacobian_, weights_;
+  bool values_valid_, jacobian_valid_;
+  // entries of the fg Jacobian which belong to the objective gradient (row 0)
+  // and to the constraint Jacobian (rows >= 1)
+  std::vector<size_t> gradient_entries_, constraint_entries_;
+};
+
+#endif /* MPC_NLP_H */
@@ -0,0 +1,97 @@
+#include "mpc_worker.h"
+#include <algorithm>
+
+using namespace std;
+
+static double Milliseconds(chrono::steady_clock::duration duration) {
+  return chrono::duration<double, milli>(duration).count();
+}
+
+MpcWorker::MpcWorker(const Handler &handler, const function<void()> &notify)
+    : handler_(handler),
+      notify_(notify),
+      stop_(false),
+      has_frame_(false),
+      has_result_(false),
+      metrics_() {
+  thread_ = thread(&MpcWorker::Run, this);
+}
+
+MpcWorker::~MpcWorker() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+void MpcWorker::Post(const Telemetry &telemetry) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    ++metrics_.received;
+    if (has_frame_) {
+      ++metrics_.dropped;
+    }
+    frame_ = telemetry;
+    has_frame_ = true;
+  }
+  wake_.notify_one();
+}
+
+bool MpcWorker::TakeResult(Result &result) {
+  lock_guard<mutex> lock(mutex_);
+  if (!has_result_) {
+    return false;
+  }
+  result = std::move(result_);
+  has_result_ = false;
+  return true;
+}
+
+void MpcWorker::RecordDelivery(const Result &result) {
+  const double age =
+      Milliseconds(chrono::steady_clock::now() - result.received);
+  lock_guard<mutex> lock(mutex_);
+  ++metrics_.delivered;
+  metrics_.last_delivery_ms = age;
+  metrics_.max_delivery_ms = max(metrics_.max_delivery_ms, age);
+}
+
+MpcWorkerMetrics MpcWorker::GetMetrics() const {
+  lock_guard<mutex> lock(mutex_);
+  return metrics_;
+}
+
+void MpcWorker::Run() {
+  Telemetry frame;
+  while (true) {
+    {
+      unique_lock<mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || has_frame_; });
+      if (stop_) {
+        return;
+      }
+      frame = std::move(frame_);
+      has_frame_ = false;
+    }
+
+    const auto start = chrono::steady_clock::now();
+    Result result;
+    result.message = handler_(frame);
+    result.received = frame.received;
+    result.solved = chrono::steady_clock::now();
+
+    {
+      lock_guard<mutex> lock(mutex_);
+      ++metrics_.solved;
+      metrics_.last_queue_ms = Milliseconds(start - frame.received);
+      metrics_.max_queue_ms =
+          max(metrics_.max_queue_ms, metrics_.last_queue_ms);
+      metrics_.last_solve_ms = Milliseconds(result.solved - start);
+      result_ = std::move(result);
+      has_result_ = true;
+    }
+    notify_();
+  }
+}
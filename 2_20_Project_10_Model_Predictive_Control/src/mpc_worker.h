@@ -0,0 +1,84 @@
+#ifndef MPC_WORKER_H
+#define MPC_WORKER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "telemetry.h"
+
+// Counters and frame ages of an MpcWorker
+struct MpcWorkerMetrics {
+  uint64_t received;   // Frames posted
+  uint64_t dropped;    // Frames replaced by a newer one before they were solved
+  uint64_t solved;     // Frames solved
+  uint64_t delivered;  // Results sent to the simulator
+  double last_queue_ms;     // Age of the last solved frame at the start of
+                            // its solve
+  double max_queue_ms;      // ... the largest one
+  double last_solve_ms;     // Duration of the last solve
+  double last_delivery_ms;  // Age of the last delivered frame at sending,
+                            // including the simulated latency
+  double max_delivery_ms;   // ... the largest one
+};
+
+// Runs the MPC of the telemetry frames on a dedicated thread.
+//
+// The frames are passed through a single slot mailbox: a frame which arrives
+// while the previous one still waits replaces it (and is counted as
+// dropped), so the worker always solves the latest frame and a slow solve
+// never builds up a backlog of stale frames. The results are kept in a
+// single slot as well and the notify callback tells the event loop to
+// collect them.
+class MpcWorker {
+ public:
+  // Computes the message for a frame, runs on the worker thread
+  typedef std::function<std::string(const Telemetry &)> Handler;
+
+  // A result of the worker
+  struct Result {
+    std::string message;
+    std::chrono::steady_clock::time_point received;  // Arrival of the frame
+    std::chrono::steady_clock::time_point solved;    // End of the solve
+  };
+
+  // Starts the worker thread. notify is called on the worker thread after
+  // every result, it has to be thread safe (e.g. uS::Async::send).
+  MpcWorker(const Handler &handler, const std::function<void()> &notify);
+
+  // Stops and joins the worker thread, a frame in the mailbox is discarded
+  ~MpcWorker();
+
+  // Hands a frame to the worker, replaces a waiting one
+  void Post(const Telemetry &telemetry);
+
+  // Takes the latest result, returns false if there is none
+  bool TakeResult(Result &result);
+
+  // Records the delivery of a result to the simulator
+  void RecordDelivery(const Result &result);
+
+  MpcWorkerMetrics GetMetrics() const;
+
+ private:
+  void Run();
+
+  Handler handler_;
+  std::function<void()> notify_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+  bool has_frame_;
+  Telemetry frame_;  // the mailbox
+  bool has_result_;
+  Result result_;
+  MpcWorkerMetrics metrics_;
+
+  std::thread thread_;
+};
+
+#endif /* MPC_WORKER_H */
@@ -0,0 +1,221 @@
+#include "multi_start_mpc.h"
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <string>
+
+using namespace std;
+
+vector<MultiStartMpc::Candidate> MultiStartMpc::DefaultCandidates(
+    double ref_v) {
+  return {{ref_v, Seed::WARM},
+          {ref_v, Seed::COLD},
+          {0.85 * ref_v, Seed::WARM},
+          {ref_v, Seed::HOLD}};
+}
+
+MultiStartMpc::MultiStartMpc(const MPC &prototype,
+                             const vector<Candidate> &candidates,
+                             size_t threads, double deadline_ms)
+    : config_(prototype.GetConfig()),
+      deadline_(static_cast<long>(deadline_ms * 1000)),
+      verbose_(true),
+      stats_(),
+      cycle_(0),
+      scorer_(MakeSqpSolver(config_.N)),
+      pool_(prototype.GetBackend() == MPC::Backend::IPOPT ? 1 : threads) {
+  scorer_->Init(config_);
+  for (const Candidate &candidate : candidates) {
+    unique_ptr<Slot> slot(new Slot());
+    slot->candidate = candidate;
+    MPCConfig config = config_;
+    config.ref_v = candidate.ref_v;
+    slot->mpc.reset(new MPC(config));
+    slot->mpc->SetBackend(prototype.GetBackend());
+    slot->mpc->SetDerivatives(prototype.GetDerivatives());
+    slot->mpc->SetWarmStart(false);
+    slot->mpc->SetVerbose(false);
+    slot->busy = false;
+    slot->finished = false;
+    slot->cycle = 0;
+    slot->success = false;
+    slots_.push_back(std::move(slot));
+  }
+}
+
+MultiStartMpc::~MultiStartMpc() {
+  unique_lock<mutex> lock(mutex_);
+  done_.wait(lock, [this] {
+    for (const auto &slot : slots_) {
+      if (slot->busy) {
+        return false;
+      }
+    }
+    return true;
+  });
+}
+
+void MultiStartMpc::Run(Slot &slot) {
+  // a candidate which waited for the others until the deadline is skipped
+  const double remaining_ms =
+      chrono::duration<double, milli>(slot.deadline -
+                                      chrono::steady_clock::now())
+          .count();
+  if (remaining_ms <= 0) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      slot.busy = false;
+    }
+    done_.notify_all();
+    return;
+  }
+  slot.mpc->SetTimeLimit(remaining_ms);
+  slot.mpc->Solve(slot.state, slot.coeffs);
+  slot.mpc->GetActuations(slot.actuations);
+  slot.success = slot.mpc->GetStats().success;
+  {
+    lock_guard<mutex> lock(mutex_);
+    slot.busy = false;
+    slot.finished = slot.cycle == cycle_;
+  }
+  done_.notify_all();
+}
+
+double MultiStartMpc::NominalCost(const Eigen::VectorXd &state,
+                                  const Eigen::VectorXd &coeffs,
+                                  const vector<double> &actuations) {
+  for (size_t t = 0; t + 1 < config_.N; ++t) {
+    scorer_->SetActuation(
+        t, max(-config_.max_delta, min(config_.max_delta, actuations[2 * t])),
+        max(-config_.max_a, min(config_.max_a, actuations[2 * t + 1])));
+  }
+  scorer_->Simulate(state, coeffs);
+  return scorer_->cost();
+}
+
+vector<double> MultiStartMpc::Solve(const Eigen::VectorXd &state,
+                                    const Eigen::VectorXd &coeffs) {
+  const auto start = chrono::steady_clock::now();
+  const size_t steps = config_.N - 1;
+
+  // initial guesses from the previous selection
+  vector<double> warm, hold;
+  if (!previous_.empty()) {
+    warm.assign(previous_.begin() + 2, previous_.end());
+    warm.push_back(previous_[2 * steps - 2]);
+    warm.push_back(previous_[2 * steps - 1]);
+    for (size_t t = 0; t < steps; ++t) {
+      hold.push_back(previous_[0]);
+      hold.push_back(previous_[1]);
+    }
+  }
+
+  stats_ = MultiStartStats();
+  {
+    lock_guard<mutex> lock(mutex_);
+    ++cycle_;
+    for (auto &pointer : slots_) {
+      Slot &slot = *pointer;
+      slot.finished = false;
+      if (slot.busy) {
+        continue;
+      }
+      slot.busy = true;
+      slot.cycle = cycle_;
+      slot.deadline = start + deadline_;
+      slot.state = state;
+      slot.coeffs = coeffs;
+      const Seed seed = slot.candidate.seed;
+      slot.mpc->SetInitialActuations(
+          seed == Seed::WARM ? warm : seed == Seed::HOLD ? hold
+                                                         : vector<double>());
+      ++stats_.started;
+      pool_.Submit([this, &slot] { Run(slot); });
+    }
+  }
+
+  // wait for the candidates of this cycle until the deadline. Which ones
+  // finished is copied under the lock: a candidate which finishes later
+  // writes its result while the selection below runs.
+  vector<bool> finished(slots_.size(), false);
+  {
+    unique_lock<mutex> lock(mutex_);
+    done_.wait_until(lock, start + deadline_, [this] {
+      for (const auto &slot : slots_) {
+        if (slot->cycle == cycle_ && !slot->finished) {
+          return false;
+        }
+      }
+      return true;
+    });
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      finished[i] = slots_[i]->finished;
+      stats_.finished += finished[i];
+    }
+  }
+
+  // The slots which finished by the deadline are not touched by the workers
+  // until the next cycle starts them again. The best converged candidate by
+  // the nominal cost, the best finished one if none converged.
+  stats_.selected = -1;
+  double best_cost = numeric_limits<double>::infinity();
+  bool best_success = false;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    const Slot &slot = *slots_[i];
+    if (!finished[i]) {
+      continue;
+    }
+    stats_.feasible += slot.success;
+    const double cost = NominalCost(state, coeffs, slot.actuations);
+    if (!isfinite(cost)) {
+      continue;
+    }
+    if (stats_.selected < 0 || (slot.success && !best_success) ||
+        (slot.success == best_success && cost < best_cost)) {
+      best_cost = cost;
+      best_success = slot.success;
+      stats_.selected = static_cast<int>(i);
+    }
+  }
+
+  vector<double> actuations;
+  if (stats_.selected >= 0) {
+    actuations = slots_[stats_.selected]->actuations;
+  } else if (!warm.empty()) {
+    actuations = warm;
+  } else {
+    actuations.assign(2 * steps, 0.0);
+  }
+  stats_.cost = NominalCost(state, coeffs, actuations);
+  previous_.resize(2 * steps);
+  for (size_t t = 0; t < steps; ++t) {
+    previous_[2 * t] = scorer_->delta(t);
+    previous_[2 * t + 1] = scorer_->a(t);
+  }
+
+  vector<double> result;
+  result.push_back(scorer_->delta(0));
+  result.push_back(scorer_->a(0));
+  for (size_t t = 0; t < config_.N; ++t) {
+    result.push_back(scorer_->state(t)[0]);
+    result.push_back(scorer_->state(t)[1]);
+  }
+
+  stats_.solve_time_ms = chrono::duration<double, milli>(
+                             chrono::steady_clock::now() - start)
+                             .count();
+  if (verbose_) {
+    cout << "Multi-start " << stats_.solve_time_ms << " ms, "
+         << stats_.finished << "/" << stats_.started << " finished, "
+         << stats_.feasible << " converged, ";
+    if (stats_.selected >= 0) {
+      cout << "candidate " << stats_.selected << " (ref_v "
+           << slots_[stats_.selected]->candidate.ref_v << ")";
+    } else {
+      cout << "fallback";
+    }
+    cout << ", cost " << stats_.cost << endl;
+  }
+  return result;
+}
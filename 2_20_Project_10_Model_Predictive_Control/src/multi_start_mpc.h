@@ -0,0 +1,120 @@
+#ifndef MULTI_START_MPC_H
+#define MULTI_START_MPC_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "thread_pool.h"
+
+// Statistics of the last multi-start solve
+struct MultiStartStats {
+  double solve_time_ms;  // Wall time including the wait for the candidates
+  size_t started;        // Candidates started, a candidate which still runs
+                         // from an earlier cycle is skipped
+  size_t finished;       // Candidates finished before the deadline
+  size_t feasible;       // ... of which converged
+  int selected;          // Index of the selected candidate, -1 if the
+                         // fallback was used
+  double cost;           // Nominal cost of the returned actuations
+};
+
+// Solves several variants of the MPC problem concurrently on a thread pool
+// and selects the best one within a deadline.
+//
+// Every candidate has its own MPC with its reference speed and one of the
+// initial guesses below. The candidates which converge before the deadline
+// are compared by the cost of their actuations on the nominal problem (the
+// costs of the candidates themselves differ by their reference speed), so a
+// lower reference speed only wins where it drives better by the nominal
+// objective, e.g. when the nominal solve fails in a tight curve. If no
+// candidate converges in time the best finished one is used, and if none
+// finished at all the previous selection advanced by one step (or zero
+// actuations on the first cycle). Every candidate is limited to the rest of
+// the deadline with MPC::SetTimeLimit, one which still misses it keeps
+// running and is skipped until it finished.
+//
+// Ipopt (with MUMPS) and the recording of CppAD tapes must not run on
+// several threads at once, so the Ipopt candidates run one after the other
+// on a single thread, each within the time left until the deadline.
+class MultiStartMpc {
+ public:
+  // Initial guesses of a candidate
+  enum class Seed {
+    WARM,  // The previous selection advanced by one step
+    COLD,  // Zero actuations
+    HOLD   // The first actuations of the previous selection held over the
+           // horizon
+  };
+
+  struct Candidate {
+    double ref_v;
+    Seed seed;
+  };
+
+  // Candidates of the default multi-start: the nominal reference speed warm
+  // and cold, 85 % of it warm and the held actuations
+  static std::vector<Candidate> DefaultCandidates(double ref_v);
+
+  // The candidates use the backend and the derivatives of prototype, the
+  // config of prototype is the nominal problem. threads is ignored for the
+  // Ipopt backend, which uses one.
+  MultiStartMpc(const MPC &prototype, const std::vector<Candidate> &candidates,
+                size_t threads, double deadline_ms);
+
+  // Waits for candidates which still run
+  ~MultiStartMpc();
+
+  // Same result as MPC::Solve: the first actuations and the predicted x, y
+  vector<double> Solve(const Eigen::VectorXd &state,
+                       const Eigen::VectorXd &coeffs);
+
+  const MultiStartStats &GetStats() const { return stats_; }
+
+  // Prints the outcome of every solve (on by default)
+  void SetVerbose(bool verbose) { verbose_ = verbose; }
+
+ private:
+  // A candidate and the result of its last solve. The worker thread owns
+  // everything but busy while the candidate runs.
+  struct Slot {
+    Candidate candidate;
+    std::unique_ptr<MPC> mpc;
+    bool busy;       // Running, guarded by mutex_
+    bool finished;   // Finished in the current cycle, guarded by mutex_
+    size_t cycle;    // Cycle of the last start
+    std::chrono::steady_clock::time_point deadline;  // ... and its deadline
+    Eigen::VectorXd state, coeffs;
+    vector<double> actuations;
+    bool success;
+  };
+
+  void Run(Slot &slot);
+
+  // Nominal cost of the actuations, simulated from the initial state
+  double NominalCost(const Eigen::VectorXd &state,
+                     const Eigen::VectorXd &coeffs,
+                     const vector<double> &actuations);
+
+  MPCConfig config_;  // Nominal problem
+  std::chrono::microseconds deadline_;
+  bool verbose_;
+  MultiStartStats stats_;
+  size_t cycle_;
+  vector<double> previous_;  // Actuations of the previous selection
+
+  // Evaluates the candidates on the nominal problem
+  std::unique_ptr<SqpSolverBase> scorer_;
+
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::vector<std::unique_ptr<Slot>> slots_;
+
+  // Last, so the threads are joined before the slots are destroyed
+  ThreadPool pool_;
+};
+
+#endif /* MULTI_START_MPC_H */
@@ -0,0 +1,352 @@
+#include "sqp_solver.h"
+#include <math.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+SqpSolverBase::SqpSolverBase()
+    : N_(0),
+      n_(0),
+      max_iterations_(10),
+      tolerance_(1e-4),
+      deadline_(std::chrono::steady_clock::time_point::max()),
+      cost_(0),
+      iterations_(0),
+      timed_out_(false) {
+  memset(coeffs_, 0, sizeof(coeffs_));
+}
+
+void SqpSolverBase::Init(const MPCConfig &config) {
+  assert(Supports(config.N));
+  config_ = config;
+  N_ = config.N;
+  n_ = 2 * (N_ - 1);
+  ResetActuations();
+}
+
+template <int Steps>
+SqpSolver<Steps>::SqpSolver() {
+  memset(z_, 0, sizeof(z_));
+}
+
+template <int Steps>
+double SqpSolver<Steps>::Rollout(const InputVector &u,
+                                 double (*z)[kStateSize]) const {
+  const size_t N = Horizon();
+  const double dt = config_.dt;
+  const double Lf = config_.Lf;
+  const double ref_v = config_.ref_v;
+  if (z != z_) {
+    memcpy(z[0], z_[0], sizeof(z_[0]));
+  }
+
+  // the cost terms of FG_eval, the ones of the initial state are constant
+  double cost = 0;
+  for (size_t t = 0; t < N; ++t) {
+    const double *z0 = z[t];
+    cost += config_.w_cte * z0[4] * z0[4] + config_.w_epsi * z0[5] * z0[5] +
+            config_.w_v * (z0[3] - ref_v) * (z0[3] - ref_v);
+    if (t + 1 == N) {
+      break;
+    }
+
+    const double delta0 = u[2 * t];
+    const double a0 = u[2 * t + 1];
+    cost += config_.w_delta * delta0 * delta0 + config_.w_a * a0 * a0;
+    if (t + 2 < N) {
+      const double ddelta = u[2 * t + 2] - delta0;
+      const double da = u[2 * t + 3] - a0;
+      cost += config_.w_ddelta * ddelta * ddelta + config_.w_da * da * da;
+    }
+
+    // the model of FG_eval
+    double *z1 = z[t + 1];
+    const double x0 = z0[0], y0 = z0[1], psi0 = z0[2], v0 = z0[3];
+    const double epsi0 = z0[5];
+    z1[0] = x0 + v0 * cos(psi0) * dt;
+    z1[1] = y0 + v0 * sin(psi0) * dt;
+    z1[2] = psi0 - v0 * delta0 / Lf * dt;
+    z1[3] = v0 + a0 * dt;
+    z1[4] = Poly(x0) - y0 - v0 * sin(epsi0) * dt;
+    z1[5] = psi0 - atan(PolyDerivative(x0)) - v0 * delta0 / Lf * dt;
+  }
+  return cost;
+}
+
+template <int Steps>
+void SqpSolver<Steps>::Condense() {
+  enum { X, Y, PSI, V, CTE, EPSI };
+  const size_t N = Horizon();
+  const double dt = config_.dt;
+  const double Lf = config_.Lf;
+
+  H_.setZero(n_, n_);
+  g_.setZero(n_);
+  sensitivity_.setZero(kStateSize, n_);
+
+  for (size_t t = 0; t + 1 < N; ++t) {
+    const double *z0 = z_[t];
+    const double *z1 = z_[t + 1];
+    const double x0 = z0[X], psi0 = z0[PSI], v0 = z0[V], epsi0 = z0[EPSI];
+    const double delta0 = u_[2 * t];
+    const double slope = PolyDerivative(x0);
+
+    // S_t+1 = A_t S_t + B_t e_t, S_t only has entries in the first 2t columns
+    const int m = 2 * t;
+    if (m > 0) {
+      const Eigen::Matrix<double, kStateSize, Eigen::Dynamic, 0, kStateSize,
+                          kMaxInputs>
+          S = sensitivity_.leftCols(m);
+      sensitivity_.row(X).head(m) += -v0 * sin(psi0) * dt * S.row(PSI) +
+                                     cos(psi0) * dt * S.row(V);
+      sensitivity_.row(Y).head(m) +=
+          v0 * cos(psi0) * dt * S.row(PSI) + sin(psi0) * dt * S.row(V);
+      sensitivity_.row(PSI).head(m) += -delta0 / Lf * dt * S.row(V);
+      sensitivity_.row(CTE).head(m) =
+          slope * S.row(X) - S.row(Y) - sin(epsi0) * dt * S.row(V) -
+          v0 * cos(epsi0) * dt * S.row(EPSI);
+      sensitivity_.row(EPSI).head(m) =
+          S.row(PSI) -
+          PolySecondDerivative(x0) / (1 + slope * slope) * S.row(X) -
+          delta0 / Lf * dt * S.row(V);
+    }
+    sensitivity_(PSI, m) = -v0 / Lf * dt;
+    sensitivity_(EPSI, m) = -v0 / Lf * dt;
+    sensitivity_(V, m + 1) = dt;
+
+    // Gauss-Newton terms of the state costs at t + 1
+    const int columns = m + 2;
+    const double residuals[3] = {z1[CTE], z1[EPSI], z1[V] - config_.ref_v};
+    const double weights[3] = {config_.w_cte, config_.w_epsi, config_.w_v};
+    const int rows[3] = {CTE, EPSI, V};
+    for (int r = 0; r < 3; ++r) {
+      const auto s = sensitivity_.row(rows[r]).head(columns);
+      H_.topLeftCorner(columns, columns).noalias() +=
+          weights[r] * s.transpose() * s;
+      g_.head(columns) += weights[r] * residuals[r] * s.transpose();
+    }
+  }
+
+  // the actuation costs are quadratic in u already, even entries are
+  // steering and odd ones throttle
+  for (size_t i = 0; i < n_; ++i) {
+    const double weight = i % 2 == 0 ? config_.w_delta : config_.w_a;
+    H_(i, i) += weight;
+    g_[i] += weight * u_[i];
+    if (i + 2 < n_) {
+      const double gap_weight = i % 2 == 0 ? config_.w_ddelta : config_.w_da;
+      const double gap = u_[i + 2] - u_[i];
+      H_(i, i) += gap_weight;
+      H_(i + 2, i + 2) += gap_weight;
+      H_(i, i + 2) -= gap_weight;
+      H_(i + 2, i) -= gap_weight;
+      g_[i] -= gap_weight * gap;
+      g_[i + 2] += gap_weight * gap;
+    }
+  }
+}
+
+template <int Steps>
+void SqpSolver<Steps>::SolveBoxQp() {
+  // primal active-set method, starting at d = 0 with all bounds inactive
+  enum { FREE, LOWER, UPPER };
+  Eigen::Matrix<int, Eigen::Dynamic, 1, 0, kMaxInputs, 1> &active = bound_;
+  active.setConstant(n_, FREE);
+  free_.resize(n_);
+  d_.setZero(n_);
+
+  for (size_t iteration = 0; iteration < 4 * n_ + 4; ++iteration) {
+    // minimize over the free variables with the bound ones fixed
+    size_t free_count = 0;
+    for (size_t i = 0; i < n_; ++i) {
+      if (active[i] == FREE) {
+        free_[free_count++] = i;
+      }
+    }
+    reduced_H_.resize(free_count, free_count);
+    reduced_rhs_.resize(free_count);
+    for (size_t r = 0; r < free_count; ++r) {
+      const int i = free_[r];
+      double rhs = -g_[i];
+      for (size_t j = 0; j < n_; ++j) {
+        if (active[j] != FREE) {
+          rhs -= H_(i, j) * d_[j];
+        }
+      }
+      reduced_rhs_[r] = rhs;
+      for (size_t c = 0; c < free_count; ++c) {
+        reduced_H_(r, c) = H_(i, free_[c]);
+      }
+    }
+    if (free_count > 0) {
+      llt_.compute(reduced_H_);
+      candidate_ = llt_.solve(reduced_rhs_);
+    }
+
+    // move towards the minimizer until the first bound blocks
+    double step = 1;
+    int blocking = -1;
+    int blocking_bound = FREE;
+    for (size_t r = 0; r < free_count; ++r) {
+      const int i = free_[r];
+      const double direction = candidate_[r] - d_[i];
+      if (candidate_[r] < lo_[i] && direction < 0) {
+        const double limit = (lo_[i] - d_[i]) / direction;
+        if (limit < step) {
+          step = limit;
+          blocking = i;
+          blocking_bound = LOWER;
+        }
+      } else if (candidate_[r] > hi_[i] && direction > 0) {
+        const double limit = (hi_[i] - d_[i]) / direction;
+        if (limit < step) {
+          step = limit;
+          blocking = i;
+          blocking_bound = UPPER;
+        }
+      }
+    }
+    for (size_t r = 0; r < free_count; ++r) {
+      const int i = free_[r];
+      d_[i] += step * (candidate_[r] - d_[i]);
+    }
+    if (blocking >= 0) {
+      d_[blocking] = blocking_bound == LOWER ? lo_[blocking] : hi_[blocking];
+      active[blocking] = blocking_bound;
+      continue;
+    }
+
+    // optimal on this face, release the bound with the most violated
+    // multiplier
+    int release = -1;
+    double worst = 1e-12;
+    for (size_t i = 0; i < n_; ++i) {
+      if (active[i] == FREE) {
+        continue;
+      }
+      const double gradient = H_.row(i).head(n_).dot(d_) + g_[i];
+      const double violation = active[i] == LOWER ? -gradient : gradient;
+      if (violation > worst) {
+        worst = violation;
+        release = i;
+      }
+    }
+    if (release < 0) {
+      return;
+    }
+    active[release] = FREE;
+  }
+}
+
+template <int Steps>
+void SqpSolver<Steps>::ShiftActuations() {
+  for (size_t i = 0; i + 2 < n_; ++i) {
+    u_[i] = u_[i + 2];
+  }
+}
+
+template <int Steps>
+void SqpSolver<Steps>::Simulate(const Eigen::VectorXd &state,
+                                const Eigen::VectorXd &coeffs) {
+  assert(N_ >= 2 && state.size() == kStateSize && coeffs.size() == 4);
+  const size_t N = Horizon();
+  const double max_delta = config_.max_delta;
+  const double max_a = config_.max_a;
+  for (int i = 0; i < 4; ++i) {
+    coeffs_[i] = coeffs[i];
+  }
+  for (int i = 0; i < kStateSize; ++i) {
+    z_[0][i] = state[i];
+  }
+
+  // start from the current actuations, projected onto the bounds
+  for (size_t t = 0; t + 1 < N; ++t) {
+    u_[2 * t] = max(-max_delta, min(max_delta, u_[2 * t]));
+    u_[2 * t + 1] = max(-max_a, min(max_a, u_[2 * t + 1]));
+  }
+  cost_ = Rollout(u_, z_);
+  iterations_ = 0;
+  timed_out_ = false;
+}
+
+template <int Steps>
+bool SqpSolver<Steps>::Solve(const Eigen::VectorXd &state,
+                             const Eigen::VectorXd &coeffs) {
+  Simulate(state, coeffs);
+  const size_t N = Horizon();
+  const double max_delta = config_.max_delta;
+  const double max_a = config_.max_a;
+
+  lo_.resize(n_);
+  hi_.resize(n_);
+  const bool has_deadline =
+      deadline_ != std::chrono::steady_clock::time_point::max();
+  while (iterations_ < max_iterations_) {
+    if (has_deadline && std::chrono::steady_clock::now() >= deadline_) {
+      // the current iterate is the best one so far
+      timed_out_ = true;
+      return false;
+    }
+    Condense();
+    for (size_t t = 0; t + 1 < N; ++t) {
+      lo_[2 * t] = -max_delta - u_[2 * t];
+      hi_[2 * t] = max_delta - u_[2 * t];
+      lo_[2 * t + 1] = -max_a - u_[2 * t + 1];
+      hi_[2 * t + 1] = max_a - u_[2 * t + 1];
+    }
+    SolveBoxQp();
+
+    const double step = d_.cwiseAbs().maxCoeff();
+    if (step < tolerance_) {
+      return true;
+    }
+
+    // backtracking line search on the nonlinear cost (Armijo), the gradient
+    // of the cost is 2 g
+    const double slope = 2 * g_.dot(d_);
+    const double previous_cost = cost_;
+    double alpha = 1;
+    bool accepted = false;
+    for (int trial = 0; trial < 20; ++trial) {
+      u_trial_ = u_ + alpha * d_;
+      const double cost = Rollout(u_trial_, z_trial_);
+      if (cost <= cost_ + 1e-4 * alpha * slope) {
+        u_ = u_trial_;
+        memcpy(z_, z_trial_, N * sizeof(z_[0]));
+        cost_ = cost;
+        accepted = true;
+        break;
+      }
+      alpha *= 0.5;
+    }
+    ++iterations_;
+    if (!accepted || 2 * alpha * step < tolerance_ ||
+        previous_cost - cost_ <= 1e-6 * previous_cost) {
+      // no (relevant) further decrease along the Gauss-Newton direction
+      return true;
+    }
+  }
+  return false;
+}
+
+template class SqpSolver<0>;
+template class SqpSolver<10>;
+template class SqpSolver<15>;
+template class SqpSolver<20>;
+template class SqpSolver<25>;
+
+std::unique_ptr<SqpSolverBase> MakeSqpSolver(size_t N) {
+  switch (N) {
+    case 10: return std::unique_ptr<SqpSolverBase>(new SqpSolver<10>());
+    case 15: return std::unique_ptr<SqpSolverBase>(new SqpSolver<15>());
+    case 20: return std::unique_ptr<SqpSolverBase>(new SqpSolver<20>());
+    case 25: return std::unique_ptr<SqpSolverBase>(new SqpSolver<25>());
+    default: break;
+  }
+  if (N < 2 || N > size_t(SqpSolverBase::kMaxSteps)) {
+    return nullptr;
+  }
+  return std::unique_ptr<SqpSolverBase>(new SqpSolver<0>());
+}
@@ -0,0 +1,195 @@
+#ifndef SQP_SOLVER_H
+#define SQP_SOLVER_H
+
+#include <chrono>
+#include <memory>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "mpc_config.h"
+
+// Dedicated real-time solver for the kinematic bicycle MPC of FG_eval.
+//
+// The problem is solved in the actuations only (single shooting): the states
+// are a function of the initial state and the actuations, so the dynamics are
+// always satisfied and only the actuator bounds remain. Every iteration
+// linearizes the model along the current trajectory, condenses the states out
+// of the quadratic cost (Gauss-Newton) and solves the resulting box
+// constrained QP with a primal active-set method. A backtracking line search
+// on the nonlinear cost accepts the step. The actuation weights have to be
+// positive.
+//
+// SqpSolverBase is the interface of the solver for one horizon, see
+// SqpSolver for the implementations and MakeSqpSolver.
+class SqpSolverBase {
+ public:
+  // Longest horizon
+  static const int kMaxSteps = 32;
+  static const int kStateSize = 6;
+
+  SqpSolverBase();
+  virtual ~SqpSolverBase() {}
+
+  // Sets the model, the cost weights and the actuator bounds of the config,
+  // the horizon has to be one the solver supports. Resets the linearization
+  // point.
+  void Init(const MPCConfig &config);
+
+  // Sets the maximum number of SQP iterations and the step size (max norm of
+  // the actuation step) below which the solver stops.
+  void SetTermination(int max_iterations, double tolerance) {
+    max_iterations_ = max_iterations;
+    tolerance_ = tolerance;
+  }
+
+  // Stops the solver at the first iteration which would start after the
+  // deadline, the default time_point::max() never stops it.
+  void SetDeadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+  }
+
+  // Solves the MPC problem for the initial state [x, y, psi, v, cte, epsi] and
+  // the coefficients of the cubic reference polynomial. The solve starts from
+  // the current actuations (by default the ones of the previous solve).
+  // Returns false if the iteration limit or the deadline was reached before
+  // the step size dropped below the tolerance, the actuations are feasible
+  // (and no worse than the start) in any case.
+  virtual bool Solve(const Eigen::VectorXd &state,
+                     const Eigen::VectorXd &coeffs) = 0;
+
+  // Only simulates the model with the current actuations, so state() and
+  // cost() describe the trajectory the next Solve would start from.
+  virtual void Simulate(const Eigen::VectorXd &state,
+                        const Eigen::VectorXd &coeffs) = 0;
+
+  // Initial guesses of the next solve: ShiftActuations advances the
+  // actuations by one step and holds the last one for the new tail step,
+  // ResetActuations starts from zero, SetActuation overwrites step t.
+  virtual void ShiftActuations() = 0;
+  virtual void ResetActuations() = 0;
+  virtual void SetActuation(size_t t, double delta, double a) = 0;
+
+  // Results of the last solve
+  size_t N() const { return N_; }
+  virtual double delta(size_t t) const = 0;
+  virtual double a(size_t t) const = 0;
+  virtual const double *state(size_t t) const = 0;
+  double cost() const { return cost_; }
+  int iterations() const { return iterations_; }
+  // Whether the deadline stopped the last solve
+  bool timed_out() const { return timed_out_; }
+
+ protected:
+  // Whether the solver supports the horizon N
+  virtual bool Supports(size_t N) const = 0;
+
+  // Reference polynomial and its derivatives
+  double Poly(double x) const {
+    return coeffs_[0] + x * (coeffs_[1] + x * (coeffs_[2] + x * coeffs_[3]));
+  }
+  double PolyDerivative(double x) const {
+    return coeffs_[1] + x * (2 * coeffs_[2] + x * 3 * coeffs_[3]);
+  }
+  double PolySecondDerivative(double x) const {
+    return 2 * coeffs_[2] + x * 6 * coeffs_[3];
+  }
+
+  // problem
+  MPCConfig config_;
+  size_t N_;
+  size_t n_;  // number of actuations, 2 * (N - 1)
+  double coeffs_[4];
+  int max_iterations_;
+  double tolerance_;
+  std::chrono::steady_clock::time_point deadline_;
+
+  double cost_;
+  int iterations_;
+  bool timed_out_;
+};
+
+// Implementation for the horizon Steps with buffers of static size, the hot
+// path of the common horizons does not depend on runtime sizes. Steps = 0 is
+// the general instance for any horizon up to kMaxSteps (with buffers of
+// fixed maximum size). A solve does not allocate in either case.
+template <int Steps>
+class SqpSolver : public SqpSolverBase {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  SqpSolver();
+
+  bool Solve(const Eigen::VectorXd &state,
+             const Eigen::VectorXd &coeffs) override;
+  void Simulate(const Eigen::VectorXd &state,
+                const Eigen::VectorXd &coeffs) override;
+
+  void ShiftActuations() override;
+  void ResetActuations() override { u_.setZero(n_); }
+  void SetActuation(size_t t, double delta, double a) override {
+    u_[2 * t] = delta;
+    u_[2 * t + 1] = a;
+  }
+
+  double delta(size_t t) const override { return u_[2 * t]; }
+  double a(size_t t) const override { return u_[2 * t + 1]; }
+  const double *state(size_t t) const override { return z_[t]; }
+
+ protected:
+  bool Supports(size_t N) const override {
+    return Steps > 0 ? N == size_t(Steps) : N >= 2 && N <= size_t(kMaxSteps);
+  }
+
+ private:
+  static const int kStates = Steps > 0 ? Steps : kMaxSteps;
+  static const int kInputs = Steps > 0 ? 2 * (Steps - 1) : Eigen::Dynamic;
+  static const int kMaxInputs = 2 * (kStates - 1);
+
+  typedef Eigen::Matrix<double, kInputs, kInputs, 0, kMaxInputs, kMaxInputs>
+      InputMatrix;
+  typedef Eigen::Matrix<double, kInputs, 1, 0, kMaxInputs, 1> InputVector;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, kMaxInputs,
+                        kMaxInputs>
+      ReducedMatrix;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, kMaxInputs, 1>
+      ReducedVector;
+
+  // Horizon, a compile time constant for Steps > 0
+  size_t Horizon() const { return Steps > 0 ? size_t(Steps) : N_; }
+
+  // Simulates the model from z_[0] with the actuations u into z and returns
+  // the cost
+  double Rollout(const InputVector &u, double (*z)[kStateSize]) const;
+
+  // Linearizes along z_ / u_ and builds the condensed Gauss-Newton QP in H_
+  // and g_
+  void Condense();
+
+  // Solves min 0.5 d'Hd + g'd s.t. lo <= d <= hi into d_ (H_ positive
+  // definite, 0 feasible)
+  void SolveBoxQp();
+
+  // current iterate: actuations [delta_0, a_0, delta_1, ...] and the states
+  InputVector u_;
+  double z_[kStates][kStateSize];
+
+  // scratch
+  double z_trial_[kStates][kStateSize];
+  InputVector u_trial_;
+  Eigen::Matrix<double, kStateSize, kInputs, 0, kStateSize, kMaxInputs>
+      sensitivity_;  // d z_t / d u
+  InputMatrix H_;
+  InputVector g_, lo_, hi_, d_;
+
+  // active-set QP scratch
+  ReducedMatrix reduced_H_;
+  ReducedVector reduced_rhs_, candidate_;
+  Eigen::Matrix<int, Eigen::Dynamic, 1, 0, kMaxInputs, 1> free_, bound_;
+  Eigen::LLT<ReducedMatrix> llt_;
+};
+
+// Solver for the horizon N: an instance with static sizes for the horizons
+// 10, 15, 20 and 25, the general one otherwise. Returns nullptr if N is not
+// supported at all.
+std::unique_ptr<SqpSolverBase> MakeSqpSolver(size_t N);
+
+#endif /* SQP_SOLVER_H */
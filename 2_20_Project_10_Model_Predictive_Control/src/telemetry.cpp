@@ -0,0 +1,120 @@
+#include "telemetry.h"
+#include <math.h>
+#include <algorithm>
+#include <cassert>
+#include "Eigen-3.3/Eigen/QR"
+#include "waypoint_fit.h"
+
+using namespace std;
+
+// for convenience
+using json = nlohmann::json;
+
+string hasData(string s) {
+  auto found_null = s.find("null");
+  auto b1 = s.find_first_of("[");
+  auto b2 = s.rfind("}]");
+  if (found_null != string::npos) {
+    return "";
+  } else if (b1 != string::npos && b2 != string::npos) {
+    return s.substr(b1, b2 - b1 + 2);
+  }
+  return "";
+}
+
+void TelemetryFromJson(const json &data, Telemetry &telemetry) {
+  telemetry.ptsx = data["ptsx"].get<vector<double>>();
+  telemetry.ptsy = data["ptsy"].get<vector<double>>();
+  telemetry.x = data["x"];
+  telemetry.y = data["y"];
+  telemetry.psi = data["psi"];
+  telemetry.speed = data["speed"];
+  telemetry.steering_angle = data["steering_angle"];
+  telemetry.throttle = data["throttle"];
+}
+
+bool ParseTelemetry(const string &message, Telemetry &telemetry) {
+  if (message.size() <= 2 || message[0] != '4' || message[1] != '2') {
+    return false;
+  }
+  string s = hasData(message);
+  if (s == "") {
+    return false;
+  }
+  auto j = json::parse(s);
+  if (j[0].get<string>() != "telemetry") {
+    return false;
+  }
+  TelemetryFromJson(j[1], telemetry);
+  return true;
+}
+
+double polyeval(const Eigen::VectorXd &coeffs, double x) {
+  return Horner(coeffs, x);
+}
+
+// Adapted from
+// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
+Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
+                        int order) {
+  assert(xvals.size() == yvals.size());
+  assert(order >= 1 && order <= xvals.size() - 1);
+  Eigen::MatrixXd A(xvals.size(), order + 1);
+
+  for (int i = 0; i < xvals.size(); i++) {
+    A(i, 0) = 1.0;
+  }
+
+  for (int j = 0; j < xvals.size(); j++) {
+    for (int i = 0; i < order; i++) {
+      A(j, i + 1) = A(j, i) * xvals(j);
+    }
+  }
+
+  auto Q = A.householderQr();
+  auto result = Q.solve(yvals);
+  return result;
+}
+
+void PrepareMpcInput(const Telemetry &telemetry, const MPCConfig &config,
+                     Eigen::VectorXd &state, Eigen::VectorXd &coeffs) {
+  double px = telemetry.x;
+  double py = telemetry.y;
+  double psi = telemetry.psi;
+  double v = telemetry.speed;
+  double delta = telemetry.steering_angle;
+  double a = telemetry.throttle;
+
+  // the points we get are global so we first of all need to
+  // transform them into local space to be able to later
+  // make a local decision, and fit a third grade polnoymial to the
+  // relative, optimal line
+  coeffs = FitWaypoints<3>(telemetry.ptsx.data(), telemetry.ptsy.data(),
+                           min(telemetry.ptsx.size(), telemetry.ptsy.size()),
+                           px, py, psi);
+
+  // Calculate the initial cross track error
+  // Note: The points are provided and transformed to be relative to the
+  // car. The closer we are to the perfect line, the small the cte
+  double cte = coeffs[0];
+
+  // Calculate the initial orientation error
+  // As we calculate the points relative to the car the only valid value
+  // is the orientation provided at index 1
+  double eps = -atan(coeffs[1]);
+
+  // Predict the state at the time the actuations take effect. This
+  // is the actuation latency, not the time step of the MPC model.
+  const double latency = config.latency;
+  const double Lf = config.Lf;
+
+  double next_x = v * latency;
+  double next_y = 0;
+  double next_psi = v * -delta / Lf * latency;
+  double next_v = v + a * latency;
+  double next_cte = cte + v * sin(eps) * latency;
+  double next_eps = eps + -delta / Lf * latency;
+
+  state.resize(6);
+  state << next_x, next_y, next_psi, next_v, next_cte, next_eps;
+}
@@ -0,0 +1,48 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "json.hpp"
+#include "mpc_config.h"
+
+// Telemetry of one simulator frame
+struct Telemetry {
+  std::vector<double> ptsx, ptsy;  // Waypoints in map coordinates
+  double x, y, psi;                // Pose of the vehicle
+  double speed;
+  double steering_angle;
+  double throttle;
+  std::chrono::steady_clock::time_point received;  // Arrival of the frame
+};
+
+// Checks if the SocketIO event has JSON data.
+// If there is data the JSON object in string format will be returned,
+// else the empty string "" will be returned.
+std::string hasData(std::string s);
+
+// Reads the fields of the data object of a telemetry event
+void TelemetryFromJson(const nlohmann::json &data, Telemetry &telemetry);
+
+// Parses a whole "42["telemetry",{...}]" message, e.g. a line of the log
+// mpc prints. Returns false for other messages.
+bool ParseTelemetry(const std::string &message, Telemetry &telemetry);
+
+// Evaluate a polynomial.
+double polyeval(const Eigen::VectorXd &coeffs, double x);
+
+// Fit a polynomial of any order, see FitWaypoints (waypoint_fit.h) for the
+// cubic fit of the waypoints.
+Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
+                        int order);
+
+// Input of the MPC for a frame: fits the cubic reference polynomial to the
+// waypoints in vehicle coordinates (FitWaypoints) and predicts the state
+// [x, y, psi, v, cte, epsi] at the time the actuations take effect (after
+// config.latency). main.cpp and mpc_benchmark share this.
+void PrepareMpcInput(const Telemetry &telemetry, const MPCConfig &config,
+                     Eigen::VectorXd &state, Eigen::VectorXd &coeffs);
+
+#endif /* TELEMETRY_H */
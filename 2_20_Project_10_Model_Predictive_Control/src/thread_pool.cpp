@@ -0,0 +1,45 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threads) : stop_(false) {
+  for (size_t i = 0; i < max<size_t>(threads, 1); ++i) {
+    threads_.push_back(thread(&ThreadPool::Run, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (thread &t : threads_) {
+    t.join();
+  }
+}
+
+void ThreadPool::Submit(const function<void()> &task) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    tasks_.push_back(task);
+  }
+  wake_.notify_one();
+}
+
+void ThreadPool::Run() {
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock<mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
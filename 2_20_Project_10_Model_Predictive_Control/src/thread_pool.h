@@ -0,0 +1,34 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed number of threads which run the submitted tasks in FIFO order
+class ThreadPool {
+ public:
+  // Starts the threads, at least one
+  explicit ThreadPool(size_t threads);
+
+  // Runs the queued tasks to the end and joins the threads
+  ~ThreadPool();
+
+  void Submit(const std::function<void()> &task);
+
+  size_t size() const { return threads_.size(); }
+
+ private:
+  void Run();
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> threads_;
+};
+
+#endif /* THREAD_POOL_H */
@@ -0,0 +1,85 @@
+#ifndef WAYPOINT_FIT_H
+#define WAYPOINT_FIT_H
+
+#include <math.h>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/Core"
+
+// Transforms the waypoints into the vehicle frame of the pose (px, py, psi)
+// and fits the polynomial y = c_0 + c_1 x + ... + c_Order x^Order to them by
+// least squares.
+//
+// Transform and fit are one pass over the waypoints without allocations: the
+// rotation is computed once and every transformed point is added to the
+// power sums of the normal equations, a fixed size system which is solved
+// with a Cholesky decomposition on the stack. x is scaled by the larger
+// distance of the first and the last waypoint (the simulator sends them in
+// order along the track) so the normal equations stay well conditioned; the
+// coefficients are scaled back afterwards. At least Order + 1 waypoints with
+// distinct x are required.
+template <int Order>
+Eigen::Matrix<double, Order + 1, 1> FitWaypoints(const double *ptsx,
+                                                 const double *ptsy,
+                                                 size_t count, double px,
+                                                 double py, double psi) {
+  const int n = Order + 1;
+  assert(count >= size_t(n));
+
+  const double c = cos(-psi);
+  const double s = sin(-psi);
+  const double first = (ptsx[0] - px) * c - (ptsy[0] - py) * s;
+  const double last =
+      (ptsx[count - 1] - px) * c - (ptsy[count - 1] - py) * s;
+  const double scale = 1.0 / std::max(1.0, std::max(fabs(first), fabs(last)));
+
+  // sums of x^k for k < 2n - 1 and of y x^k for k < n
+  double sums[2 * n - 1] = {};
+  double rhs[n] = {};
+  for (size_t i = 0; i < count; ++i) {
+    // waypoint relative to the vehicle, rotated into its frame
+    const double dx = ptsx[i] - px;
+    const double dy = ptsy[i] - py;
+    const double x = (dx * c - dy * s) * scale;
+    const double y = dx * s + dy * c;
+    double power = 1;
+    for (int k = 0; k < 2 * n - 1; ++k) {
+      sums[k] += power;
+      if (k < n) {
+        rhs[k] += power * y;
+      }
+      power *= x;
+    }
+  }
+
+  Eigen::Matrix<double, n, n> normal;
+  Eigen::Matrix<double, n, 1> b;
+  for (int i = 0; i < n; ++i) {
+    b[i] = rhs[i];
+    for (int j = 0; j < n; ++j) {
+      normal(i, j) = sums[i + j];
+    }
+  }
+  Eigen::Matrix<double, n, 1> coeffs = normal.llt().solve(b);
+  double factor = 1;
+  for (int k = 0; k < n; ++k) {
+    coeffs[k] *= factor;
+    factor *= scale;
+  }
+  return coeffs;
+}
+
+// Evaluates the polynomial with the coefficients c_0, c_1, ... at x with the
+// Horner scheme
+template <class Coeffs>
+double Horner(const Coeffs &coeffs, double x) {
+  double result = 0;
+  for (int i = int(coeffs.size()) - 1; i >= 0; --i) {
+    result = result * x + coeffs[i];
+  }
+  return result;
+}
+
+#endif /* WAYPOINT_FIT_H */
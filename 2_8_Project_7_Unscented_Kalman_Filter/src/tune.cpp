@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include "tuner.h"
+
+using namespace std;
+
+// Headless tuning of std_a_ and std_yawdd_ against a recorded measurement log.
+//
+// usage: UKFTune <log file> [options]
+//   --grid A_MIN A_MAX A_STEPS YAWDD_MIN YAWDD_MAX YAWDD_STEPS   (default 0.1 5 40 0.05 3 40)
+//   --bo BUDGET       Bayesian optimization with BUDGET UKF runs instead of the grid
+//   --threads N       worker threads, default: all cores
+//   --top K           number of ranked configurations to print, default 10
+
+void usage()
+{
+  cerr << "usage: UKFTune <log file> [--grid A_MIN A_MAX A_STEPS YAWDD_MIN YAWDD_MAX YAWDD_STEPS]"
+       << " [--bo BUDGET] [--threads N] [--top K]" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+  {
+    usage();
+    return -1;
+  }
+
+  double a_min = 0.1, a_max = 5.0, yawdd_min = 0.05, yawdd_max = 3.0;
+  int a_steps = 40, yawdd_steps = 40;
+  int budget = 0;
+  unsigned int threads = 0;
+  size_t top = 10;
+
+  for(int i = 2; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--grid") == 0 && i + 6 < argc)
+    {
+      a_min = atof(argv[++i]);
+      a_max = atof(argv[++i]);
+      a_steps = atoi(argv[++i]);
+      yawdd_min = atof(argv[++i]);
+      yawdd_max = atof(argv[++i]);
+      yawdd_steps = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--bo") == 0 && i + 1 < argc)
+    {
+      budget = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+      threads = atoi(argv[++i]);
+    }
+    else if(strcmp(argv[i], "--top") == 0 && i + 1 < argc)
+    {
+      top = atoi(argv[++i]);
+    }
+    else
+    {
+      usage();
+      return -1;
+    }
+  }
+
+  if(a_min <= 0 || a_max <= 0 || yawdd_min <= 0 || yawdd_max <= 0 || a_steps < 1 || yawdd_steps < 1)
+  {
+    cerr << "Noise bounds must be positive and step counts at least 1" << endl;
+    return -1;
+  }
+
+  vector<LogEntry> log;
+  if(!Tuner::ReadLog(argv[1], log))
+  {
+    cerr << "Error: Could not read measurement log " << argv[1] << endl;
+    return -1;
+  }
+
+  Tuner tuner(log, threads);
+
+  auto start = chrono::steady_clock::now();
+  vector<TuningResult> results = budget > 0
+      ? tuner.BayesianSearch(a_min, a_max, yawdd_min, yawdd_max, budget)
+      : tuner.GridSearch(a_min, a_max, a_steps, yawdd_min, yawdd_max, yawdd_steps);
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << "Evaluated " << results.size() << " configurations over " << log.size()
+       << " measurements in " << elapsed << " s on " << tuner.threads() << " threads" << endl;
+
+  cout << setw(5) << "rank" << setw(10) << "std_a" << setw(10) << "std_yawdd"
+       << setw(10) << "rmse_px" << setw(10) << "rmse_py" << setw(10) << "rmse_vx" << setw(10) << "rmse_vy"
+       << setw(10) << "nis_rad" << setw(10) << "nis_las" << endl;
+  cout << fixed << setprecision(4);
+  for(size_t i = 0; i < results.size() && i < top; ++i)
+  {
+    const TuningResult &r = results[i];
+    cout << setw(5) << i + 1 << setw(10) << r.config.std_a << setw(10) << r.config.std_yawdd
+         << setw(10) << r.rmse(0) << setw(10) << r.rmse(1) << setw(10) << r.rmse(2) << setw(10) << r.rmse(3)
+         << setw(10) << r.nis_radar_inside << setw(10) << r.nis_laser_inside
+         << (r.consistent ? "" : "  (NIS inconsistent)") << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,370 @@
+#include "tuner.h"
+#include "ukf.h"
+#include "tools.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+namespace {
+
+// chi-square 95% / 5% bounds
+const double kRadarNISLow = 0.352;  // 3 dof
+const double kRadarNISHigh = 7.815;
+const double kLaserNISLow = 0.103;  // 2 dof
+const double kLaserNISHigh = 5.991;
+
+// fraction of radar NIS values that must lie inside the band
+const double kRadarNISRequired = 0.8;
+
+// value assigned to diverged runs so they end up at the bottom of the ranking
+const double kDiverged = 1e9;
+
+/**
+ * Objective minimized by the Bayesian search: log RMSE sum with a fixed
+ * penalty for configurations that violate the NIS criterion.
+ */
+double Objective(const TuningResult &result)
+{
+  return log(result.rmse_sum) + (result.consistent ? 0.0 : 1.0);
+}
+
+/**
+ * Squared exponential kernel on normalized parameters.
+ */
+double Kernel(const VectorXd &a, const VectorXd &b, double length)
+{
+  return exp(-0.5 * (a - b).squaredNorm() / (length * length));
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+Tuner::Tuner(const vector<LogEntry> &log, unsigned int threads)
+  : log_(log), threads_(threads)
+{
+  if(threads_ == 0)
+  {
+    threads_ = max(1u, thread::hardware_concurrency());
+  }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool Tuner::ReadLog(const string &filename, vector<LogEntry> &log)
+{
+  ifstream in_file(filename.c_str(), ifstream::in);
+  if(!in_file)
+  {
+    return false;
+  }
+
+  string line;
+  while(getline(in_file, line))
+  {
+    istringstream iss(line);
+    string sensor_type;
+    long long timestamp;
+    LogEntry entry;
+
+    iss >> sensor_type;
+
+    if(sensor_type.compare("L") == 0)
+    {
+      float px, py;
+      iss >> px >> py >> timestamp;
+      entry.meas_package.sensor_type_ = MeasurementPackage::LASER;
+      entry.meas_package.raw_measurements_ = VectorXd(2);
+      entry.meas_package.raw_measurements_ << px, py;
+    }
+    else if(sensor_type.compare("R") == 0)
+    {
+      float ro, theta, ro_dot;
+      iss >> ro >> theta >> ro_dot >> timestamp;
+      entry.meas_package.sensor_type_ = MeasurementPackage::RADAR;
+      entry.meas_package.raw_measurements_ = VectorXd(3);
+      entry.meas_package.raw_measurements_ << ro, theta, ro_dot;
+    }
+    else
+    {
+      continue;
+    }
+    entry.meas_package.timestamp_ = timestamp;
+
+    float x_gt, y_gt, vx_gt, vy_gt;
+    iss >> x_gt >> y_gt >> vx_gt >> vy_gt;
+    if(!iss)
+    {
+      continue;
+    }
+    entry.gt_values = VectorXd(4);
+    entry.gt_values << x_gt, y_gt, vx_gt, vy_gt;
+
+    log.push_back(entry);
+  }
+
+  return !log.empty();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+TuningResult Tuner::Evaluate(const NoiseConfig &config) const
+{
+  UKF ukf;
+  ukf.std_a_ = config.std_a;
+  ukf.std_yawdd_ = config.std_yawdd;
+
+  Tools tools;
+  vector<VectorXd> estimations;
+  vector<VectorXd> ground_truth;
+  estimations.reserve(log_.size());
+  ground_truth.reserve(log_.size());
+
+  int radar_count = 0, radar_inside = 0;
+  int laser_count = 0, laser_inside = 0;
+
+  for(size_t i = 0; i < log_.size(); ++i)
+  {
+    const MeasurementPackage &meas_package = log_[i].meas_package;
+    const bool initialized = ukf.is_initialized_;
+
+    ukf.ProcessMeasurement(meas_package);
+
+    // the first measurement only initializes the state, it has no NIS
+    if(initialized)
+    {
+      if(meas_package.sensor_type_ == MeasurementPackage::RADAR)
+      {
+        ++radar_count;
+        radar_inside += (ukf.NIS_radar_ > kRadarNISLow && ukf.NIS_radar_ < kRadarNISHigh);
+      }
+      else
+      {
+        ++laser_count;
+        laser_inside += (ukf.NIS_laser_ > kLaserNISLow && ukf.NIS_laser_ < kLaserNISHigh);
+      }
+    }
+
+    double v = ukf.x_(2);
+    double yaw = ukf.x_(3);
+
+    VectorXd estimate(4);
+    estimate << ukf.x_(0), ukf.x_(1), cos(yaw) * v, sin(yaw) * v;
+
+    estimations.push_back(estimate);
+    ground_truth.push_back(log_[i].gt_values);
+  }
+
+  TuningResult result;
+  result.config = config;
+  result.rmse = tools.CalculateRMSE(estimations, ground_truth);
+  result.rmse_sum = result.rmse.sum();
+  if(!std::isfinite(result.rmse_sum))
+  {
+    result.rmse_sum = kDiverged;
+  }
+  result.nis_radar_inside = radar_count ? double(radar_inside) / radar_count : 1.0;
+  result.nis_laser_inside = laser_count ? double(laser_inside) / laser_count : 1.0;
+  result.consistent = result.nis_radar_inside >= kRadarNISRequired;
+
+  return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+vector<TuningResult> Tuner::EvaluateAll(const vector<NoiseConfig> &configs) const
+{
+  vector<TuningResult> results(configs.size());
+  atomic<size_t> next(0);
+
+  // workers pull the next configuration index until all are done
+  auto worker = [&]()
+  {
+    for(size_t i = next++; i < configs.size(); i = next++)
+    {
+      results[i] = Evaluate(configs[i]);
+    }
+  };
+
+  unsigned int n_threads = min<size_t>(threads_, configs.size());
+  vector<thread> pool;
+  for(unsigned int t = 1; t < n_threads; ++t)
+  {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for(size_t t = 0; t < pool.size(); ++t)
+  {
+    pool[t].join();
+  }
+
+  return results;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+vector<TuningResult> Tuner::GridSearch(double a_min, double a_max, int a_steps,
+                                       double yawdd_min, double yawdd_max, int yawdd_steps) const
+{
+  vector<NoiseConfig> configs;
+  configs.reserve(a_steps * yawdd_steps);
+
+  for(int i = 0; i < a_steps; ++i)
+  {
+    double ta = a_steps > 1 ? double(i) / (a_steps - 1) : 0.0;
+    double std_a = a_min * pow(a_max / a_min, ta);
+    for(int j = 0; j < yawdd_steps; ++j)
+    {
+      double ty = yawdd_steps > 1 ? double(j) / (yawdd_steps - 1) : 0.0;
+      NoiseConfig config;
+      config.std_a = std_a;
+      config.std_yawdd = yawdd_min * pow(yawdd_max / yawdd_min, ty);
+      configs.push_back(config);
+    }
+  }
+
+  vector<TuningResult> results = EvaluateAll(configs);
+  Rank(results);
+  return results;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+vector<TuningResult> Tuner::BayesianSearch(double a_min, double a_max,
+                                           double yawdd_min, double yawdd_max,
+                                           int budget, unsigned int seed) const
+{
+  const double length = 0.2;        // kernel length scale in normalized units
+  const double noise = 1e-6;        // observation noise (the UKF is deterministic)
+  const int n_candidates = 2000;    // acquisition samples per round
+
+  mt19937 gen(seed);
+  uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  // map a point of the unit square to a noise configuration (log scale)
+  auto to_config = [&](const VectorXd &u)
+  {
+    NoiseConfig config;
+    config.std_a = a_min * pow(a_max / a_min, u(0));
+    config.std_yawdd = yawdd_min * pow(yawdd_max / yawdd_min, u(1));
+    return config;
+  };
+
+  vector<VectorXd> points;
+  vector<TuningResult> results;
+
+  // initial space filling design: one jittered stratum per batch slot
+  int n_init = min(budget, max<int>(2 * threads_, 8));
+  vector<NoiseConfig> batch;
+  for(int i = 0; i < n_init; ++i)
+  {
+    VectorXd u(2);
+    u << (i + uniform(gen)) / n_init, uniform(gen);
+    points.push_back(u);
+    batch.push_back(to_config(u));
+  }
+  results = EvaluateAll(batch);
+
+  while((int)results.size() < budget)
+  {
+    const int n = points.size();
+
+    // standardize the observed objective
+    VectorXd y(n);
+    for(int i = 0; i < n; ++i)
+    {
+      y(i) = Objective(results[i]);
+    }
+    double mean = y.mean();
+    double stddev = sqrt((y.array() - mean).square().sum() / n) + 1e-12;
+    y = (y.array() - mean) / stddev;
+    double best = y.minCoeff();
+
+    MatrixXd K(n, n);
+    for(int i = 0; i < n; ++i)
+    {
+      for(int j = 0; j < n; ++j)
+      {
+        K(i, j) = Kernel(points[i], points[j], length);
+      }
+      K(i, i) += noise;
+    }
+    Eigen::LLT<MatrixXd> llt(K);
+    VectorXd alpha = llt.solve(y);
+
+    // expected improvement on random candidates
+    vector<pair<double, VectorXd> > scored;
+    scored.reserve(n_candidates);
+    for(int c = 0; c < n_candidates; ++c)
+    {
+      VectorXd u(2);
+      u << uniform(gen), uniform(gen);
+
+      VectorXd k(n);
+      for(int i = 0; i < n; ++i)
+      {
+        k(i) = Kernel(u, points[i], length);
+      }
+      double mu = k.dot(alpha);
+      double var = max(1e-12, 1.0 - k.dot(llt.solve(k)));
+      double sigma = sqrt(var);
+      double z = (best - mu) / sigma;
+      double cdf = 0.5 * erfc(-z / sqrt(2.0));
+      double pdf = exp(-0.5 * z * z) / sqrt(2.0 * M_PI);
+      scored.push_back(make_pair((best - mu) * cdf + sigma * pdf, u));
+    }
+    sort(scored.begin(), scored.end(),
+         [](const pair<double, VectorXd> &a, const pair<double, VectorXd> &b) { return a.first > b.first; });
+
+    // take the best candidates that are not too close to each other
+    int batch_size = min<int>(threads_, budget - results.size());
+    vector<VectorXd> chosen;
+    for(size_t c = 0; c < scored.size() && (int)chosen.size() < batch_size; ++c)
+    {
+      bool separated = true;
+      for(size_t k = 0; k < chosen.size(); ++k)
+      {
+        separated = separated && (scored[c].second - chosen[k]).norm() > 0.25 * length;
+      }
+      if(separated)
+      {
+        chosen.push_back(scored[c].second);
+      }
+    }
+
+    batch.clear();
+    for(size_t c = 0; c < chosen.size(); ++c)
+    {
+      points.push_back(chosen[c]);
+      batch.push_back(to_config(chosen[c]));
+    }
+    vector<TuningResult> batch_results = EvaluateAll(batch);
+    results.insert(results.end(), batch_results.begin(), batch_results.end());
+  }
+
+  Rank(results);
+  return results;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+void Tuner::Rank(vector<TuningResult> &results)
+{
+  stable_sort(results.begin(), results.end(),
+              [](const TuningResult &a, const TuningResult &b)
+              {
+                if(a.consistent != b.consistent)
+                {
+                  return a.consistent;
+                }
+                return a.rmse_sum < b.rmse_sum;
+              });
+}
@@ -0,0 +1,115 @@
+#ifndef TUNER_H_
+#define TUNER_H_
+
+#include "measurement_package.h"
+#include "Eigen/Dense"
+#include <vector>
+#include <string>
+
+using Eigen::VectorXd;
+
+/**
+ * One recorded line of a measurement log: the measurement itself and the
+ * ground truth [px, py, vx, vy] that belongs to it.
+ */
+struct LogEntry {
+  MeasurementPackage meas_package;
+  VectorXd gt_values;
+};
+
+/**
+ * Process noise setting evaluated by the tuner.
+ */
+struct NoiseConfig {
+  double std_a;
+  double std_yawdd;
+};
+
+/**
+ * Result of replaying a log through one UKF configured with a NoiseConfig.
+ */
+struct TuningResult {
+  NoiseConfig config;
+
+  ///* RMSE of [px, py, vx, vy]
+  VectorXd rmse;
+
+  ///* sum of the four RMSE components, used for ranking
+  double rmse_sum;
+
+  ///* fraction of radar NIS values inside the 95%/5% chi-square band (3 dof)
+  double nis_radar_inside;
+
+  ///* fraction of laser NIS values inside the 95%/5% chi-square band (2 dof)
+  double nis_laser_inside;
+
+  ///* true if the radar NIS criterion of the rubric (>= 80% inside) holds
+  bool consistent;
+};
+
+/**
+ * Headless tuning of the UKF process noise parameters std_a_ and std_yawdd_
+ * against a recorded measurement log. Every configuration runs in its own UKF
+ * instance; the parsed log is shared read-only between worker threads.
+ */
+class Tuner {
+public:
+  /**
+   * Constructor.
+   * @param log Parsed measurement log, see ReadLog
+   * @param threads Number of worker threads, 0 selects hardware concurrency
+   */
+  Tuner(const std::vector<LogEntry> &log, unsigned int threads = 0);
+
+  /**
+   * Reads a measurement log in the "L|R meas... timestamp gt_px gt_py gt_vx gt_vy"
+   * text format used by the simulator and the EKF project data files.
+   * @param filename Path to the log file
+   * @param log Output vector of parsed entries
+   * @return True if the file could be read and contained at least one entry
+   */
+  static bool ReadLog(const std::string &filename, std::vector<LogEntry> &log);
+
+  /**
+   * Replays the log through one UKF configured with config.
+   */
+  TuningResult Evaluate(const NoiseConfig &config) const;
+
+  /**
+   * Evaluates all configs in parallel.
+   * @return One result per config, in the order of configs
+   */
+  std::vector<TuningResult> EvaluateAll(const std::vector<NoiseConfig> &configs) const;
+
+  /**
+   * Evaluates a regular grid spaced logarithmically between the given bounds.
+   * @return Results ranked best first, see Rank
+   */
+  std::vector<TuningResult> GridSearch(double a_min, double a_max, int a_steps,
+                                       double yawdd_min, double yawdd_max, int yawdd_steps) const;
+
+  /**
+   * Bayesian optimization with a Gaussian process surrogate over
+   * (log std_a, log std_yawdd) and the expected improvement acquisition.
+   * Candidates are evaluated in batches of one per worker thread.
+   * @param budget Total number of UKF runs
+   * @param seed Seed for the initial design and the candidate sampling
+   * @return All evaluated results ranked best first, see Rank
+   */
+  std::vector<TuningResult> BayesianSearch(double a_min, double a_max,
+                                           double yawdd_min, double yawdd_max,
+                                           int budget, unsigned int seed = 42) const;
+
+  /**
+   * Sorts results: NIS-consistent configurations first, then by RMSE sum.
+   */
+  static void Rank(std::vector<TuningResult> &results);
+
+  unsigned int threads() const { return threads_; }
+
+private:
+  const std::vector<LogEntry> &log_;
+  unsigned int threads_;
+};
+
+#endif /* TUNER_H_ */